@@ -0,0 +1,471 @@
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+#include "diarkis_client/rpc.h"
+#include "diarkis/commands.h"
+#include "histogram.h"
+
+DEFINE_string(server, "127.0.0.1:9100", "Server address (IP:PORT or unix:///path)");
+DEFINE_int32(connections, 4, "Number of client connections");
+DEFINE_int32(threads, 4, "Number of worker threads");
+DEFINE_int32(duration_s, 30, "Measured run duration in seconds");
+DEFINE_int32(warmup_s, 5, "Warmup duration in seconds (not measured)");
+DEFINE_string(mode, "closed", "Load model: closed (back-to-back) or open (fixed arrival rate)");
+DEFINE_double(rate, 1000.0, "Target total ops/s in open-loop mode");
+DEFINE_string(mix, "read:80,write:20",
+              "Operation weights: read, write, append, create, delete, list, rename");
+DEFINE_string(size_dist, "fixed", "File size distribution: fixed, uniform or exponential");
+DEFINE_int64(file_size, 4096, "File size in bytes (fixed) or mean size (exponential)");
+DEFINE_int64(min_size, 1, "Minimum file size in bytes (uniform)");
+DEFINE_int64(max_size, 1024 * 1024, "Maximum file size in bytes (uniform, exponential cap)");
+DEFINE_int32(dirs, 16, "Number of directories (directory fan-out)");
+DEFINE_int32(files_per_dir, 64, "Number of files per directory");
+DEFINE_string(prefix, "bench", "Root directory for benchmark files");
+DEFINE_bool(prepopulate, true, "Create directories and files before the run");
+DEFINE_int32(prepopulate_batch, 256, "Commands per BATCH request while prepopulating (1 disables batching)");
+DEFINE_uint64(seed, 42, "Random seed");
+DEFINE_bool(verbose, false, "Log client errors");
+DEFINE_bool(compact, false, "Encode commands in the compact binary format instead of MessagePack");
+DEFINE_string(compression, "none", "Negotiate payload compression with the server (none, lz4, zstd)");
+DEFINE_int32(shared_memory_mb, 0, "Over unix:// addresses, move connections onto shared memory rings of this size (0 disables)");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using diarkis::commands::Command;
+using diarkis::commands::Response;
+using diarkis::commands::Type;
+using diarkis::bench::LatencyHistogram;
+
+enum class Op { READ, WRITE, APPEND, CREATE, DELETE, LIST, RENAME, COUNT };
+
+constexpr const char* OP_NAMES[] = {
+    "read", "write", "append", "create", "delete", "list", "rename"
+};
+constexpr size_t NUM_OPS = static_cast<size_t>(Op::COUNT);
+
+struct Workload {
+    std::vector<double> weights = std::vector<double>(NUM_OPS, 0.0);
+    bool open_loop = false;
+};
+
+struct OpStats {
+    LatencyHistogram latency;
+    int64_t errors = 0;
+    int64_t bytes = 0;
+};
+
+struct ThreadStats {
+    std::vector<OpStats> ops = std::vector<OpStats>(NUM_OPS);
+};
+
+bool parse_server(const std::string& server, std::string& host, uint16_t& port) {
+    if (diarkis_client::is_unix_endpoint(server)) {
+        host = server;
+        port = 0;
+        return true;
+    }
+    
+    auto pos = server.rfind(':');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    host = server.substr(0, pos);
+    int p = std::atoi(server.c_str() + pos + 1);
+    if (p <= 0 || p > 65535) {
+        return false;
+    }
+    port = static_cast<uint16_t>(p);
+    return true;
+}
+
+bool parse_mix(const std::string& mix, Workload& workload) {
+    std::istringstream iss(mix);
+    std::string item;
+    double total = 0.0;
+
+    while (std::getline(iss, item, ',')) {
+        auto pos = item.find(':');
+        if (pos == std::string::npos) {
+            return false;
+        }
+        std::string name = item.substr(0, pos);
+        double weight = std::atof(item.c_str() + pos + 1);
+
+        size_t i = 0;
+        for (; i < NUM_OPS; ++i) {
+            if (name == OP_NAMES[i]) break;
+        }
+        if (i == NUM_OPS || weight < 0) {
+            return false;
+        }
+        workload.weights[i] = weight;
+        total += weight;
+    }
+    return total > 0;
+}
+
+class SizeGenerator {
+public:
+    explicit SizeGenerator(uint64_t seed) : rng_(seed) {}
+
+    size_t next() {
+        if (FLAGS_size_dist == "uniform") {
+            std::uniform_int_distribution<int64_t> dist(FLAGS_min_size, FLAGS_max_size);
+            return static_cast<size_t>(dist(rng_));
+        }
+        if (FLAGS_size_dist == "exponential") {
+            std::exponential_distribution<double> dist(1.0 / static_cast<double>(FLAGS_file_size));
+            int64_t size = static_cast<int64_t>(dist(rng_));
+            return static_cast<size_t>(std::clamp<int64_t>(size, 1, FLAGS_max_size));
+        }
+        return static_cast<size_t>(FLAGS_file_size);
+    }
+
+private:
+    std::mt19937_64 rng_;
+};
+
+std::string dir_path(int dir) {
+    return FLAGS_prefix + "/d" + std::to_string(dir);
+}
+
+std::string file_path(int dir, int file) {
+    return dir_path(dir) + "/f" + std::to_string(file);
+}
+
+class Worker {
+public:
+    Worker(int id, const Workload& workload, std::vector<std::unique_ptr<diarkis_client::RpcClient>> clients,
+           double rate)
+        : id_(id), workload_(workload), clients_(std::move(clients)), rate_(rate),
+          rng_(FLAGS_seed + static_cast<uint64_t>(id)), sizes_(FLAGS_seed * 31 + static_cast<uint64_t>(id)),
+          op_dist_(workload.weights.begin(), workload.weights.end()) {}
+
+    void run(Clock::time_point measure_start, Clock::time_point end,
+             const std::atomic<bool>& stop) {
+        const auto interval = rate_ > 0
+            ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rate_))
+            : Clock::duration::zero();
+        auto next_send = Clock::now();
+
+        while (!stop.load(std::memory_order_relaxed)) {
+            Clock::time_point start;
+            if (workload_.open_loop) {
+                // Latency is measured from the intended send time so that
+                // server stalls are not hidden (coordinated omission).
+                std::this_thread::sleep_until(next_send);
+                start = next_send;
+                next_send += interval;
+            } else {
+                start = Clock::now();
+            }
+
+            if (start >= end) {
+                break;
+            }
+
+            Op op = static_cast<Op>(op_dist_(rng_));
+            size_t bytes = 0;
+            bool ok = execute(op, bytes);
+            auto finish = Clock::now();
+
+            if (start < measure_start) {
+                continue;
+            }
+
+            auto& stats = stats_.ops[static_cast<size_t>(op)];
+            stats.latency.record(
+                std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count());
+            stats.bytes += static_cast<int64_t>(bytes);
+            if (!ok) {
+                stats.errors++;
+            }
+        }
+    }
+
+    const ThreadStats& stats() const { return stats_; }
+
+private:
+    bool execute(Op op, size_t& bytes) {
+        auto& client = *clients_[next_client_++ % clients_.size()];
+        std::uniform_int_distribution<int> dir_dist(0, FLAGS_dirs - 1);
+        std::uniform_int_distribution<int> file_dist(0, FLAGS_files_per_dir - 1);
+        int dir = dir_dist(rng_);
+        int file = file_dist(rng_);
+
+        Command cmd;
+        cmd.path = file_path(dir, file);
+
+        switch (op) {
+            case Op::READ:
+                cmd.type = Type::READ_FILE;
+                break;
+            case Op::WRITE:
+                cmd.type = Type::WRITE_FILE;
+                cmd.contents.resize(sizes_.next(), static_cast<uint8_t>('a' + id_ % 26));
+                break;
+            case Op::APPEND:
+                cmd.type = Type::APPEND_FILE;
+                cmd.contents.resize(sizes_.next(), static_cast<uint8_t>('a' + id_ % 26));
+                break;
+            case Op::CREATE:
+                cmd.type = Type::CREATE_FILE;
+                break;
+            case Op::DELETE:
+                cmd.type = Type::DELETE_FILE;
+                break;
+            case Op::LIST:
+                cmd.type = Type::LIST_DIR;
+                cmd.path = dir_path(dir);
+                break;
+            case Op::RENAME:
+                // Rename back and forth between two names of the same slot
+                cmd.type = Type::RENAME;
+                cmd.new_path = cmd.path + ".r";
+                break;
+            default:
+                return false;
+        }
+
+        bytes = cmd.contents.size();
+        Response resp = client.send_command(cmd);
+        if (!resp.success) {
+            if (FLAGS_verbose) {
+                spdlog::warn("{} {} failed: {}", OP_NAMES[static_cast<size_t>(op)], cmd.path, resp.error);
+            }
+            return false;
+        }
+
+        if (op == Op::READ) {
+            bytes = resp.data.size();
+        } else if (op == Op::RENAME) {
+            Command back(Type::RENAME, cmd.new_path, cmd.path);
+            client.send_command(back);
+        }
+        return true;
+    }
+
+    int id_;
+    const Workload& workload_;
+    std::vector<std::unique_ptr<diarkis_client::RpcClient>> clients_;
+    double rate_;
+    std::mt19937_64 rng_;
+    SizeGenerator sizes_;
+    std::discrete_distribution<int> op_dist_;
+    size_t next_client_ = 0;
+    ThreadStats stats_;
+};
+
+bool prepopulate(const std::string& host, uint16_t port) {
+    diarkis_client::RpcClient client(host, port);
+    if (!client.connect()) {
+        return false;
+    }
+
+    SizeGenerator sizes(FLAGS_seed);
+    auto check = [](const Response& resp, const std::string& path) {
+        if (!resp.success) {
+            spdlog::error("Prepopulate failed for {}: {}", path, resp.error);
+        }
+        return resp.success;
+    };
+
+    if (!check(client.send_command(Command(Type::CREATE_DIR, FLAGS_prefix)), FLAGS_prefix)) {
+        return false;
+    }
+
+    // Commands are sent in batches, flushed early to stay well below the request limit
+    constexpr size_t MAX_BATCH_BYTES = 16 * 1024 * 1024;
+    std::vector<Command> batch;
+    size_t batch_bytes = 0;
+    auto flush = [&]() {
+        std::vector<Response> responses = FLAGS_prepopulate_batch > 1
+            ? client.send_batch(batch)
+            : std::vector<Response>{client.send_command(batch.front())};
+        for (size_t i = 0; i < responses.size(); ++i) {
+            if (!check(responses[i], batch[i].path)) {
+                return false;
+            }
+        }
+        batch.clear();
+        batch_bytes = 0;
+        return true;
+    };
+    auto add = [&](Command cmd) {
+        batch_bytes += cmd.contents.size();
+        batch.push_back(std::move(cmd));
+        if (batch.size() >= static_cast<size_t>(std::max(FLAGS_prepopulate_batch, 1)) ||
+            batch_bytes >= MAX_BATCH_BYTES) {
+            return flush();
+        }
+        return true;
+    };
+
+    for (int d = 0; d < FLAGS_dirs; ++d) {
+        if (!add(Command(Type::CREATE_DIR, dir_path(d)))) {
+            return false;
+        }
+        for (int f = 0; f < FLAGS_files_per_dir; ++f) {
+            std::vector<uint8_t> data(sizes.next(), 'p');
+            if (!add(Command(Type::WRITE_FILE, file_path(d, f), std::move(data)))) {
+                return false;
+            }
+        }
+    }
+    return batch.empty() || flush();
+}
+
+void print_report(const std::vector<std::unique_ptr<Worker>>& workers, double elapsed_s) {
+    std::vector<OpStats> totals(NUM_OPS);
+    for (const auto& worker : workers) {
+        for (size_t i = 0; i < NUM_OPS; ++i) {
+            totals[i].latency.merge(worker->stats().ops[i].latency);
+            totals[i].errors += worker->stats().ops[i].errors;
+            totals[i].bytes += worker->stats().ops[i].bytes;
+        }
+    }
+
+    LatencyHistogram all;
+    int64_t all_errors = 0;
+    int64_t all_bytes = 0;
+
+    std::printf("\n%-8s %10s %10s %8s %10s %10s %10s %10s %10s %10s %10s\n",
+                "op", "count", "ops/s", "errors", "MB/s",
+                "mean(us)", "p50", "p90", "p99", "p99.9", "max");
+
+    auto print_row = [elapsed_s](const char* name, const LatencyHistogram& h,
+                                 int64_t errors, int64_t bytes) {
+        std::printf("%-8s %10lld %10.1f %8lld %10.2f %10.1f %10lld %10lld %10lld %10lld %10lld\n",
+                    name,
+                    static_cast<long long>(h.count()),
+                    h.count() / elapsed_s,
+                    static_cast<long long>(errors),
+                    bytes / elapsed_s / (1024.0 * 1024.0),
+                    h.mean(),
+                    static_cast<long long>(h.percentile(50.0)),
+                    static_cast<long long>(h.percentile(90.0)),
+                    static_cast<long long>(h.percentile(99.0)),
+                    static_cast<long long>(h.percentile(99.9)),
+                    static_cast<long long>(h.max()));
+    };
+
+    for (size_t i = 0; i < NUM_OPS; ++i) {
+        if (totals[i].latency.count() == 0) continue;
+        print_row(OP_NAMES[i], totals[i].latency, totals[i].errors, totals[i].bytes);
+        all.merge(totals[i].latency);
+        all_errors += totals[i].errors;
+        all_bytes += totals[i].bytes;
+    }
+    print_row("total", all, all_errors, all_bytes);
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    gflags::SetUsageMessage("Diarkis load generator and latency benchmark");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+    spdlog::set_level(FLAGS_verbose ? spdlog::level::info : spdlog::level::err);
+
+    std::string host;
+    uint16_t port = 0;
+    if (!parse_server(FLAGS_server, host, port)) {
+        std::cerr << "Invalid --server: " << FLAGS_server << std::endl;
+        return 1;
+    }
+
+    Workload workload;
+    if (!parse_mix(FLAGS_mix, workload)) {
+        std::cerr << "Invalid --mix: " << FLAGS_mix << std::endl;
+        return 1;
+    }
+    if (FLAGS_mode != "closed" && FLAGS_mode != "open") {
+        std::cerr << "Invalid --mode: " << FLAGS_mode << std::endl;
+        return 1;
+    }
+    workload.open_loop = FLAGS_mode == "open";
+
+    diarkis::commands::compression::Algorithm compression;
+    if (!diarkis::commands::compression::parse(FLAGS_compression, compression)) {
+        std::cerr << "Invalid --compression: " << FLAGS_compression << std::endl;
+        return 1;
+    }
+
+    if (FLAGS_threads <= 0 || FLAGS_dirs <= 0 || FLAGS_files_per_dir <= 0) {
+        std::cerr << "--threads, --dirs and --files_per_dir must be positive" << std::endl;
+        return 1;
+    }
+    int connections = std::max(FLAGS_connections, FLAGS_threads);
+    if (connections != FLAGS_connections) {
+        std::cerr << "Raising --connections to " << connections
+                  << " so every thread owns a connection" << std::endl;
+    }
+
+    if (FLAGS_prepopulate) {
+        std::cout << "Prepopulating " << FLAGS_dirs << " dirs x " << FLAGS_files_per_dir
+                  << " files..." << std::endl;
+        if (!prepopulate(host, port)) {
+            std::cerr << "Prepopulation failed" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::vector<std::unique_ptr<diarkis_client::RpcClient>>> per_thread(FLAGS_threads);
+    for (int c = 0; c < connections; ++c) {
+        auto client = std::make_unique<diarkis_client::RpcClient>(host, port);
+        client->set_compact_encoding(FLAGS_compact);
+        client->set_compression(compression);
+        client->set_shared_memory(static_cast<size_t>(FLAGS_shared_memory_mb) * 1024 * 1024);
+        if (!client->connect()) {
+            std::cerr << "Failed to connect to " << FLAGS_server << std::endl;
+            return 1;
+        }
+        per_thread[c % FLAGS_threads].push_back(std::move(client));
+    }
+
+    double thread_rate = workload.open_loop ? FLAGS_rate / FLAGS_threads : 0.0;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int t = 0; t < FLAGS_threads; ++t) {
+        workers.push_back(std::make_unique<Worker>(t, workload, std::move(per_thread[t]), thread_rate));
+    }
+
+    std::cout << "Running " << FLAGS_mode << "-loop workload '" << FLAGS_mix << "' with "
+              << FLAGS_threads << " threads, " << connections << " connections for "
+              << FLAGS_warmup_s << "s warmup + " << FLAGS_duration_s << "s" << std::endl;
+
+    std::atomic<bool> stop{false};
+    auto measure_start = Clock::now() + std::chrono::seconds(FLAGS_warmup_s);
+    auto end = measure_start + std::chrono::seconds(FLAGS_duration_s);
+
+    std::vector<std::thread> threads;
+    for (auto& worker : workers) {
+        threads.emplace_back([&worker, measure_start, end, &stop] {
+            worker->run(measure_start, end, stop);
+        });
+    }
+
+    std::this_thread::sleep_until(end);
+    stop.store(true, std::memory_order_relaxed);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    auto elapsed = std::chrono::duration<double>(Clock::now() - measure_start).count();
+    print_report(workers, std::max(elapsed, 1e-3));
+
+    gflags::ShutDownCommandLineFlags();
+    return 0;
+}
@@ -0,0 +1,415 @@
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "gflags/gflags.h"
+#include "spdlog/spdlog.h"
+#include "diarkis_client/rpc.h"
+#include "diarkis/commands.h"
+#include "histogram.h"
+
+#ifndef DIARKIS_SERVER_BIN
+#define DIARKIS_SERVER_BIN "./diarkis"
+#endif
+
+DEFINE_string(diarkis_bin, DIARKIS_SERVER_BIN, "Path to the diarkis server binary");
+DEFINE_int32(nodes, 3, "Number of nodes in the cluster");
+DEFINE_string(base_dir, "/tmp", "Directory under which per-run node directories are created");
+DEFINE_int32(raft_base_port, 18100, "Raft port of node 0; node i uses raft_base_port + i");
+DEFINE_int32(rpc_base_port, 19100, "RPC port of node 0; node i uses rpc_base_port + i");
+DEFINE_int32(election_timeout_ms, 1000, "Raft election timeout for every node");
+DEFINE_int32(startup_timeout_s, 30, "Maximum time to wait for nodes and leader election");
+DEFINE_int32(threads, 4, "Number of writer threads");
+DEFINE_int32(duration_s, 30, "Workload duration in seconds");
+DEFINE_int64(write_size, 4096, "Bytes per WRITE_FILE");
+DEFINE_int32(files, 1024, "Number of distinct files written");
+DEFINE_int32(kill_interval_s, 0, "Kill the leader every N seconds (0 disables fault injection)");
+DEFINE_int32(restart_delay_s, 2, "Seconds before a killed node is restarted");
+DEFINE_bool(keep_data, false, "Keep node directories and logs after the run");
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using diarkis::commands::Command;
+using diarkis::commands::Response;
+using diarkis::commands::Type;
+using diarkis::bench::LatencyHistogram;
+
+const std::string PROBE_DIR = "cluster";
+
+int64_t elapsed_ms(Clock::time_point from, Clock::time_point to) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(to - from).count();
+}
+
+class Cluster {
+public:
+    struct Node {
+        int index = 0;
+        pid_t pid = -1;
+        uint16_t raft_port = 0;
+        uint16_t rpc_port = 0;
+        std::string dir;
+        std::string config_path;
+        std::string log_path;
+    };
+
+    ~Cluster() {
+        stop();
+        if (!root_.empty() && !FLAGS_keep_data) {
+            std::string cmd = "rm -rf '" + root_ + "'";
+            if (std::system(cmd.c_str()) != 0) {
+                spdlog::warn("Failed to remove {}", root_);
+            }
+        }
+    }
+
+    bool init(int count) {
+        std::string tmpl = FLAGS_base_dir + "/diarkis_cluster_XXXXXX";
+        std::vector<char> buf(tmpl.begin(), tmpl.end());
+        buf.push_back('\0');
+        if (!::mkdtemp(buf.data())) {
+            spdlog::error("mkdtemp failed for {}", tmpl);
+            return false;
+        }
+        root_ = buf.data();
+
+        std::string initial_conf;
+        for (int i = 0; i < count; ++i) {
+            if (i > 0) initial_conf += ",";
+            initial_conf += "127.0.0.1:" + std::to_string(FLAGS_raft_base_port + i);
+        }
+
+        for (int i = 0; i < count; ++i) {
+            Node node;
+            node.index = i;
+            node.raft_port = static_cast<uint16_t>(FLAGS_raft_base_port + i);
+            node.rpc_port = static_cast<uint16_t>(FLAGS_rpc_base_port + i);
+            node.dir = root_ + "/node" + std::to_string(i);
+            node.config_path = node.dir + "/config.yaml";
+            node.log_path = node.dir + "/diarkis.log";
+
+            std::string cmd = "mkdir -p '" + node.dir + "'";
+            if (std::system(cmd.c_str()) != 0) {
+                spdlog::error("Failed to create {}", node.dir);
+                return false;
+            }
+
+            std::ofstream config(node.config_path);
+            config << "storage:\n"
+                   << "  base_path: \"" << node.dir << "/data\"\n"
+                   << "raft:\n"
+                   << "  path: \"" << node.dir << "/raft\"\n"
+                   << "  group_id: \"diarkis_cluster\"\n"
+                   << "  peer_addr: \"127.0.0.1:" << node.raft_port << "\"\n"
+                   << "  initial_conf: \"" << initial_conf << "\"\n"
+                   << "  election_timeout_ms: " << FLAGS_election_timeout_ms << "\n"
+                   << "  snapshot_interval: 3600\n"
+                   << "rpc:\n"
+                   << "  addr: \"127.0.0.1\"\n"
+                   << "  port: " << node.rpc_port << "\n";
+            if (!config) {
+                spdlog::error("Failed to write {}", node.config_path);
+                return false;
+            }
+
+            nodes_.push_back(node);
+        }
+
+        spdlog::info("Cluster directory: {}", root_);
+        return true;
+    }
+
+    bool start_all() {
+        for (auto& node : nodes_) {
+            if (!start(node.index)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool start(int index) {
+        Node& node = nodes_[index];
+
+        pid_t pid = ::fork();
+        if (pid < 0) {
+            spdlog::error("fork failed: {}", std::strerror(errno));
+            return false;
+        }
+
+        if (pid == 0) {
+            int fd = ::open(node.log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd >= 0) {
+                ::dup2(fd, STDOUT_FILENO);
+                ::dup2(fd, STDERR_FILENO);
+                ::close(fd);
+            }
+            std::string config_flag = "--config=" + node.config_path;
+            ::execl(FLAGS_diarkis_bin.c_str(), FLAGS_diarkis_bin.c_str(),
+                    config_flag.c_str(), static_cast<char*>(nullptr));
+            std::_Exit(127);
+        }
+
+        node.pid = pid;
+        spdlog::info("Started node {} (pid {}, rpc {}, raft {})",
+                     index, pid, node.rpc_port, node.raft_port);
+        return true;
+    }
+
+    void kill(int index) {
+        Node& node = nodes_[index];
+        if (node.pid <= 0) return;
+        ::kill(node.pid, SIGKILL);
+        ::waitpid(node.pid, nullptr, 0);
+        spdlog::info("Killed node {} (pid {})", index, node.pid);
+        node.pid = -1;
+    }
+
+    void stop() {
+        for (auto& node : nodes_) {
+            if (node.pid > 0) {
+                ::kill(node.pid, SIGTERM);
+            }
+        }
+
+        auto deadline = Clock::now() + std::chrono::seconds(10);
+        for (auto& node : nodes_) {
+            if (node.pid <= 0) continue;
+            while (::waitpid(node.pid, nullptr, WNOHANG) == 0) {
+                if (Clock::now() > deadline) {
+                    ::kill(node.pid, SIGKILL);
+                    ::waitpid(node.pid, nullptr, 0);
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            node.pid = -1;
+        }
+    }
+
+    bool is_alive(int index) const { return nodes_[index].pid > 0; }
+
+    // Returns the index of the node that accepts writes, or -1 on timeout.
+    int find_leader(std::chrono::milliseconds timeout) const {
+        auto deadline = Clock::now() + timeout;
+        while (Clock::now() < deadline) {
+            for (const auto& node : nodes_) {
+                if (node.pid <= 0) continue;
+                diarkis_client::RpcClient client("127.0.0.1", node.rpc_port);
+                Response resp = client.send_command(Command(Type::CREATE_DIR, PROBE_DIR));
+                if (resp.success) {
+                    return node.index;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        return -1;
+    }
+
+    size_t size() const { return nodes_.size(); }
+    uint16_t rpc_port(int index) const { return nodes_[index].rpc_port; }
+
+private:
+    std::string root_;
+    std::vector<Node> nodes_;
+};
+
+struct RunState {
+    std::atomic<int> leader{-1};
+    std::atomic<int> killed_node{-1};
+    std::atomic<bool> stop{false};
+    std::atomic<int64_t> kill_time_ms{-1};
+    std::atomic<int64_t> recovered_time_ms{-1};
+    Clock::time_point epoch = Clock::now();
+};
+
+struct WriterStats {
+    LatencyHistogram latency;
+    int64_t ok = 0;
+    int64_t errors = 0;
+};
+
+void writer_loop(int id, const Cluster& cluster, RunState& state, WriterStats& stats) {
+    std::mt19937_64 rng(static_cast<uint64_t>(id) + 1);
+    std::uniform_int_distribution<int> file_dist(0, FLAGS_files - 1);
+    std::vector<uint8_t> payload(static_cast<size_t>(FLAGS_write_size), static_cast<uint8_t>('a' + id % 26));
+
+    int connected_to = -1;
+    std::unique_ptr<diarkis_client::RpcClient> client;
+
+    while (!state.stop.load(std::memory_order_relaxed)) {
+        int leader = state.leader.load(std::memory_order_acquire);
+        if (leader < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+        if (leader != connected_to) {
+            client = std::make_unique<diarkis_client::RpcClient>("127.0.0.1", cluster.rpc_port(leader));
+            connected_to = leader;
+        }
+
+        Command cmd(Type::WRITE_FILE, PROBE_DIR + "/f" + std::to_string(file_dist(rng)), payload);
+        auto start = Clock::now();
+        Response resp = client->send_command(cmd);
+        auto finish = Clock::now();
+
+        if (!resp.success) {
+            stats.errors++;
+            // Let the control thread rediscover the leader
+            state.leader.compare_exchange_strong(leader, -1);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        stats.ok++;
+        stats.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(finish - start).count());
+
+        if (state.kill_time_ms.load(std::memory_order_acquire) >= 0 &&
+            connected_to != state.killed_node.load(std::memory_order_acquire)) {
+            int64_t expected = -1;
+            state.recovered_time_ms.compare_exchange_strong(expected, elapsed_ms(state.epoch, finish));
+        }
+    }
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    gflags::SetUsageMessage("Launches a local diarkis cluster and measures replication performance");
+    gflags::ParseCommandLineFlags(&argc, &argv, true);
+    spdlog::set_pattern("[%H:%M:%S.%e] %v");
+
+    if (FLAGS_nodes <= 0 || FLAGS_threads <= 0 || FLAGS_files <= 0) {
+        std::cerr << "--nodes, --threads and --files must be positive" << std::endl;
+        return 1;
+    }
+
+    Cluster cluster;
+    if (!cluster.init(FLAGS_nodes) || !cluster.start_all()) {
+        return 1;
+    }
+
+    RunState state;
+    auto startup_timeout = std::chrono::seconds(FLAGS_startup_timeout_s);
+    auto election_start = Clock::now();
+    int leader = cluster.find_leader(startup_timeout);
+    if (leader < 0) {
+        spdlog::error("No leader elected within {}s", FLAGS_startup_timeout_s);
+        return 1;
+    }
+    spdlog::info("Node {} is leader after {} ms", leader, elapsed_ms(election_start, Clock::now()));
+    state.leader.store(leader, std::memory_order_release);
+
+    std::vector<WriterStats> stats(FLAGS_threads);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < FLAGS_threads; ++t) {
+        writers.emplace_back(writer_loop, t, std::cref(cluster), std::ref(state), std::ref(stats[t]));
+    }
+
+    std::vector<int64_t> failover_ms;
+    auto run_start = Clock::now();
+    auto run_end = run_start + std::chrono::seconds(FLAGS_duration_s);
+    auto next_kill = FLAGS_kill_interval_s > 0
+        ? run_start + std::chrono::seconds(FLAGS_kill_interval_s)
+        : Clock::time_point::max();
+    int killed = -1;
+    Clock::time_point restart_at = Clock::time_point::max();
+
+    while (Clock::now() < run_end) {
+        auto now = Clock::now();
+
+        if (now >= next_kill && killed < 0) {
+            int current = state.leader.load(std::memory_order_acquire);
+            if (current >= 0) {
+                state.recovered_time_ms.store(-1, std::memory_order_release);
+                state.killed_node.store(current, std::memory_order_release);
+                state.kill_time_ms.store(elapsed_ms(state.epoch, now), std::memory_order_release);
+                cluster.kill(current);
+                state.leader.store(-1, std::memory_order_release);
+                killed = current;
+                restart_at = now + std::chrono::seconds(FLAGS_restart_delay_s);
+            }
+            next_kill = now + std::chrono::seconds(FLAGS_kill_interval_s);
+        }
+
+        if (killed >= 0 && now >= restart_at) {
+            cluster.start(killed);
+            killed = -1;
+            restart_at = Clock::time_point::max();
+        }
+
+        if (state.leader.load(std::memory_order_acquire) < 0) {
+            int found = cluster.find_leader(std::chrono::milliseconds(200));
+            if (found >= 0) {
+                state.leader.store(found, std::memory_order_release);
+            }
+        }
+
+        int64_t kill_ms = state.kill_time_ms.load(std::memory_order_acquire);
+        int64_t recovered_ms = state.recovered_time_ms.load(std::memory_order_acquire);
+        if (kill_ms >= 0 && recovered_ms >= 0) {
+            failover_ms.push_back(recovered_ms - kill_ms);
+            spdlog::info("Failover completed in {} ms, new leader is node {}",
+                         recovered_ms - kill_ms, state.leader.load());
+            state.kill_time_ms.store(-1, std::memory_order_release);
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    state.stop.store(true, std::memory_order_relaxed);
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    double elapsed_s = std::chrono::duration<double>(Clock::now() - run_start).count();
+
+    LatencyHistogram latency;
+    int64_t ok = 0;
+    int64_t errors = 0;
+    for (const auto& s : stats) {
+        latency.merge(s.latency);
+        ok += s.ok;
+        errors += s.errors;
+    }
+
+    std::printf("\nnodes=%d threads=%d write_size=%lld duration=%.1fs\n",
+                FLAGS_nodes, FLAGS_threads, static_cast<long long>(FLAGS_write_size), elapsed_s);
+    std::printf("throughput:     %.1f ops/s, %.2f MB/s\n",
+                ok / elapsed_s, ok * FLAGS_write_size / elapsed_s / (1024.0 * 1024.0));
+    std::printf("errors:         %lld\n", static_cast<long long>(errors));
+    std::printf("commit latency: mean=%.1fus p50=%lldus p99=%lldus p99.9=%lldus max=%lldus\n",
+                latency.mean(),
+                static_cast<long long>(latency.percentile(50.0)),
+                static_cast<long long>(latency.percentile(99.0)),
+                static_cast<long long>(latency.percentile(99.9)),
+                static_cast<long long>(latency.max()));
+    if (!failover_ms.empty()) {
+        std::printf("failovers:      %zu, time(ms):", failover_ms.size());
+        for (int64_t ms : failover_ms) {
+            std::printf(" %lld", static_cast<long long>(ms));
+        }
+        std::printf("\n");
+    } else if (FLAGS_kill_interval_s > 0) {
+        std::printf("failovers:      none completed\n");
+    }
+
+    cluster.stop();
+    gflags::ShutDownCommandLineFlags();
+    return 0;
+}
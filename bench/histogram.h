@@ -0,0 +1,118 @@
+
+#ifndef DIARKIS_BENCH_HISTOGRAM_H
+#define DIARKIS_BENCH_HISTOGRAM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace diarkis::bench {
+
+// HdrHistogram-style log/linear histogram with 3 significant digits.
+// Values are recorded in microseconds; anything above the highest
+// trackable value is clamped into the last bucket.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_HALF_MAGNITUDE = 10;
+    static constexpr int64_t SUB_BUCKET_HALF_COUNT = int64_t(1) << SUB_BUCKET_HALF_MAGNITUDE;
+    static constexpr int64_t SUB_BUCKET_COUNT = SUB_BUCKET_HALF_COUNT * 2;
+    static constexpr int64_t SUB_BUCKET_MASK = SUB_BUCKET_COUNT - 1;
+
+    explicit LatencyHistogram(int64_t highest_trackable_us = 3600LL * 1000 * 1000)
+        : highest_(highest_trackable_us) {
+        int bucket_count = 1;
+        int64_t smallest_untrackable = SUB_BUCKET_COUNT;
+        while (smallest_untrackable <= highest_) {
+            smallest_untrackable <<= 1;
+            bucket_count++;
+        }
+        counts_.assign(static_cast<size_t>(bucket_count + 1) * SUB_BUCKET_HALF_COUNT, 0);
+    }
+
+    void record(int64_t value_us) {
+        value_us = std::clamp<int64_t>(value_us, 0, highest_);
+        counts_[index_of(value_us)]++;
+        total_count_++;
+        sum_ += value_us;
+        min_ = std::min(min_, value_us);
+        max_ = std::max(max_, value_us);
+    }
+
+    void merge(const LatencyHistogram& other) {
+        if (other.counts_.size() != counts_.size()) {
+            return;
+        }
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_count_ += other.total_count_;
+        sum_ += other.sum_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_count_ = 0;
+        sum_ = 0;
+        min_ = INT64_MAX;
+        max_ = 0;
+    }
+
+    int64_t count() const { return total_count_; }
+    int64_t min() const { return total_count_ ? min_ : 0; }
+    int64_t max() const { return max_; }
+    double mean() const {
+        return total_count_ ? static_cast<double>(sum_) / total_count_ : 0.0;
+    }
+
+    // Highest value equivalent to the one at the given percentile (0-100).
+    int64_t percentile(double p) const {
+        if (total_count_ == 0) {
+            return 0;
+        }
+        p = std::clamp(p, 0.0, 100.0);
+        int64_t target = static_cast<int64_t>(std::ceil(p / 100.0 * total_count_));
+        target = std::max<int64_t>(target, 1);
+
+        int64_t cumulative = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            cumulative += counts_[i];
+            if (cumulative >= target) {
+                return std::min(highest_equivalent(static_cast<int64_t>(i)), max_);
+            }
+        }
+        return max_;
+    }
+
+private:
+    static size_t index_of(int64_t value) {
+        int leading = __builtin_clzll(static_cast<uint64_t>(value | SUB_BUCKET_MASK));
+        int bucket = (64 - leading) - (SUB_BUCKET_HALF_MAGNITUDE + 1);
+        int64_t sub_bucket = value >> bucket;
+        return static_cast<size_t>(((static_cast<int64_t>(bucket) + 1) << SUB_BUCKET_HALF_MAGNITUDE)
+                                   + (sub_bucket - SUB_BUCKET_HALF_COUNT));
+    }
+
+    static int64_t highest_equivalent(int64_t index) {
+        int64_t bucket = (index >> SUB_BUCKET_HALF_MAGNITUDE) - 1;
+        int64_t sub_bucket = (index & (SUB_BUCKET_HALF_COUNT - 1)) + SUB_BUCKET_HALF_COUNT;
+        if (bucket < 0) {
+            sub_bucket -= SUB_BUCKET_HALF_COUNT;
+            bucket = 0;
+        }
+        return (sub_bucket << bucket) + ((int64_t(1) << bucket) - 1);
+    }
+
+    int64_t highest_;
+    std::vector<int64_t> counts_;
+    int64_t total_count_ = 0;
+    int64_t sum_ = 0;
+    int64_t min_ = INT64_MAX;
+    int64_t max_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,286 @@
+
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "benchmark/benchmark.h"
+#include "msgpack.hpp"
+#include "spdlog/spdlog.h"
+#include "diarkis/codec.h"
+#include "diarkis/commands.h"
+#include "diarkis/path.h"
+#include "diarkis/rpc.h"
+#include "diarkis/storage.h"
+#include "diarkis/tcp.h"
+
+namespace {
+
+using diarkis::commands::Command;
+using diarkis::commands::Response;
+using diarkis::commands::Type;
+
+const std::vector<std::string>& sample_paths() {
+    static const std::vector<std::string> paths = {
+        "file.txt",
+        "a/b/c/d/e/f/g/h/file.bin",
+        "dir//with///repeated////slashes/",
+        "./relative/./path/./file",
+        "deeply/nested/" + std::string(200, 'x') + "/component/file.log",
+    };
+    return paths;
+}
+
+void BM_IsSafePath(benchmark::State& state) {
+    const auto& paths = sample_paths();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(diarkis::is_safe_path(paths[i++ % paths.size()]));
+    }
+}
+BENCHMARK(BM_IsSafePath);
+
+void BM_NormalizePath(benchmark::State& state) {
+    const auto& paths = sample_paths();
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(diarkis::normalize_path(paths[i++ % paths.size()]));
+    }
+}
+BENCHMARK(BM_NormalizePath);
+
+// range(0): 0 = all threads contend on one path, 1 = each thread has its own path
+void BM_FileLockerWrite(benchmark::State& state) {
+    static diarkis::FileLocker locker;
+    std::string path = state.range(0) == 0
+        ? "shared"
+        : "private_" + std::to_string(state.thread_index());
+
+    for (auto _ : state) {
+        diarkis::WriteLock lock(locker, path);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_FileLockerWrite)->Arg(0)->Arg(1)->ThreadRange(1, 16)->UseRealTime();
+
+void BM_FileLockerRead(benchmark::State& state) {
+    static diarkis::FileLocker locker;
+    for (auto _ : state) {
+        diarkis::ReadLock lock(locker, "shared");
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_FileLockerRead)->ThreadRange(1, 16)->UseRealTime();
+
+Command make_write_command(size_t size) {
+    return Command(Type::WRITE_FILE, "bench/dir/file.bin", std::vector<uint8_t>(size, 'x'));
+}
+
+void BM_CommandEncode(benchmark::State& state) {
+    Command cmd = make_write_command(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, cmd);
+        benchmark::DoNotOptimize(sbuf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CommandEncode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+void BM_CommandDecode(benchmark::State& state) {
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, make_write_command(static_cast<size_t>(state.range(0))));
+
+    for (auto _ : state) {
+        msgpack::object_handle oh = msgpack::unpack(sbuf.data(), sbuf.size());
+        Command cmd;
+        oh.get().convert(cmd);
+        benchmark::DoNotOptimize(cmd.contents.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CommandDecode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+// Reference-mode unpack into a view with a reused zone, as the server decodes
+void BM_CommandDecodeView(benchmark::State& state) {
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, make_write_command(static_cast<size_t>(state.range(0))));
+    diarkis::commands::codec::Decoder decoder;
+
+    for (auto _ : state) {
+        diarkis::commands::CommandView view;
+        decoder.decode(reinterpret_cast<const uint8_t*>(sbuf.data()), sbuf.size(), view);
+        benchmark::DoNotOptimize(view.contents);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CommandDecodeView)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+void BM_CompactEncode(benchmark::State& state) {
+    Command cmd = make_write_command(static_cast<size_t>(state.range(0)));
+    diarkis::commands::CommandView view(cmd);
+    for (auto _ : state) {
+        std::vector<uint8_t> buf;
+        diarkis::commands::codec::encode(view, buf);
+        benchmark::DoNotOptimize(buf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CompactEncode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+void BM_CompactDecode(benchmark::State& state) {
+    std::vector<uint8_t> buf;
+    Command cmd = make_write_command(static_cast<size_t>(state.range(0)));
+    diarkis::commands::codec::encode(diarkis::commands::CommandView(cmd), buf);
+
+    for (auto _ : state) {
+        diarkis::commands::CommandView view;
+        if (!diarkis::commands::codec::decode(buf.data(), buf.size(), view)) {
+            state.SkipWithError("decode failed");
+            break;
+        }
+        benchmark::DoNotOptimize(view.contents);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_CompactDecode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+void BM_ResponseEncode(benchmark::State& state) {
+    Response resp;
+    resp.success = true;
+    resp.data.assign(static_cast<size_t>(state.range(0)), 'x');
+
+    for (auto _ : state) {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, resp);
+        benchmark::DoNotOptimize(sbuf.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ResponseEncode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+void BM_ResponseDecode(benchmark::State& state) {
+    Response resp;
+    resp.success = true;
+    resp.data.assign(static_cast<size_t>(state.range(0)), 'x');
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, resp);
+
+    for (auto _ : state) {
+        msgpack::object_handle oh = msgpack::unpack(sbuf.data(), sbuf.size());
+        Response out;
+        oh.get().convert(out);
+        benchmark::DoNotOptimize(out.data.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_ResponseDecode)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+// Round trip of one framed message over a socketpair with an echo thread
+void BM_MessageProtocolRoundTrip(benchmark::State& state) {
+    int fds[2];
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        state.SkipWithError("socketpair failed");
+        return;
+    }
+
+    auto client = std::make_shared<diarkis::TcpConnection>(fds[0]);
+    auto server = std::make_shared<diarkis::TcpConnection>(fds[1]);
+
+    std::thread echo([server] {
+        std::vector<uint8_t> message;
+        while (diarkis::MessageProtocol::receive_message(server, message)) {
+            if (!diarkis::MessageProtocol::send_message(server, message)) {
+                break;
+            }
+        }
+    });
+
+    std::vector<uint8_t> request(static_cast<size_t>(state.range(0)), 'x');
+    std::vector<uint8_t> reply;
+
+    for (auto _ : state) {
+        if (!diarkis::MessageProtocol::send_message(client, request) ||
+            !diarkis::MessageProtocol::receive_message(client, reply)) {
+            state.SkipWithError("framing round trip failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0) * 2);
+
+    ::shutdown(fds[0], SHUT_RDWR);
+    echo.join();
+    client->close();
+    server->close();
+}
+BENCHMARK(BM_MessageProtocolRoundTrip)->RangeMultiplier(16)->Range(64, 16 << 20)->UseRealTime();
+
+class StorageFixture : public benchmark::Fixture {
+public:
+    void SetUp(const benchmark::State&) override {
+        char dir_template[] = "/dev/shm/diarkis_microbench_XXXXXX";
+        const char* dir = ::mkdtemp(dir_template);
+        base_path_ = dir ? dir : "/tmp/diarkis_microbench";
+        storage_ = std::make_unique<diarkis::Storage>(base_path_);
+        storage_->init();
+    }
+
+    void TearDown(const benchmark::State&) override {
+        storage_.reset();
+        std::string cmd = "rm -rf '" + base_path_ + "'";
+        if (std::system(cmd.c_str()) != 0) {
+            spdlog::warn("Failed to remove {}", base_path_);
+        }
+    }
+
+protected:
+    std::string base_path_;
+    std::unique_ptr<diarkis::Storage> storage_;
+};
+
+BENCHMARK_DEFINE_F(StorageFixture, WriteFile)(benchmark::State& state) {
+    std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        auto result = storage_->write_file("file.bin", data.data(), data.size());
+        if (!result.ok()) {
+            state.SkipWithError("write_file failed");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(StorageFixture, WriteFile)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+BENCHMARK_DEFINE_F(StorageFixture, ReadFile)(benchmark::State& state) {
+    std::vector<uint8_t> data(static_cast<size_t>(state.range(0)), 'x');
+    storage_->write_file("file.bin", data.data(), data.size());
+
+    for (auto _ : state) {
+        auto result = storage_->read_file("file.bin");
+        if (!result.ok()) {
+            state.SkipWithError("read_file failed");
+            break;
+        }
+        benchmark::DoNotOptimize(result.value().data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_REGISTER_F(StorageFixture, ReadFile)->RangeMultiplier(16)->Range(64, 16 << 20);
+
+}
+
+int main(int argc, char** argv) {
+    spdlog::set_level(spdlog::level::warn);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -21,6 +21,10 @@ public:
     int append_file(std::string& path, uint8_t* buffer, size_t size);
 
     int rename_file(std::string& old_path, std::string& new_path);
+    int copy_file(std::string& src_path, std::string& dst_path);
+    
+    int truncate_file(std::string& path, uint64_t size);
+    int punch_hole(std::string& path, uint64_t offset, uint64_t length);
 
     int delete_file(std::string& path);
     int delete_directory(std::string& path);
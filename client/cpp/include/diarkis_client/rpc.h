@@ -2,10 +2,14 @@
 #ifndef DIARKIS_CLIENT_RPC_H
 #define DIARKIS_CLIENT_RPC_H
 
+#include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 #include "diarkis_client/tcp.h"
 #include "diarkis/commands.h"
+#include "diarkis/codec.h"
+#include "diarkis/shm.h"
 
 namespace diarkis_client {
 
@@ -18,15 +22,69 @@ public:
     void disconnect();
     bool is_connected() const;
     
+    // Send commands in the compact binary encoding instead of MessagePack
+    void set_compact_encoding(bool enabled) { compact_ = enabled; }
+    
+    // Offer compression in the HELLO exchange on the next connect. Payloads of
+    // at least threshold bytes are then compressed in both directions.
+    void set_compression(diarkis::commands::compression::Algorithm preferred, size_t threshold = 4096) {
+        preferred_compression_ = preferred;
+        compression_threshold_ = threshold;
+    }
+    diarkis::commands::compression::Algorithm compression() const { return compression_; }
+    
+    // Label sent in HELLO on the next connect, shown in the server's logs.
+    // Rate limits are keyed on the address or Unix socket uid instead.
+    void set_client_id(std::string id) { client_id_ = std::move(id); }
+    
+    // Negotiated in the HELLO exchange; 0 when the server predates it
+    uint32_t protocol_version() const { return protocol_version_; }
+    bool multiplexed() const { return multiplexed_; }
+    
+    // Over a unix:// address, ask the server on the next connect to move the
+    // connection onto shared memory rings of ring_bytes each way; 0 disables.
+    // Frames are then limited to half a ring.
+    void set_shared_memory(size_t ring_bytes) { shm_ring_bytes_ = ring_bytes; }
+    bool shared_memory() const { return shm_ != nullptr; }
+    
     diarkis::commands::Response send_command(const diarkis::commands::Command& cmd);
     
+    // Pipelines the commands, reading responses while later commands are
+    // still being sent, which saves a round trip per command. Responses are
+    // returned in command order.
+    std::vector<diarkis::commands::Response> send_commands(const std::vector<diarkis::commands::Command>& cmds);
+    
+    // Sends all commands in one BATCH request; the server commits runs of
+    // writes as one Raft entry. Falls back to send_commands on servers that
+    // predate BATCH. Responses are returned in command order.
+    std::vector<diarkis::commands::Response> send_batch(const std::vector<diarkis::commands::Command>& cmds);
+    
 private:    
-    bool receive_message(std::vector<uint8_t>& message);
-    bool send_message(const std::vector<uint8_t>& message);
+    bool handshake();
+    bool attach_shm();
+    void encode_command(const diarkis::commands::Command& cmd, std::vector<uint8_t>& out);
+    bool decode_response(const uint8_t* data, size_t size, diarkis::commands::Response& resp);
+    bool receive_response(diarkis::commands::Response& resp, uint32_t& request_id);
+    bool receive_message(std::vector<uint8_t>& message, uint32_t* request_id = nullptr);
+    bool send_message(const std::vector<uint8_t>& message, uint32_t request_id = 0);
 
     std::string address_;
     uint16_t port_;
     std::unique_ptr<TcpConnection> conn_;
+    bool compact_ = false;
+    diarkis::commands::compression::Algorithm preferred_compression_ = diarkis::commands::compression::Algorithm::NONE;
+    diarkis::commands::compression::Algorithm compression_ = diarkis::commands::compression::Algorithm::NONE;
+    size_t compression_threshold_ = 4096;
+    uint32_t protocol_version_ = 0;
+    bool multiplexed_ = false;
+    size_t max_frame_size_ = MAX_MESSAGE_SIZE;     // largest request the server accepts
+    uint32_t next_request_id_ = 1;
+    size_t shm_ring_bytes_ = 0;
+    std::string client_id_;
+    std::unique_ptr<diarkis::commands::shm::Channel> shm_;
+    
+    static constexpr size_t MAX_MESSAGE_SIZE = 100 * 1024 * 1024;
+    static constexpr int SHM_TIMEOUT_MS = 30000;    // matches the socket timeouts
 };
 
 }
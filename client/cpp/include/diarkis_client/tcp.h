@@ -10,6 +10,14 @@
 
 namespace diarkis_client {
 
+// Addresses of the form unix:///path/to/socket connect to a co-located
+// server over a Unix domain socket; the port is then ignored
+constexpr const char* UNIX_SCHEME = "unix://";
+
+inline bool is_unix_endpoint(const std::string& address) {
+    return address.compare(0, 7, UNIX_SCHEME) == 0;
+}
+
 class TcpConnection {
 public:
     explicit TcpConnection(const std::string& address, uint16_t port);
@@ -24,7 +32,12 @@ public:
     
     std::vector<uint8_t> receive(size_t max_size = 65536);
     bool receive_exact(void* buffer, size_t size);
+    
+    // Sends one byte carrying the descriptors as SCM_RIGHTS (Unix sockets only)
+    bool send_fds(const int* fds, int count);
 
+    // Wakes a thread blocked on the socket without releasing the descriptor
+    void shutdown();
     void close();
     
     std::string address() const { return address_; }
@@ -36,6 +49,9 @@ public:
     int socket_fd() const { return socket_fd_; }
     
 private:
+    bool connect_tcp();
+    bool connect_unix(const std::string& path);
+    
     std::string address_;
     uint16_t port_;
     
@@ -5,6 +5,17 @@
 
 namespace diarkis_client {
 
+namespace {
+    std::vector<uint8_t> pack_extent(uint64_t offset, uint64_t length) {
+        diarkis::commands::Extent extent;
+        extent.offset = offset;
+        extent.length = length;
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, extent);
+        return std::vector<uint8_t>(sbuf.data(), sbuf.data() + sbuf.size());
+    }
+}
+
 Client::Client(const std::string& address, uint16_t port)
     : rpc_(address, port) {
 }
@@ -107,6 +118,49 @@ int Client::rename_file(std::string& old_path, std::string& new_path) {
     return 0;
 }
 
+// The copy is made by each replica, so only the paths travel
+int Client::copy_file(std::string& src_path, std::string& dst_path) {
+    diarkis::commands::Command cmd;
+    cmd.type = diarkis::commands::Type::COPY;
+    cmd.path = src_path;
+    cmd.new_path = dst_path;
+    
+    diarkis::commands::Response resp = rpc_.send_command(cmd);
+    
+    if (!resp.success) {
+        spdlog::error("copy_file failed: {}", resp.error);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int Client::truncate_file(std::string& path, uint64_t size) {
+    diarkis::commands::Command cmd(diarkis::commands::Type::TRUNCATE, path, pack_extent(size, 0));
+    
+    diarkis::commands::Response resp = rpc_.send_command(cmd);
+    
+    if (!resp.success) {
+        spdlog::error("truncate_file failed: {}", resp.error);
+        return -1;
+    }
+    
+    return 0;
+}
+
+int Client::punch_hole(std::string& path, uint64_t offset, uint64_t length) {
+    diarkis::commands::Command cmd(diarkis::commands::Type::PUNCH_HOLE, path, pack_extent(offset, length));
+    
+    diarkis::commands::Response resp = rpc_.send_command(cmd);
+    
+    if (!resp.success) {
+        spdlog::error("punch_hole failed: {}", resp.error);
+        return -1;
+    }
+    
+    return 0;
+}
+
 int Client::delete_file(std::string& path) {
     diarkis::commands::Command cmd;
     cmd.type = diarkis::commands::Type::DELETE_FILE;
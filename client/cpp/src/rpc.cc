@@ -3,6 +3,8 @@
 #include "spdlog/spdlog.h"
 #include "arpa/inet.h"
 #include "msgpack.hpp"
+#include <algorithm>
+#include <thread>
 
 namespace diarkis_client {
 
@@ -29,10 +31,157 @@ bool RpcClient::connect() {
     }
     
     spdlog::info("Connected to {}:{}", address_, port_);
+    
+    if (!handshake()) {
+        conn_.reset();
+        return false;
+    }
+    return true;
+}
+
+bool RpcClient::handshake() {
+    using diarkis::commands::compression::Algorithm;
+    
+    compression_ = Algorithm::NONE;
+    protocol_version_ = 0;
+    multiplexed_ = false;
+    max_frame_size_ = MAX_MESSAGE_SIZE;
+    shm_.reset();
+    
+    diarkis::commands::Hello offered;
+    offered.version = diarkis::commands::PROTOCOL_VERSION;
+    offered.max_frame_size = static_cast<uint32_t>(MAX_MESSAGE_SIZE);
+    offered.capabilities = diarkis::commands::CAP_MULTIPLEX;
+    offered.client_id = client_id_;
+    if (preferred_compression_ != Algorithm::NONE) {
+        offered.capabilities |= diarkis::commands::compression_capabilities();
+    }
+    if (shm_ring_bytes_ > 0 && is_unix_endpoint(address_)) {
+        offered.capabilities |= diarkis::commands::CAP_SHM;
+    }
+    
+    msgpack::sbuffer hello_buf;
+    msgpack::pack(hello_buf, offered);
+    diarkis::commands::Command cmd(diarkis::commands::Type::HELLO, "",
+        std::vector<uint8_t>(hello_buf.data(), hello_buf.data() + hello_buf.size()));
+    
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, cmd);
+    std::vector<uint8_t> request_data(sbuf.data(), sbuf.data() + sbuf.size());
+    std::vector<uint8_t> response_data;
+    if (!send_message(request_data) || !receive_message(response_data)) {
+        spdlog::error("Handshake with {}:{} failed", address_, port_);
+        return false;
+    }
+    
+    try {
+        diarkis::commands::Response resp;
+        msgpack::object_handle oh = msgpack::unpack(
+            reinterpret_cast<const char*>(response_data.data()), response_data.size());
+        oh.get().convert(resp);
+        
+        // Servers without HELLO reject it; the connection keeps the original protocol
+        if (!resp.success) {
+            spdlog::debug("Server does not support HELLO: {}", resp.error);
+            return true;
+        }
+        
+        diarkis::commands::Hello accepted;
+        msgpack::object_handle hello_oh = msgpack::unpack(
+            reinterpret_cast<const char*>(resp.data.data()), resp.data.size());
+        hello_oh.get().convert(accepted);
+        
+        protocol_version_ = accepted.version;
+        multiplexed_ = (accepted.capabilities & diarkis::commands::CAP_MULTIPLEX) != 0;
+        if (accepted.max_frame_size > 0) {
+            max_frame_size_ = std::min<size_t>(accepted.max_frame_size, MAX_MESSAGE_SIZE);
+        }
+        
+        uint32_t preferred_cap = preferred_compression_ == Algorithm::ZSTD
+            ? diarkis::commands::CAP_ZSTD : diarkis::commands::CAP_LZ4;
+        compression_ = (accepted.capabilities & preferred_cap)
+            ? preferred_compression_
+            : diarkis::commands::pick_compression(accepted.capabilities);
+        
+        spdlog::debug("Negotiated protocol v{} with {}:{}: multiplex={}, compression={}", 
+                      protocol_version_, address_, port_, multiplexed_,
+                      diarkis::commands::compression::name(compression_));
+        
+        if (accepted.capabilities & diarkis::commands::CAP_SHM) {
+            return attach_shm();
+        }
+        return true;
+        
+    } catch (const std::exception& e) {
+        spdlog::error("Invalid handshake response: {}", e.what());
+        return false;
+    }
+}
+
+bool RpcClient::attach_shm() {
+    std::string error;
+    auto channel = diarkis::commands::shm::Channel::create(shm_ring_bytes_, error);
+    if (!channel) {
+        // Not fatal, the socket keeps working
+        spdlog::warn("Shared memory unavailable: {}", error);
+        return true;
+    }
+    
+    // The descriptors follow the request as ancillary data on one byte
+    diarkis::commands::Command cmd(diarkis::commands::Type::ATTACH_SHM, "");
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, cmd);
+    std::vector<uint8_t> request_data(sbuf.data(), sbuf.data() + sbuf.size());
+    int fds[3] = {channel->memfd(), channel->client_event(), channel->server_event()};
+    
+    uint32_t request_id = next_request_id_++;
+    diarkis::commands::Response resp;
+    uint32_t response_id = request_id;
+    if (!send_message(request_data, request_id) || !conn_->send_fds(fds, 3) ||
+        !receive_response(resp, response_id)) {
+        spdlog::error("Shared memory attach with {} failed", address_);
+        return false;
+    }
+    if (!resp.success) {
+        spdlog::warn("Server refused shared memory: {}", resp.error);
+        return true;
+    }
+    
+    // Compressing in memory would only cost CPU
+    shm_ = std::move(channel);
+    compression_ = diarkis::commands::compression::Algorithm::NONE;
+    max_frame_size_ = std::min(max_frame_size_, shm_->max_payload());
+    spdlog::debug("Using shared memory rings of {} bytes with {}", shm_ring_bytes_, address_);
     return true;
 }
 
+void RpcClient::encode_command(const diarkis::commands::Command& cmd, std::vector<uint8_t>& out) {
+    using diarkis::commands::compression::Algorithm;
+    
+    if (compression_ != Algorithm::NONE && cmd.contents.size() >= compression_threshold_) {
+        std::vector<uint8_t> compressed;
+        if (diarkis::commands::compression::compress(compression_, cmd.contents.data(),
+                                                     cmd.contents.size(), compressed)) {
+            diarkis::commands::CommandView view(cmd);
+            view.contents = compressed.data();
+            view.contents_size = compressed.size();
+            view.compression = compression_;
+            diarkis::commands::codec::encode(view, out);
+            return;
+        }
+    }
+    
+    if (compact_ || compression_ != Algorithm::NONE) {
+        diarkis::commands::codec::encode(diarkis::commands::CommandView(cmd), out);
+    } else {
+        msgpack::sbuffer sbuf;
+        msgpack::pack(sbuf, cmd);
+        out.assign(sbuf.data(), sbuf.data() + sbuf.size());
+    }
+}
+
 void RpcClient::disconnect() {
+    shm_.reset();
     if (conn_) {
         conn_->close();
         conn_.reset();
@@ -43,11 +192,22 @@ bool RpcClient::is_connected() const {
     return conn_ && conn_->socket_fd() >= 0;
 }
 
-bool RpcClient::receive_message(std::vector<uint8_t>& message) {
+bool RpcClient::receive_message(std::vector<uint8_t>& message, uint32_t* request_id) {
     if (!conn_) {
         return false;
     }
     
+    if (shm_) {
+        uint32_t id = 0;
+        if (!shm_->receive(message, id, SHM_TIMEOUT_MS, conn_->socket_fd())) {
+            return false;
+        }
+        if (request_id) {
+            *request_id = id;
+        }
+        return true;
+    }
+    
     uint32_t msg_len_net;
     if (!conn_->receive_exact(&msg_len_net, sizeof(msg_len_net))) {
         return false;
@@ -56,11 +216,22 @@ bool RpcClient::receive_message(std::vector<uint8_t>& message) {
     uint32_t msg_len = ntohl(msg_len_net);
     
     // Sanity check
-    if (msg_len == 0 || msg_len > 100 * 1024 * 1024) { // 100MB max
+    if (msg_len == 0 || msg_len > MAX_MESSAGE_SIZE) {
         spdlog::error("Invalid message length: {}", msg_len);
         return false;
     }
     
+    if (multiplexed_) {
+        uint32_t id_net;
+        if (msg_len < sizeof(id_net) || !conn_->receive_exact(&id_net, sizeof(id_net))) {
+            return false;
+        }
+        if (request_id) {
+            *request_id = ntohl(id_net);
+        }
+        msg_len -= sizeof(id_net);
+    }
+    
     message.resize(msg_len);
     if (!conn_->receive_exact(message.data(), msg_len)) {
         return false;
@@ -69,15 +240,27 @@ bool RpcClient::receive_message(std::vector<uint8_t>& message) {
     return true;
 }
 
-bool RpcClient::send_message(const std::vector<uint8_t>& message) {
+bool RpcClient::send_message(const std::vector<uint8_t>& message, uint32_t request_id) {
     if (!conn_) {
         return false;
     }
     
+    if (shm_) {
+        return shm_->send(message.data(), message.size(), request_id, SHM_TIMEOUT_MS, conn_->socket_fd());
+    }
+    
+    // Length prefix, plus the request id on multiplexed connections
+    uint32_t header[2];
+    size_t header_size = sizeof(uint32_t);
     uint32_t msg_len = message.size();
-    uint32_t msg_len_net = htonl(msg_len);
+    if (multiplexed_) {
+        msg_len += sizeof(uint32_t);
+        header[1] = htonl(request_id);
+        header_size += sizeof(uint32_t);
+    }
+    header[0] = htonl(msg_len);
     
-    if (!conn_->send(&msg_len_net, sizeof(msg_len_net))) {
+    if (!conn_->send(header, header_size)) {
         return false;
     }
     
@@ -88,6 +271,44 @@ bool RpcClient::send_message(const std::vector<uint8_t>& message) {
     return true;
 }
 
+bool RpcClient::receive_response(diarkis::commands::Response& resp, uint32_t& request_id) {
+    // Shared memory responses are decoded where the server wrote them
+    if (shm_) {
+        return shm_->receive([&](const uint8_t* data, size_t size, uint32_t id) {
+            request_id = id;
+            decode_response(data, size, resp);
+        }, SHM_TIMEOUT_MS, conn_->socket_fd());
+    }
+    
+    std::vector<uint8_t> response_data;
+    if (!receive_message(response_data, &request_id)) {
+        return false;
+    }
+    decode_response(response_data.data(), response_data.size(), resp);
+    return true;
+}
+
+bool RpcClient::decode_response(const uint8_t* data, size_t size, diarkis::commands::Response& resp) {
+    msgpack::object_handle oh = msgpack::unpack(
+        reinterpret_cast<const char*>(data),
+        size
+    );
+    oh.get().convert(resp);
+    
+    if (resp.compression != diarkis::commands::compression::Algorithm::NONE) {
+        std::vector<uint8_t> inflated;
+        if (!diarkis::commands::compression::decompress(resp.compression, resp.data.data(),
+                                                       resp.data.size(), inflated)) {
+            resp.success = false;
+            resp.error = "Failed to decompress response";
+            return false;
+        }
+        resp.data.swap(inflated);
+        resp.compression = diarkis::commands::compression::Algorithm::NONE;
+    }
+    return true;
+}
+
 diarkis::commands::Response RpcClient::send_command(const diarkis::commands::Command& cmd) {
     diarkis::commands::Response resp;
     resp.success = false;
@@ -100,31 +321,29 @@ diarkis::commands::Response RpcClient::send_command(const diarkis::commands::Com
     }
     
     try {
-        msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, cmd);
-        std::vector<uint8_t> request_data(sbuf.data(), sbuf.data() + sbuf.size());
+        std::vector<uint8_t> request_data;
+        encode_command(cmd, request_data);
+        
+        if (request_data.size() > max_frame_size_) {
+            resp.error = "Request exceeds the server frame size";
+            return resp;
+        }
         
         // Send request
-        if (!send_message(request_data)) {
+        uint32_t request_id = next_request_id_++;
+        if (!send_message(request_data, request_id)) {
             resp.error = "Failed to send request";
             disconnect();
             return resp;
         }
         
-        std::vector<uint8_t> response_data;
-        if (!receive_message(response_data)) {
+        uint32_t response_id = request_id;
+        if (!receive_response(resp, response_id) || response_id != request_id) {
+            resp.success = false;
             resp.error = "Failed to receive response";
             disconnect();
             return resp;
         }
-        
-        msgpack::object_handle oh = msgpack::unpack(
-            reinterpret_cast<const char*>(response_data.data()),
-            response_data.size()
-        );
-        msgpack::object obj = oh.get();
-        obj.convert(resp);
-        
         return resp;
         
     } catch (const std::exception& e) {
@@ -135,4 +354,151 @@ diarkis::commands::Response RpcClient::send_command(const diarkis::commands::Com
     }
 }
 
+std::vector<diarkis::commands::Response> RpcClient::send_commands(
+        const std::vector<diarkis::commands::Command>& cmds) {
+    std::vector<diarkis::commands::Response> responses(cmds.size());
+    auto fail_all = [&](const std::string& error) {
+        for (auto& resp : responses) {
+            resp.success = false;
+            resp.error = error;
+        }
+        return responses;
+    };
+    
+    if (!is_connected() && !connect()) {
+        return fail_all("Not connected to server");
+    }
+    
+    // Sending everything before reading anything deadlocks once responses
+    // fill the socket buffers or ring: the server waits for them to drain
+    // while the client is still sending. Reads therefore overlap the sends.
+    uint32_t first_id = next_request_id_;
+    size_t received = 0;
+    std::string receive_error;
+    auto receive_next = [&]() {
+        try {
+            // Multiplexed responses are matched by id, others arrive in order
+            diarkis::commands::Response resp;
+            uint32_t response_id = first_id + static_cast<uint32_t>(received);
+            if (!receive_response(resp, response_id)) {
+                receive_error = "Failed to receive response";
+                return false;
+            }
+            size_t index = response_id - first_id;
+            if (index >= responses.size()) {
+                receive_error = "Unexpected response id";
+                return false;
+            }
+            responses[index] = std::move(resp);
+            ++received;
+            return true;
+        } catch (const std::exception& e) {
+            receive_error = std::string("RPC error: ") + e.what();
+            return false;
+        }
+    };
+    
+    // Over a socket a second thread reads. Both ring directions share one
+    // eventfd per side, so shared memory stays on this thread and reads a
+    // response whenever the request ring is full.
+    std::thread reader;
+    if (!shm_) {
+        reader = std::thread([&] {
+            while (received < cmds.size() && receive_next()) {
+            }
+            // Unblocks a send the server will never read
+            if (!receive_error.empty()) {
+                conn_->shutdown();
+            }
+        });
+    }
+    
+    std::string send_error;
+    try {
+        size_t sent = 0;
+        for (const auto& cmd : cmds) {
+            std::vector<uint8_t> request_data;
+            encode_command(cmd, request_data);
+            if (request_data.size() > max_frame_size_) {
+                send_error = "Failed to send request";
+                break;
+            }
+            if (shm_) {
+                while (!shm_->send(request_data.data(), request_data.size(), next_request_id_, 0,
+                                   conn_->socket_fd())) {
+                    if (received == sent) {
+                        // Nothing in flight, so the ring is not full for lack of reads
+                        if (!send_message(request_data, next_request_id_)) {
+                            send_error = "Failed to send request";
+                        }
+                        break;
+                    }
+                    if (!receive_next()) {
+                        break;
+                    }
+                }
+                if (!send_error.empty() || !receive_error.empty()) {
+                    break;
+                }
+                ++next_request_id_;
+            } else if (!send_message(request_data, next_request_id_++)) {
+                send_error = "Failed to send request";
+                break;
+            }
+            ++sent;
+        }
+        while (shm_ && send_error.empty() && receive_error.empty() && received < cmds.size()) {
+            receive_next();
+        }
+    } catch (const std::exception& e) {
+        send_error = std::string("RPC error: ") + e.what();
+    }
+    
+    if (reader.joinable()) {
+        // The reader waits for responses to requests that were never sent
+        if (!send_error.empty()) {
+            conn_->shutdown();
+        }
+        reader.join();
+    }
+    
+    if (!send_error.empty() || !receive_error.empty()) {
+        disconnect();
+        return fail_all(send_error.empty() ? receive_error : send_error);
+    }
+    return responses;
+}
+
+std::vector<diarkis::commands::Response> RpcClient::send_batch(
+        const std::vector<diarkis::commands::Command>& cmds) {
+    if (!is_connected() && !connect()) {
+        std::vector<diarkis::commands::Response> responses(cmds.size());
+        for (auto& resp : responses) {
+            resp.error = "Not connected to server";
+        }
+        return responses;
+    }
+    if (protocol_version_ < 2) {
+        return send_commands(cmds);
+    }
+    
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, cmds);
+    diarkis::commands::Command batch(diarkis::commands::Type::BATCH, "",
+        std::vector<uint8_t>(sbuf.data(), sbuf.data() + sbuf.size()));
+    
+    diarkis::commands::Response resp = send_command(batch);
+    if (resp.success && resp.results.size() == cmds.size()) {
+        return std::move(resp.results);
+    }
+    
+    // The batch as a whole failed; report it for every command
+    if (resp.success) {
+        resp.success = false;
+        resp.error = "Batch response has the wrong number of results";
+    }
+    resp.results.clear();
+    return std::vector<diarkis::commands::Response>(cmds.size(), resp);
+}
+
 }
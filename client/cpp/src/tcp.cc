@@ -5,12 +5,23 @@
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <cstring>
 
 namespace diarkis_client {
 
+namespace {
+    void set_timeouts(int fd) {
+        struct timeval timeout;
+        timeout.tv_sec = 30;
+        timeout.tv_usec = 0;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+}
+
 TcpConnection::TcpConnection(const std::string& address, uint16_t port)
     : address_(address),
       port_(port),
@@ -19,38 +30,44 @@ TcpConnection::TcpConnection(const std::string& address, uint16_t port)
     
     std::memset(&socket_addr_, 0, sizeof(socket_addr_));
     
+    bool connected = is_unix_endpoint(address_)
+        ? connect_unix(address_.substr(std::strlen(UNIX_SCHEME)))
+        : connect_tcp();
+    if (!connected) {
+        if (socket_fd_ >= 0) {
+            ::close(socket_fd_);
+            socket_fd_ = -1;
+        }
+        return;
+    }
+    
+    spdlog::debug("Connected to {}:{}", address_, port_);
+}
+
+bool TcpConnection::connect_tcp() {
     socket_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
     if (socket_fd_ < 0) {
         spdlog::error("Failed to create socket: {}", strerror(errno));
-        return;
+        return false;
     }
     
     int flag = 1;
     if (setsockopt(socket_fd_, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag)) < 0) {
         spdlog::warn("Failed to set TCP_NODELAY: {}", strerror(errno));
     }
-    
-    struct timeval timeout;
-    timeout.tv_sec = 30;
-    timeout.tv_usec = 0;
-    setsockopt(socket_fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-    setsockopt(socket_fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    set_timeouts(socket_fd_);
     
     socket_addr_.sin_family = AF_INET;
     socket_addr_.sin_port = htons(port_);
     
     if (inet_pton(AF_INET, address_.c_str(), &socket_addr_.sin_addr) <= 0) {
         spdlog::error("Invalid address: {}", address_);
-        ::close(socket_fd_);
-        socket_fd_ = -1;
-        return;
+        return false;
     }
     
     if (::connect(socket_fd_, (sockaddr*)&socket_addr_, sizeof(socket_addr_)) < 0) {
         spdlog::error("Failed to connect to {}:{}: {}", address_, port_, strerror(errno));
-        ::close(socket_fd_);
-        socket_fd_ = -1;
-        return;
+        return false;
     }
     
     sockaddr_in addr;
@@ -61,8 +78,33 @@ TcpConnection::TcpConnection(const std::string& address, uint16_t port)
         remote_addr_ = ip_str;
         remote_port_ = ntohs(addr.sin_port);
     }
+    return true;
+}
+
+bool TcpConnection::connect_unix(const std::string& path) {
+    sockaddr_un addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        spdlog::error("Invalid unix socket path: {}", path);
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
     
-    spdlog::debug("Connected to {}:{}", address_, port_);
+    socket_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket_fd_ < 0) {
+        spdlog::error("Failed to create socket: {}", strerror(errno));
+        return false;
+    }
+    set_timeouts(socket_fd_);
+    
+    if (::connect(socket_fd_, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        spdlog::error("Failed to connect to {}: {}", address_, strerror(errno));
+        return false;
+    }
+    
+    remote_addr_ = path;
+    return true;
 }
 
 TcpConnection::~TcpConnection() {
@@ -159,6 +201,48 @@ bool TcpConnection::receive_exact(void* buffer, size_t size) {
     return true;
 }
 
+bool TcpConnection::send_fds(const int* fds, int count) {
+    constexpr int MAX_PASSED_FDS = 4;
+    if (socket_fd_ < 0 || count <= 0 || count > MAX_PASSED_FDS) {
+        return false;
+    }
+    
+    char byte = 0;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    std::memset(control, 0, sizeof(control));
+    
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    std::memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(socket_fd_, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    
+    if (sent != 1) {
+        spdlog::error("Failed to send descriptors: {}", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void TcpConnection::shutdown() {
+    if (socket_fd_ >= 0) {
+        ::shutdown(socket_fd_, SHUT_RDWR);
+    }
+}
+
 void TcpConnection::close() {
     if (socket_fd_ >= 0) {
         ::shutdown(socket_fd_, SHUT_RDWR);
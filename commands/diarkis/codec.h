@@ -0,0 +1,330 @@
+
+#ifndef DIARKIS_CODEC_H
+#define DIARKIS_CODEC_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <msgpack.hpp>
+#include "diarkis/commands.h"
+
+namespace diarkis::commands {
+
+// Non-owning view of a Command; the buffer it was decoded from must outlive it
+struct CommandView {
+    Type type = Type::CREATE_FILE;
+    std::string_view path;
+    std::string_view new_path;
+    const uint8_t* contents = nullptr;
+    size_t contents_size = 0;
+    uint64_t trace_id = 0;
+    compression::Algorithm compression = compression::Algorithm::NONE;  // Of contents
+
+    CommandView() = default;
+    explicit CommandView(const Command& cmd)
+        : type(cmd.type), path(cmd.path), new_path(cmd.new_path),
+          contents(cmd.contents.data()), contents_size(cmd.contents.size()),
+          trace_id(cmd.trace_id) {}
+
+    Command to_command() const {
+        Command cmd(type, std::string(path));
+        cmd.new_path = std::string(new_path);
+        cmd.contents.assign(contents, contents + contents_size);
+        cmd.trace_id = trace_id;
+        return cmd;
+    }
+};
+
+// A BATCH executes in order, in runs of one kind: consecutive writes become
+// one Raft entry and consecutive reads are served in parallel, so each run
+// sees the earlier ones. Any other command is a run of its own and fails.
+struct BatchRun {
+    enum Kind { OTHER, WRITE, READ };
+    Kind kind;
+    size_t begin;
+    size_t end;         // one past the run's last command
+};
+
+// Splits cmds into the runs they execute as; false, with no runs, when
+// there are more than max_commands
+inline bool plan_batch(const std::vector<CommandView>& cmds, size_t max_commands,
+                       std::vector<BatchRun>& runs) {
+    runs.clear();
+    if (cmds.size() > max_commands) {
+        return false;
+    }
+    auto kind_of = [](Type type) {
+        return is_write(type) ? BatchRun::WRITE : (is_read(type) ? BatchRun::READ : BatchRun::OTHER);
+    };
+    size_t begin = 0;
+    while (begin < cmds.size()) {
+        BatchRun::Kind kind = kind_of(cmds[begin].type);
+        size_t end = begin + 1;
+        while (kind != BatchRun::OTHER && end < cmds.size() && kind_of(cmds[end].type) == kind) {
+            ++end;
+        }
+        runs.push_back(BatchRun{kind, begin, end});
+        begin = end;
+    }
+    return true;
+}
+
+namespace codec {
+
+// Compact encoding, integers little endian:
+//
+//   [0]       magic 0xC1, a byte msgpack never emits
+//   [1]       version
+//   [2]       type
+//   [3]       flags, low two bits are the contents compression::Algorithm
+//   [4, 8)    path length
+//   [8, 12)   new_path length
+//   [12, 16)  contents length
+//   [16, 24)  trace id
+//
+// followed by the path, new_path and contents bytes. Compressed contents
+// are laid out as produced by compression::compress().
+constexpr uint8_t MAGIC = 0xC1;
+constexpr uint8_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 24;
+
+namespace detail {
+    inline void put_u32(uint8_t* out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    inline void put_u64(uint8_t* out, uint64_t v) {
+        for (int i = 0; i < 8; ++i) out[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    inline uint32_t get_u32(const uint8_t* in) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(in[i]) << (8 * i);
+        return v;
+    }
+
+    inline uint64_t get_u64(const uint8_t* in) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; ++i) v |= static_cast<uint64_t>(in[i]) << (8 * i);
+        return v;
+    }
+}
+
+inline bool is_compact(const uint8_t* data, size_t size) {
+    return size > 0 && data[0] == MAGIC;
+}
+
+inline size_t encoded_size(const CommandView& cmd) {
+    return HEADER_SIZE + cmd.path.size() + cmd.new_path.size() + cmd.contents_size;
+}
+
+// Lengths must fit in 32 bits; callers enforce far smaller message limits
+inline void write_header(const CommandView& cmd, uint8_t* out) {
+    out[0] = MAGIC;
+    out[1] = VERSION;
+    out[2] = static_cast<uint8_t>(cmd.type);
+    out[3] = static_cast<uint8_t>(cmd.compression);
+    detail::put_u32(out + 4, static_cast<uint32_t>(cmd.path.size()));
+    detail::put_u32(out + 8, static_cast<uint32_t>(cmd.new_path.size()));
+    detail::put_u32(out + 12, static_cast<uint32_t>(cmd.contents_size));
+    detail::put_u64(out + 16, cmd.trace_id);
+}
+
+// Appends the encoded command to out
+inline void encode(const CommandView& cmd, std::vector<uint8_t>& out) {
+    size_t offset = out.size();
+    out.resize(offset + encoded_size(cmd));
+    uint8_t* p = out.data() + offset;
+
+    write_header(cmd, p);
+    p += HEADER_SIZE;
+    p = std::copy(cmd.path.begin(), cmd.path.end(), p);
+    p = std::copy(cmd.new_path.begin(), cmd.new_path.end(), p);
+    if (cmd.contents_size > 0) {
+        std::copy(cmd.contents, cmd.contents + cmd.contents_size, p);
+    }
+}
+
+// Size of the compact command at the start of data, or 0 if the header is
+// invalid or the command is truncated; used to walk concatenated commands
+inline size_t frame_size(const uint8_t* data, size_t size) {
+    if (size < HEADER_SIZE || data[0] != MAGIC) {
+        return 0;
+    }
+    uint64_t total = HEADER_SIZE + static_cast<uint64_t>(detail::get_u32(data + 4)) +
+                     detail::get_u32(data + 8) + detail::get_u32(data + 12);
+    return total <= size ? static_cast<size_t>(total) : 0;
+}
+
+// Size the compact command's compressed contents declare they inflate to,
+// or 0 if they are not compressed or the header is invalid; lets a server
+// charge the inflated size to its memory budget before decoding
+inline size_t inflated_size(const uint8_t* data, size_t size) {
+    if (frame_size(data, size) != size || (data[3] & 0x03) == 0) {
+        return 0;
+    }
+    size_t offset = HEADER_SIZE + detail::get_u32(data + 4) + detail::get_u32(data + 8);
+    return compression::raw_size(data + offset, detail::get_u32(data + 12));
+}
+
+// Decodes without copying; out points into data and compressed contents are
+// left as they are (see Decoder). Rejects unknown versions and flags,
+// truncated input and trailing bytes.
+inline bool decode(const uint8_t* data, size_t size, CommandView& out) {
+    if (size < HEADER_SIZE || data[0] != MAGIC || data[1] != VERSION || (data[3] & ~0x03) != 0) {
+        return false;
+    }
+
+    uint64_t path_len = detail::get_u32(data + 4);
+    uint64_t new_path_len = detail::get_u32(data + 8);
+    uint64_t contents_len = detail::get_u32(data + 12);
+    if (HEADER_SIZE + path_len + new_path_len + contents_len != size) {
+        return false;
+    }
+
+    const char* p = reinterpret_cast<const char*>(data + HEADER_SIZE);
+    out.type = static_cast<Type>(data[2]);
+    out.compression = static_cast<compression::Algorithm>(data[3] & 0x03);
+    out.trace_id = detail::get_u64(data + 16);
+    out.path = std::string_view(p, path_len);
+    out.new_path = std::string_view(p + path_len, new_path_len);
+    out.contents = data + HEADER_SIZE + path_len + new_path_len;
+    out.contents_size = contents_len;
+    return true;
+}
+
+// Decodes either encoding into views, reusing its MessagePack zone across
+// calls. Not thread safe; keep one per thread or connection. Strings and
+// binaries are unpacked by reference, so views point into the input.
+// Compressed contents are inflated into a buffer owned by the decoder.
+class Decoder {
+public:
+    // Throws msgpack errors for malformed MessagePack
+    bool decode(const uint8_t* data, size_t size, CommandView& out) {
+        if (is_compact(data, size)) {
+            return codec::decode(data, size, out) && inflate(out);
+        }
+
+        zone_.clear();
+        size_t offset = 0;
+        bool referenced = false;
+        msgpack::object obj = msgpack::unpack(
+            zone_, reinterpret_cast<const char*>(data), size, offset, referenced,
+            &Decoder::reference_all, nullptr);
+        if (view_of(obj, out)) {
+            return true;
+        }
+
+        // Unusual but valid shapes, e.g. contents packed as an array
+        obj.convert(fallback_);
+        out = CommandView(fallback_);
+        return true;
+    }
+
+    // Decodes the packed std::vector<Command> carried by a BATCH command into
+    // views pointing into data. Views returned by decode() stay valid.
+    bool decode_batch(const uint8_t* data, size_t size, std::vector<CommandView>& out) {
+        zone_.clear();
+        size_t offset = 0;
+        bool referenced = false;
+        msgpack::object obj = msgpack::unpack(
+            zone_, reinterpret_cast<const char*>(data), size, offset, referenced,
+            &Decoder::reference_all, nullptr);
+        if (obj.type != msgpack::type::ARRAY) {
+            return false;
+        }
+
+        // Reserved up front so views into it are not invalidated
+        size_t count = obj.via.array.size;
+        out.resize(count);
+        batch_fallback_.clear();
+        batch_fallback_.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            const msgpack::object& element = obj.via.array.ptr[i];
+            if (!view_of(element, out[i])) {
+                batch_fallback_.emplace_back();
+                element.convert(batch_fallback_.back());
+                out[i] = CommandView(batch_fallback_.back());
+            }
+        }
+        return true;
+    }
+
+    // Compressed contents declaring a larger size are rejected as malformed
+    void set_max_inflated(size_t max_bytes) {
+        max_inflated_ = max_bytes;
+    }
+
+    // Frees buffers grown beyond max_bytes by a large request
+    void trim(size_t max_bytes) {
+        if (inflated_.capacity() > max_bytes) {
+            std::vector<uint8_t>().swap(inflated_);
+        }
+        std::vector<Command>().swap(batch_fallback_);
+    }
+
+private:
+    bool inflate(CommandView& view) {
+        if (view.compression == compression::Algorithm::NONE) {
+            return true;
+        }
+        if (!compression::decompress(view.compression, view.contents, view.contents_size, inflated_,
+                                     max_inflated_)) {
+            return false;
+        }
+        view.contents = inflated_.data();
+        view.contents_size = inflated_.size();
+        view.compression = compression::Algorithm::NONE;
+        return true;
+    }
+
+    static bool reference_all(msgpack::type::object_type, size_t, void*) {
+        return true;
+    }
+
+    static bool string_of(const msgpack::object& obj, std::string_view& out) {
+        if (obj.type == msgpack::type::STR) {
+            out = std::string_view(obj.via.str.ptr, obj.via.str.size);
+            return true;
+        }
+        return false;
+    }
+
+    // Command is packed as [type, path, new_path, contents, trace_id?]
+    static bool view_of(const msgpack::object& obj, CommandView& out) {
+        if (obj.type != msgpack::type::ARRAY || obj.via.array.size < 4) {
+            return false;
+        }
+        const msgpack::object* f = obj.via.array.ptr;
+        if (f[0].type != msgpack::type::POSITIVE_INTEGER || f[3].type != msgpack::type::BIN) {
+            return false;
+        }
+        if (!string_of(f[1], out.path) || !string_of(f[2], out.new_path)) {
+            return false;
+        }
+
+        out.type = static_cast<Type>(f[0].via.u64);
+        out.compression = compression::Algorithm::NONE;
+        out.contents = reinterpret_cast<const uint8_t*>(f[3].via.bin.ptr);
+        out.contents_size = f[3].via.bin.size;
+        out.trace_id = 0;
+        if (obj.via.array.size > 4 && f[4].type == msgpack::type::POSITIVE_INTEGER) {
+            out.trace_id = f[4].via.u64;
+        }
+        return true;
+    }
+
+    msgpack::zone zone_;
+    Command fallback_;
+    std::vector<Command> batch_fallback_;
+    std::vector<uint8_t> inflated_;
+    size_t max_inflated_ = compression::MAX_RAW_SIZE;
+};
+
+}
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <vector>
 #include <stdint.h>
 #include <msgpack.hpp>
+#include "diarkis/compression.h"
 
 namespace diarkis::commands {
 
@@ -18,15 +19,67 @@ enum class Type : uint8_t {
     CREATE_DIR = 6,
     LIST_DIR = 7,
     DELETE_DIR = 8,
-    RENAME = 9
+    RENAME = 9,
+    HELLO = 10,         // Connection handshake, contents carry a packed Hello
+    BATCH = 11,         // Contents carry a packed std::vector<Command>
+    ATTACH_SHM = 12,    // Followed by the shared memory descriptors, see shm.h
+    COPY = 13,          // Copies path to new_path on every replica
+    TRUNCATE = 14,      // Contents carry a packed Extent
+    PUNCH_HOLE = 15     // Contents carry a packed Extent
 };
 
+inline const char* type_name(Type type) {
+    switch (type) {
+        case Type::CREATE_FILE: return "create_file";
+        case Type::READ_FILE: return "read_file";
+        case Type::WRITE_FILE: return "write_file";
+        case Type::APPEND_FILE: return "append_file";
+        case Type::DELETE_FILE: return "delete_file";
+        case Type::CREATE_DIR: return "create_dir";
+        case Type::LIST_DIR: return "list_dir";
+        case Type::DELETE_DIR: return "delete_dir";
+        case Type::RENAME: return "rename";
+        case Type::HELLO: return "hello";
+        case Type::BATCH: return "batch";
+        case Type::ATTACH_SHM: return "attach_shm";
+        case Type::COPY: return "copy";
+        case Type::TRUNCATE: return "truncate";
+        case Type::PUNCH_HOLE: return "punch_hole";
+    }
+    return "unknown";
+}
+
+// Commands that go through Raft
+inline bool is_write(Type type) {
+    switch (type) {
+        case Type::CREATE_FILE:
+        case Type::WRITE_FILE:
+        case Type::APPEND_FILE:
+        case Type::DELETE_FILE:
+        case Type::CREATE_DIR:
+        case Type::DELETE_DIR:
+        case Type::RENAME:
+        case Type::COPY:
+        case Type::TRUNCATE:
+        case Type::PUNCH_HOLE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Commands served from local storage
+inline bool is_read(Type type) {
+    return type == Type::READ_FILE || type == Type::LIST_DIR;
+}
+
 struct Command {
     Type type;
     std::string path;
     
-    std::string new_path;              // For RENAME
+    std::string new_path;              // For RENAME and COPY
     std::vector<uint8_t> contents;     // For WRITE/APPEND/READ response
+    uint64_t trace_id = 0;             // Non-zero forces tracing on the server
     
     Command() {}
 
@@ -38,11 +91,68 @@ struct Command {
     Command(Type _type, std::string _path, std::vector<uint8_t> _data)
         : type(_type), path(std::move(_path)), contents(std::move(_data)) {}
     
-    // for RENAME
+    // for RENAME and COPY
     Command(Type _type, std::string _path, std::string _new_path)
         : type(_type), path(std::move(_path)), new_path(std::move(_new_path)) {}
     
-    MSGPACK_DEFINE(type, path, new_path, contents);
+    MSGPACK_DEFINE(type, path, new_path, contents, trace_id);
+};
+
+// Refines a failed Response; BUSY, OVERLOADED and THROTTLED mean the request
+// was not executed and may be retried after a backoff
+enum class Status : uint8_t {
+    OK = 0,
+    ERROR = 1,
+    BUSY = 2,          // RPC memory budget or execution slots exhausted
+    OVERLOADED = 3,    // Raft write pipeline full
+    THROTTLED = 4      // client over its rate limit
+};
+
+// Version of the connection protocol negotiated by HELLO; peers that never
+// send HELLO speak version 0. Version 2 adds BATCH, version 3 adds COPY and
+// version 4 adds TRUNCATE and PUNCH_HOLE.
+constexpr uint32_t PROTOCOL_VERSION = 4;
+
+// Features a peer supports, advertised in the HELLO exchange
+enum Capability : uint32_t {
+    CAP_LZ4 = 1u << 0,
+    CAP_ZSTD = 1u << 1,
+    CAP_MULTIPLEX = 1u << 2,    // frames carry a request id, responses may be reordered
+    CAP_SHM = 1u << 3           // shared memory rings, offered on Unix sockets only
+};
+
+inline uint32_t compression_capabilities() {
+    uint32_t caps = 0;
+    if (compression::available(compression::Algorithm::LZ4)) caps |= CAP_LZ4;
+    if (compression::available(compression::Algorithm::ZSTD)) caps |= CAP_ZSTD;
+    return caps;
+}
+
+// Preferred algorithm among the given capabilities
+inline compression::Algorithm pick_compression(uint32_t caps) {
+    if (caps & CAP_ZSTD) return compression::Algorithm::ZSTD;
+    if (caps & CAP_LZ4) return compression::Algorithm::LZ4;
+    return compression::Algorithm::NONE;
+}
+
+// Payload of a HELLO command. Each side states what it supports; the server
+// answers with the negotiated version and the accepted capabilities.
+struct Hello {
+    uint32_t capabilities = 0;
+    uint32_t version = 0;
+    uint32_t max_frame_size = 0;    // largest frame the sender accepts, 0 for no limit
+    std::string client_id;          // label for the server's logs; not used for rate limits
+    
+    MSGPACK_DEFINE(capabilities, version, max_frame_size, client_id);
+};
+
+// Payload of TRUNCATE, which sets the file size to offset, and of PUNCH_HOLE,
+// which deallocates length bytes from offset
+struct Extent {
+    uint64_t offset = 0;
+    uint64_t length = 0;
+    
+    MSGPACK_DEFINE(offset, length);
 };
 
 struct Response {
@@ -50,14 +160,23 @@ struct Response {
     std::string error;
     std::vector<uint8_t> data;              // For READ responses
     std::vector<std::string> entries;       // For LIST_DIR responses
+    Status status = Status::OK;
+    compression::Algorithm compression = compression::Algorithm::NONE;  // Applies to data
+    std::vector<Response> results;          // For BATCH responses, one per command
     
     Response() : success(false) {}
     
-    MSGPACK_DEFINE(success, error, data, entries);
+    bool retryable() const {
+        return status == Status::BUSY || status == Status::OVERLOADED || status == Status::THROTTLED;
+    }
+    
+    MSGPACK_DEFINE(success, error, data, entries, status, compression, results);
 };
 
 }
 
 MSGPACK_ADD_ENUM(diarkis::commands::Type);
+MSGPACK_ADD_ENUM(diarkis::commands::Status);
+MSGPACK_ADD_ENUM(diarkis::commands::compression::Algorithm);
 
 #endif
@@ -0,0 +1,222 @@
+
+#ifndef DIARKIS_COMPRESSION_H
+#define DIARKIS_COMPRESSION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef DIARKIS_HAVE_LZ4
+#include <lz4.h>
+#endif
+#ifdef DIARKIS_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace diarkis::commands::compression {
+
+enum class Algorithm : uint8_t {
+    NONE = 0,
+    LZ4 = 1,
+    ZSTD = 2
+};
+
+// Decompressed payloads are capped like uncompressed messages
+constexpr size_t MAX_RAW_SIZE = 100 * 1024 * 1024;
+
+// An LZ4 block never inflates to more than 255 times its size, so larger
+// declared sizes are corrupt
+constexpr size_t LZ4_MAX_RATIO = 255;
+
+// First output buffer of a streamed Zstd inflate; it doubles as output arrives
+constexpr size_t INFLATE_CHUNK = 64 * 1024;
+
+// Payloads above this size are probed with a prefix before compressing
+constexpr size_t PROBE_THRESHOLD = 64 * 1024;
+constexpr size_t PROBE_SIZE = 4 * 1024;
+
+inline const char* name(Algorithm algorithm) {
+    switch (algorithm) {
+        case Algorithm::NONE: return "none";
+        case Algorithm::LZ4: return "lz4";
+        case Algorithm::ZSTD: return "zstd";
+    }
+    return "unknown";
+}
+
+inline bool parse(const std::string& text, Algorithm& out) {
+    if (text == "none") { out = Algorithm::NONE; return true; }
+    if (text == "lz4") { out = Algorithm::LZ4; return true; }
+    if (text == "zstd") { out = Algorithm::ZSTD; return true; }
+    return false;
+}
+
+// Whether this build can compress and decompress with the algorithm
+inline bool available(Algorithm algorithm) {
+    switch (algorithm) {
+        case Algorithm::NONE: return true;
+#ifdef DIARKIS_HAVE_LZ4
+        case Algorithm::LZ4: return true;
+#endif
+#ifdef DIARKIS_HAVE_ZSTD
+        case Algorithm::ZSTD: return true;
+#endif
+        default: return false;
+    }
+}
+
+namespace detail {
+    // Compresses n bytes to dst, which has bound(n) bytes; returns 0 on failure
+    inline size_t compress_raw(Algorithm algorithm, const uint8_t* src, size_t n, uint8_t* dst, size_t capacity) {
+        switch (algorithm) {
+#ifdef DIARKIS_HAVE_LZ4
+            case Algorithm::LZ4: {
+                int written = LZ4_compress_default(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(dst),
+                                                   static_cast<int>(n), static_cast<int>(capacity));
+                return written > 0 ? static_cast<size_t>(written) : 0;
+            }
+#endif
+#ifdef DIARKIS_HAVE_ZSTD
+            case Algorithm::ZSTD: {
+                size_t written = ZSTD_compress(dst, capacity, src, n, 1);
+                return ZSTD_isError(written) ? 0 : written;
+            }
+#endif
+            default:
+                (void)src; (void)n; (void)dst; (void)capacity;
+                return 0;
+        }
+    }
+
+    inline size_t bound(Algorithm algorithm, size_t n) {
+        switch (algorithm) {
+#ifdef DIARKIS_HAVE_LZ4
+            case Algorithm::LZ4: return static_cast<size_t>(LZ4_compressBound(static_cast<int>(n)));
+#endif
+#ifdef DIARKIS_HAVE_ZSTD
+            case Algorithm::ZSTD: return ZSTD_compressBound(n);
+#endif
+            default: return n;
+        }
+    }
+
+    // Worth keeping only if it saves at least an eighth
+    inline bool worthwhile(size_t raw, size_t compressed) {
+        return compressed > 0 && compressed < raw - raw / 8;
+    }
+
+    inline void put_u32(uint8_t* out, uint32_t v) {
+        for (int i = 0; i < 4; ++i) out[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+
+    inline uint32_t get_u32(const uint8_t* in) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; ++i) v |= static_cast<uint32_t>(in[i]) << (8 * i);
+        return v;
+    }
+}
+
+// Compresses n bytes into out as [u32 raw size, little endian][frame].
+// Returns false, leaving out unspecified, when the algorithm is unavailable
+// or the data does not shrink enough; large inputs are rejected early when
+// a prefix does not compress, so incompressible data costs little CPU.
+inline bool compress(Algorithm algorithm, const uint8_t* in, size_t n, std::vector<uint8_t>& out) {
+    if (algorithm == Algorithm::NONE || !available(algorithm) || n == 0 || n > MAX_RAW_SIZE) {
+        return false;
+    }
+
+    if (n > PROBE_THRESHOLD) {
+        out.resize(detail::bound(algorithm, PROBE_SIZE));
+        size_t probe = detail::compress_raw(algorithm, in, PROBE_SIZE, out.data(), out.size());
+        if (!detail::worthwhile(PROBE_SIZE, probe)) {
+            return false;
+        }
+    }
+
+    out.resize(4 + detail::bound(algorithm, n));
+    size_t written = detail::compress_raw(algorithm, in, n, out.data() + 4, out.size() - 4);
+    if (!detail::worthwhile(n, written + 4)) {
+        return false;
+    }
+    detail::put_u32(out.data(), static_cast<uint32_t>(n));
+    out.resize(4 + written);
+    return true;
+}
+
+// Size a compressed payload declares it inflates to, or 0 if it is too short
+inline size_t raw_size(const uint8_t* in, size_t n) {
+    return n < 4 ? 0 : detail::get_u32(in);
+}
+
+// Reverses compress(); fails on corrupt input or raw sizes above max_raw.
+// Zstd is streamed into a buffer that grows with the output actually
+// produced; LZ4 blocks cannot be streamed, so their declared size is first
+// checked against the most the block could inflate to.
+inline bool decompress(Algorithm algorithm, const uint8_t* in, size_t n, std::vector<uint8_t>& out,
+                       size_t max_raw = MAX_RAW_SIZE) {
+    if (n < 4 || !available(algorithm)) {
+        return false;
+    }
+    size_t raw = raw_size(in, n);
+    if (raw == 0 || raw > std::min(max_raw, MAX_RAW_SIZE)) {
+        return false;
+    }
+
+    switch (algorithm) {
+#ifdef DIARKIS_HAVE_LZ4
+        case Algorithm::LZ4: {
+            if (raw > (n - 4) * LZ4_MAX_RATIO) {
+                return false;
+            }
+            out.resize(raw);
+            int read = LZ4_decompress_safe(reinterpret_cast<const char*>(in + 4), reinterpret_cast<char*>(out.data()),
+                                           static_cast<int>(n - 4), static_cast<int>(raw));
+            return read >= 0 && static_cast<size_t>(read) == raw;
+        }
+#endif
+#ifdef DIARKIS_HAVE_ZSTD
+        case Algorithm::ZSTD: {
+            thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            if (!dctx) {
+                return false;
+            }
+            ZSTD_DCtx_reset(dctx.get(), ZSTD_reset_session_only);
+
+            ZSTD_inBuffer input{in + 4, n - 4, 0};
+            size_t produced = 0;
+            out.resize(std::min(raw, INFLATE_CHUNK));
+            while (true) {
+                ZSTD_outBuffer output{out.data(), out.size(), produced};
+                size_t ret = ZSTD_decompressStream(dctx.get(), &output, &input);
+                if (ZSTD_isError(ret)) {
+                    return false;
+                }
+                produced = output.pos;
+                if (ret == 0) {
+                    break;
+                }
+                if (produced == out.size()) {
+                    // More output than the header declared
+                    if (out.size() == raw) {
+                        return false;
+                    }
+                    out.resize(std::min(raw, out.size() * 2));
+                } else if (input.pos == input.size) {
+                    return false;
+                }
+            }
+            return produced == raw && input.pos == input.size;
+        }
+#endif
+        default:
+            (void)out;
+            return false;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,468 @@
+
+#ifndef DIARKIS_SHM_H
+#define DIARKIS_SHM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace diarkis::commands::shm {
+
+// Shared memory transport for clients on the same host. The client creates a
+// memfd holding two single-producer single-consumer rings, one per direction,
+// and an eventfd per side, and hands all three to the server over its Unix
+// socket. Each side spins briefly when its ring is empty or full and then
+// sleeps on its eventfd; the peer writes the eventfd only when it sees the
+// sleeping flag set, so a busy connection makes no syscalls.
+//
+// Memory layout: [Header][request ring][response ring]
+//
+// Each frame is [u32 payload length][u32 request id][payload], padded to 8
+// bytes. A length of WRAP_MARKER means the rest of the ring is skipped.
+constexpr uint32_t MAGIC = 0x44534852;      // "DSHR"
+constexpr uint32_t VERSION = 1;
+constexpr size_t MIN_RING_BYTES = 64 * 1024;
+constexpr size_t MAX_RING_BYTES = 1024ULL * 1024 * 1024;
+constexpr size_t FRAME_HEADER = 8;
+constexpr uint32_t WRAP_MARKER = 0xFFFFFFFF;
+
+constexpr int REQUIRED_SEALS = F_SEAL_SHRINK | F_SEAL_GROW;
+
+// Iterations spent polling before going to sleep
+constexpr int SPIN_ITERATIONS = 4000;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock free");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "shared atomics must be lock free");
+
+struct RingControl {
+    alignas(64) std::atomic<uint64_t> head;     // bytes consumed, written by the consumer
+    alignas(64) std::atomic<uint64_t> tail;     // bytes produced, written by the producer
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_bytes;                        // size of each ring
+    alignas(64) std::atomic<uint32_t> client_sleeping;
+    alignas(64) std::atomic<uint32_t> server_sleeping;
+    RingControl requests;                       // client to server
+    RingControl responses;                      // server to client
+};
+
+constexpr size_t DATA_OFFSET = (sizeof(Header) + 63) / 64 * 64;
+
+inline size_t align8(size_t n) {
+    return (n + 7) & ~static_cast<size_t>(7);
+}
+
+inline size_t mapping_size(size_t ring_bytes) {
+    return DATA_OFFSET + 2 * ring_bytes;
+}
+
+// Whether fd is an eventfd, judged by its /proc/self/fd link
+inline bool is_eventfd(int fd) {
+    std::string link = "/proc/self/fd/" + std::to_string(fd);
+    char target[32];
+    ssize_t n = ::readlink(link.c_str(), target, sizeof(target));
+    return n > 0 && std::string_view(target, static_cast<size_t>(n)) == "anon_inode:[eventfd]";
+}
+
+// One direction of the channel. The peer shares the memory and is not
+// trusted: each side keeps the index it owns (the producer's tail, the
+// consumer's head) in a private member and never reads it back from the
+// mapping, and every index and length read from the peer is bounds checked.
+class Ring {
+public:
+    Ring(RingControl* control, uint8_t* data, uint64_t capacity)
+        : control_(control), data_(data), capacity_(capacity) {}
+
+    // Largest payload a frame may carry; bigger frames could never fit
+    size_t max_payload() const { return capacity_ / 2 - FRAME_HEADER; }
+
+    // Producer: returns where size payload bytes go, or nullptr while the
+    // ring lacks room. The frame becomes visible on commit().
+    uint8_t* reserve(size_t size) {
+        if (size > max_payload()) {
+            return nullptr;
+        }
+        uint64_t head = control_->head.load(std::memory_order_acquire);
+        if (tail_ - head > capacity_ || head % 8 != 0) {
+            return nullptr;
+        }
+        uint64_t offset = tail_ % capacity_;
+        uint64_t contiguous = capacity_ - offset;
+        uint64_t need = align8(FRAME_HEADER + size);
+
+        skip_ = contiguous < need ? contiguous : 0;
+        if (tail_ + skip_ + need - head > capacity_) {
+            return nullptr;
+        }
+        reserved_ = need;
+        start_ = skip_ ? 0 : offset;
+        return data_ + start_ + FRAME_HEADER;
+    }
+
+    // Producer: publishes the frame placed by the last reserve()
+    void commit(size_t size, uint32_t request_id) {
+        if (skip_) {
+            put_u32(data_ + tail_ % capacity_, WRAP_MARKER);
+        }
+        put_u32(data_ + start_, static_cast<uint32_t>(size));
+        put_u32(data_ + start_ + 4, request_id);
+        tail_ += skip_ + reserved_;
+        control_->tail.store(tail_, std::memory_order_release);
+    }
+
+    enum class Peek { EMPTY, FRAME, CORRUPT };
+
+    // Consumer: finds the next frame without consuming it
+    Peek peek(const uint8_t*& payload, size_t& size, uint32_t& request_id) {
+        uint64_t tail = control_->tail.load(std::memory_order_acquire);
+        if (head_ == tail) {
+            return Peek::EMPTY;
+        }
+        if (tail - head_ > capacity_ || tail % 8 != 0) {
+            return Peek::CORRUPT;
+        }
+
+        uint64_t offset = head_ % capacity_;
+        uint32_t length = get_u32(data_ + offset);
+        if (length == WRAP_MARKER) {
+            if (capacity_ - offset > tail - head_) {
+                return Peek::CORRUPT;
+            }
+            head_ += capacity_ - offset;
+            control_->head.store(head_, std::memory_order_release);
+            if (head_ == tail) {
+                return Peek::EMPTY;
+            }
+            offset = 0;
+            length = get_u32(data_);
+        }
+
+        uint64_t frame = align8(FRAME_HEADER + static_cast<uint64_t>(length));
+        if (frame > tail - head_ || frame > capacity_ - offset) {
+            return Peek::CORRUPT;
+        }
+        payload = data_ + offset + FRAME_HEADER;
+        size = length;
+        request_id = get_u32(data_ + offset + 4);
+        consumed_ = frame;
+        return Peek::FRAME;
+    }
+
+    // Consumer: releases the frame returned by the last peek()
+    void consume() {
+        head_ += consumed_;
+        control_->head.store(head_, std::memory_order_release);
+        consumed_ = 0;
+    }
+
+private:
+    static void put_u32(uint8_t* out, uint32_t v) { std::memcpy(out, &v, sizeof(v)); }
+    static uint32_t get_u32(const uint8_t* in) {
+        uint32_t v;
+        std::memcpy(&v, in, sizeof(v));
+        return v;
+    }
+
+    RingControl* control_;
+    uint8_t* data_;
+    uint64_t capacity_;
+
+    // Indexes owned by this side; both rings start at 0 in a fresh memfd
+    uint64_t tail_ = 0;
+    uint64_t head_ = 0;
+
+    // State carried from reserve() to commit() and peek() to consume()
+    uint64_t skip_ = 0;
+    uint64_t start_ = 0;
+    uint64_t reserved_ = 0;
+    uint64_t consumed_ = 0;
+};
+
+// One side of a mapped channel. Owns the mapping and the descriptors.
+class Channel {
+public:
+    enum class Side { CLIENT, SERVER };
+
+    ~Channel() {
+        if (base_ != MAP_FAILED && base_ != nullptr) {
+            ::munmap(base_, size_);
+        }
+        for (int fd : {memfd_, client_event_, server_event_}) {
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    // Client side: allocates the memory and the eventfds
+    static std::unique_ptr<Channel> create(size_t ring_bytes, std::string& error) {
+        ring_bytes = align8(ring_bytes);
+        if (ring_bytes < MIN_RING_BYTES || ring_bytes > MAX_RING_BYTES) {
+            error = "Invalid ring size";
+            return nullptr;
+        }
+        std::unique_ptr<Channel> channel(new Channel(Side::CLIENT));
+        channel->memfd_ = ::memfd_create("diarkis-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        channel->client_event_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        channel->server_event_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (channel->memfd_ < 0 || channel->client_event_ < 0 || channel->server_event_ < 0 ||
+            ::ftruncate(channel->memfd_, static_cast<off_t>(mapping_size(ring_bytes))) != 0) {
+            error = std::string("Failed to allocate shared memory: ") + std::strerror(errno);
+            return nullptr;
+        }
+        if (::fcntl(channel->memfd_, F_ADD_SEALS, REQUIRED_SEALS | F_SEAL_SEAL) != 0) {
+            error = std::string("Failed to seal shared memory: ") + std::strerror(errno);
+            return nullptr;
+        }
+        if (!channel->map(mapping_size(ring_bytes), error)) {
+            return nullptr;
+        }
+
+        // A fresh memfd is zero filled, so the indexes and flags start at 0
+        auto* header = channel->header();
+        header->magic = MAGIC;
+        header->version = VERSION;
+        header->ring_bytes = ring_bytes;
+        channel->init_rings(ring_bytes);
+        return channel;
+    }
+
+    // Server side: maps descriptors received from the client and validates
+    // the header against the real size of the memory
+    static std::unique_ptr<Channel> attach(int memfd, int client_event, int server_event,
+                                           std::string& error) {
+        std::unique_ptr<Channel> channel(new Channel(Side::SERVER));
+        channel->memfd_ = memfd;
+        channel->client_event_ = client_event;
+        channel->server_event_ = server_event;
+
+        // Any other descriptor, or a blocking eventfd, could stall the server
+        // in read() or write(); the flag is shared with the client's copy
+        for (int fd : {client_event, server_event}) {
+            int flags = is_eventfd(fd) ? ::fcntl(fd, F_GETFL) : -1;
+            if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+                error = "Shared memory events must be eventfds";
+                return nullptr;
+            }
+        }
+
+        // Unsealed memory could be shrunk under us, faulting the server
+        int seals = ::fcntl(memfd, F_GET_SEALS);
+        if (seals < 0 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS) {
+            error = "Shared memory must be sealed against resizing";
+            return nullptr;
+        }
+
+        struct stat st;
+        if (::fstat(memfd, &st) != 0 || st.st_size < static_cast<off_t>(DATA_OFFSET)) {
+            error = "Invalid shared memory descriptor";
+            return nullptr;
+        }
+        if (!channel->map(static_cast<size_t>(st.st_size), error)) {
+            return nullptr;
+        }
+
+        const auto* header = channel->header();
+        uint64_t ring_bytes = header->ring_bytes;
+        if (header->magic != MAGIC || header->version != VERSION ||
+            ring_bytes < MIN_RING_BYTES || ring_bytes > MAX_RING_BYTES || ring_bytes % 8 != 0 ||
+            mapping_size(ring_bytes) != channel->size_) {
+            error = "Invalid shared memory header";
+            return nullptr;
+        }
+        channel->init_rings(ring_bytes);
+        return channel;
+    }
+
+    int memfd() const { return memfd_; }
+    int client_event() const { return client_event_; }
+    int server_event() const { return server_event_; }
+    size_t max_payload() const { return outbound_->max_payload(); }
+
+    // Writes one frame, waiting up to timeout_ms while the ring is full.
+    // fill(uint8_t* out) writes exactly size bytes straight into the ring.
+    template <typename Fill>
+    bool send(size_t size, uint32_t request_id, Fill&& fill, int timeout_ms, int liveness_fd = -1) {
+        if (size > outbound_->max_payload()) {
+            return false;
+        }
+        uint8_t* out = nullptr;
+        if (!wait([&] { return (out = outbound_->reserve(size)) != nullptr; }, timeout_ms, liveness_fd)) {
+            return false;
+        }
+        fill(out);
+        outbound_->commit(size, request_id);
+        notify_peer();
+        return true;
+    }
+
+    bool send(const uint8_t* data, size_t size, uint32_t request_id, int timeout_ms, int liveness_fd = -1) {
+        return send(size, request_id, [&](uint8_t* out) { std::memcpy(out, data, size); },
+                    timeout_ms, liveness_fd);
+    }
+
+    // Waits up to timeout_ms (-1 forever) for a frame and hands it to
+    // handle(const uint8_t* data, size_t size, uint32_t request_id) while it
+    // is still in the ring. Fails on timeout, on a corrupt ring, or when
+    // liveness_fd reports the peer gone.
+    template <typename Handle>
+    bool receive(Handle&& handle, int timeout_ms, int liveness_fd = -1) {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        uint32_t request_id = 0;
+        Ring::Peek peek = Ring::Peek::EMPTY;
+        if (!wait([&] {
+                peek = inbound_->peek(data, size, request_id);
+                return peek != Ring::Peek::EMPTY;
+            }, timeout_ms, liveness_fd)) {
+            return false;
+        }
+        if (peek == Ring::Peek::CORRUPT) {
+            return false;
+        }
+        handle(data, size, request_id);
+        inbound_->consume();
+        notify_peer();
+        return true;
+    }
+
+    bool receive(std::vector<uint8_t>& out, uint32_t& request_id, int timeout_ms, int liveness_fd = -1) {
+        return receive([&](const uint8_t* data, size_t size, uint32_t id) {
+            out.assign(data, data + size);
+            request_id = id;
+        }, timeout_ms, liveness_fd);
+    }
+
+private:
+    explicit Channel(Side side) : side_(side) {}
+
+    Header* header() const { return static_cast<Header*>(base_); }
+
+    bool map(size_t size, std::string& error) {
+        size_ = size;
+        base_ = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd_, 0);
+        if (base_ == MAP_FAILED) {
+            base_ = nullptr;
+            error = std::string("Failed to map shared memory: ") + std::strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    void init_rings(uint64_t ring_bytes) {
+        auto* header = this->header();
+        auto* data = static_cast<uint8_t*>(base_) + DATA_OFFSET;
+        Ring requests(&header->requests, data, ring_bytes);
+        Ring responses(&header->responses, data + ring_bytes, ring_bytes);
+        bool client = side_ == Side::CLIENT;
+        outbound_ = std::make_unique<Ring>(client ? requests : responses);
+        inbound_ = std::make_unique<Ring>(client ? responses : requests);
+        own_sleeping_ = client ? &header->client_sleeping : &header->server_sleeping;
+        peer_sleeping_ = client ? &header->server_sleeping : &header->client_sleeping;
+        own_event_ = client ? client_event_ : server_event_;
+        peer_event_ = client ? server_event_ : client_event_;
+    }
+
+    void notify_peer() {
+        // Pairs with the fence in wait(): either the peer sees our update
+        // before sleeping or we see its flag and wake it
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (peer_sleeping_->load(std::memory_order_relaxed)) {
+            uint64_t one = 1;
+            ssize_t written = ::write(peer_event_, &one, sizeof(one));
+            (void)written;
+        }
+    }
+
+    template <typename Ready>
+    bool wait(Ready&& ready, int timeout_ms, int liveness_fd) {
+        for (int i = 0; i < SPIN_ITERATIONS; ++i) {
+            if (ready()) {
+                return true;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (true) {
+            own_sleeping_->store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ready()) {
+                own_sleeping_->store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            int poll_ms = -1;
+            if (timeout_ms >= 0) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count();
+                poll_ms = left > 0 ? static_cast<int>(left) : 0;
+            }
+
+            pollfd fds[2] = {{own_event_, POLLIN, 0}, {liveness_fd, POLLIN | POLLRDHUP, 0}};
+            int rc = ::poll(fds, liveness_fd >= 0 ? 2 : 1, poll_ms);
+            int poll_errno = errno;
+            own_sleeping_->store(0, std::memory_order_relaxed);
+
+            // Read only when signalled, so a timeout never waits on the eventfd
+            if (rc > 0 && (fds[0].revents & POLLIN)) {
+                uint64_t count;
+                ssize_t drained = ::read(own_event_, &count, sizeof(count));
+                (void)drained;
+            }
+
+            if (rc < 0 && poll_errno != EINTR) {
+                return false;
+            }
+            // Nothing is expected on the socket once the rings are in use
+            if (liveness_fd >= 0 && fds[1].revents != 0) {
+                return ready();
+            }
+            if (ready()) {
+                return true;
+            }
+            if (rc == 0 && timeout_ms >= 0) {
+                return false;
+            }
+        }
+    }
+
+    Side side_;
+    int memfd_ = -1;
+    int client_event_ = -1;
+    int server_event_ = -1;
+    void* base_ = nullptr;
+    size_t size_ = 0;
+
+    std::unique_ptr<Ring> outbound_;
+    std::unique_ptr<Ring> inbound_;
+    std::atomic<uint32_t>* own_sleeping_ = nullptr;
+    std::atomic<uint32_t>* peer_sleeping_ = nullptr;
+    int own_event_ = -1;
+    int peer_event_ = -1;
+};
+
+}
+
+#endif
@@ -0,0 +1,268 @@
+
+#include "diarkis/admission.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace diarkis {
+
+namespace {
+    int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+}
+
+bool MemoryBudget::try_acquire(size_t bytes, std::chrono::milliseconds wait) {
+    if (bytes > capacity_) {
+        return false;
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    bool admitted = released_.wait_for(lock, wait, [&] {
+        return in_use_ + bytes <= capacity_;
+    });
+    if (!admitted) {
+        return false;
+    }
+    
+    in_use_ += bytes;
+    return true;
+}
+
+void MemoryBudget::release(size_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        in_use_ -= bytes;
+    }
+    released_.notify_all();
+}
+
+size_t MemoryBudget::in_use() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_use_;
+}
+
+const char* lane_name(Lane lane) {
+    switch (lane) {
+        case Lane::INTERACTIVE: return "interactive";
+        case Lane::BULK: return "bulk";
+    }
+    return "unknown";
+}
+
+LaneScheduler::LaneScheduler(const Options& opts) : options_(opts) {
+}
+
+bool LaneScheduler::try_acquire(Lane lane, uint64_t client, size_t bytes, std::chrono::milliseconds wait) {
+    size_t index = static_cast<size_t>(lane);
+    LaneQueue& queue = queues_[index];
+    std::unique_lock<std::mutex> lock(mutex_);
+    
+    // Waiters exist only while their lane is full, so this keeps their turn
+    if (queue.waiting == 0 && has_room(lane)) {
+        ++active_[index];
+        ++total_active_;
+        return true;
+    }
+    
+    Waiter waiter;
+    waiter.cost = bytes + DRR_REQUEST_COST;
+    auto it = queue.flows.find(client);
+    if (it == queue.flows.end()) {
+        queue.ring.emplace_back();
+        queue.ring.back().client = client;
+        it = queue.flows.emplace(client, std::prev(queue.ring.end())).first;
+    }
+    it->second->waiters.push_back(&waiter);
+    ++queue.waiting;
+    
+    bool granted = waiter.cv.wait_for(lock, wait, [&] { return waiter.granted; });
+    if (!granted) {
+        remove_waiter(queue, client, &waiter);
+    }
+    return granted;
+}
+
+void LaneScheduler::release(Lane lane) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    --active_[static_cast<size_t>(lane)];
+    --total_active_;
+    grant_waiters();
+}
+
+size_t LaneScheduler::active(Lane lane) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return active_[static_cast<size_t>(lane)];
+}
+
+size_t LaneScheduler::queued(Lane lane) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queues_[static_cast<size_t>(lane)].waiting;
+}
+
+bool LaneScheduler::has_room(Lane lane) const {
+    if (total_active_ >= options_.max_active) {
+        return false;
+    }
+    return lane != Lane::BULK || active_[static_cast<size_t>(Lane::BULK)] < options_.bulk_max_active;
+}
+
+void LaneScheduler::grant_waiters() {
+    auto& interactive = queues_[static_cast<size_t>(Lane::INTERACTIVE)];
+    auto& bulk = queues_[static_cast<size_t>(Lane::BULK)];
+    
+    while (true) {
+        bool interactive_ready = interactive.waiting > 0 && has_room(Lane::INTERACTIVE);
+        bool bulk_ready = bulk.waiting > 0 && has_room(Lane::BULK);
+        if (!interactive_ready && !bulk_ready) {
+            return;
+        }
+        
+        Lane lane = Lane::INTERACTIVE;
+        if (!interactive_ready || (bulk_ready && interactive_streak_ >= options_.interactive_weight)) {
+            lane = Lane::BULK;
+        }
+        interactive_streak_ = lane == Lane::BULK ? 0 : interactive_streak_ + 1;
+        
+        size_t index = static_cast<size_t>(lane);
+        Waiter* waiter = next_waiter(queues_[index]);
+        ++active_[index];
+        ++total_active_;
+        waiter->granted = true;
+        waiter->cv.notify_one();
+    }
+}
+
+LaneScheduler::Waiter* LaneScheduler::next_waiter(LaneQueue& queue) {
+    // Skip the rounds in which no flow could be served, each of which would
+    // only add a quantum to every flow; the loop below then ends within two
+    size_t rounds = SIZE_MAX;
+    for (const Flow& flow : queue.ring) {
+        size_t cost = flow.waiters.front()->cost;
+        size_t missing = cost > flow.deficit ? cost - flow.deficit : 0;
+        rounds = std::min(rounds, (missing + DRR_QUANTUM - 1) / DRR_QUANTUM);
+    }
+    if (rounds > 1) {
+        for (Flow& flow : queue.ring) {
+            flow.deficit += (rounds - 1) * DRR_QUANTUM;
+        }
+    }
+    
+    while (true) {
+        Flow& flow = queue.ring.front();
+        Waiter* waiter = flow.waiters.front();
+        if (flow.deficit >= waiter->cost) {
+            flow.deficit -= waiter->cost;
+            flow.waiters.pop_front();
+            --queue.waiting;
+            if (flow.waiters.empty()) {
+                queue.flows.erase(flow.client);
+                queue.ring.pop_front();
+            }
+            return waiter;
+        }
+        flow.deficit += DRR_QUANTUM;
+        queue.ring.splice(queue.ring.end(), queue.ring, queue.ring.begin());
+    }
+}
+
+void LaneScheduler::remove_waiter(LaneQueue& queue, uint64_t client, Waiter* waiter) {
+    auto it = queue.flows.find(client);
+    if (it == queue.flows.end()) {
+        return;
+    }
+    auto& waiters = it->second->waiters;
+    auto pos = std::find(waiters.begin(), waiters.end(), waiter);
+    if (pos == waiters.end()) {
+        return;
+    }
+    waiters.erase(pos);
+    --queue.waiting;
+    if (waiters.empty()) {
+        queue.ring.erase(it->second);
+        queue.flows.erase(it);
+    }
+}
+
+RateLimiter::RateLimiter(const Options& opts)
+    : options_(opts),
+      ops_capacity_(std::max(1.0, opts.ops_per_sec * opts.burst_sec)),
+      bytes_capacity_(std::max(1.0, opts.bytes_per_sec * opts.burst_sec)) {
+}
+
+bool RateLimiter::acquire(const std::string& client, size_t bytes, std::chrono::milliseconds max_wait,
+                          std::chrono::microseconds& delay) {
+    int64_t now = now_us();
+    std::lock_guard<std::mutex> lock(mutex_);
+    Bucket& b = bucket(client, now);
+    
+    double wait_sec = 0.0;
+    if (options_.ops_per_sec > 0 && b.ops < 1.0) {
+        wait_sec = (1.0 - b.ops) / options_.ops_per_sec;
+    }
+    if (options_.bytes_per_sec > 0) {
+        double needed = std::min(static_cast<double>(bytes), bytes_capacity_);
+        if (b.bytes < needed) {
+            wait_sec = std::max(wait_sec, (needed - b.bytes) / options_.bytes_per_sec);
+        }
+    }
+    
+    delay = std::chrono::microseconds(static_cast<int64_t>(wait_sec * 1e6));
+    if (delay > max_wait) {
+        return false;
+    }
+    b.ops -= 1.0;
+    b.bytes -= static_cast<double>(bytes);
+    return true;
+}
+
+void RateLimiter::charge(const std::string& client, size_t bytes) {
+    if (options_.bytes_per_sec <= 0 || bytes == 0) {
+        return;
+    }
+    int64_t now = now_us();
+    std::lock_guard<std::mutex> lock(mutex_);
+    bucket(client, now).bytes -= static_cast<double>(bytes);
+}
+
+size_t RateLimiter::clients() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buckets_.size();
+}
+
+RateLimiter::Bucket& RateLimiter::bucket(const std::string& client, int64_t now_us) {
+    auto it = buckets_.find(client);
+    if (it != buckets_.end()) {
+        refill(it->second, now_us);
+        return it->second;
+    }
+    
+    if (buckets_.size() >= options_.max_clients) {
+        evict_full(now_us);
+    }
+    return buckets_.emplace(client, Bucket{ops_capacity_, bytes_capacity_, now_us}).first->second;
+}
+
+void RateLimiter::refill(Bucket& bucket, int64_t now_us) const {
+    double elapsed = static_cast<double>(now_us - bucket.updated_us) / 1e6;
+    bucket.ops = std::min(ops_capacity_, bucket.ops + elapsed * options_.ops_per_sec);
+    bucket.bytes = std::min(bytes_capacity_, bucket.bytes + elapsed * options_.bytes_per_sec);
+    bucket.updated_us = now_us;
+}
+
+// A full bucket is the same as no bucket, so dropping it loses nothing; a
+// scan runs at most once per burst period
+void RateLimiter::evict_full(int64_t now_us) {
+    if (now_us - last_eviction_us_ < static_cast<int64_t>(options_.burst_sec * 1e6)) {
+        return;
+    }
+    last_eviction_us_ = now_us;
+    for (auto it = buckets_.begin(); it != buckets_.end();) {
+        refill(it->second, now_us);
+        bool full = (options_.ops_per_sec <= 0 || it->second.ops >= ops_capacity_) &&
+                    (options_.bytes_per_sec <= 0 || it->second.bytes >= bytes_capacity_);
+        it = full ? buckets_.erase(it) : std::next(it);
+    }
+}
+
+}
@@ -0,0 +1,461 @@
+
+#include "diarkis/brpc_server.h"
+#include "diarkis/http.h"
+#include "diarkis/metrics.h"
+#include "brpc/controller.h"
+#include "brpc/closure_guard.h"
+#include "brpc/http_status_code.h"
+#include "bthread/bthread.h"
+#include "butil/endpoint.h"
+#include "gflags/gflags.h"
+#include "msgpack.hpp"
+#include "spdlog/spdlog.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace diarkis {
+
+namespace {
+    // Not among brpc's HttpStatusCode constants
+    constexpr int HTTP_STATUS_TOO_MANY_REQUESTS = 429;
+    
+    // Quoted hex "<size>-<mtime ns>", a strong validator. The inode is left
+    // out, as it changes when a snapshot is restored though the contents do not.
+    std::string etag_of(const FileStat& stat) {
+        char buf[48];
+        std::snprintf(buf, sizeof(buf), "\"%" PRIx64 "-%" PRIx64 "\"",
+                      stat.size, static_cast<uint64_t>(stat.mtime_ns));
+        return buf;
+    }
+    
+    int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+    
+    // Decodes %XX escapes; false on a malformed escape or an encoded NUL
+    bool percent_decode(std::string_view text, std::string& out) {
+        out.clear();
+        out.reserve(text.size());
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] != '%') {
+                out.push_back(text[i]);
+                continue;
+            }
+            if (i + 2 >= text.size()) {
+                return false;
+            }
+            int high = hex_value(text[i + 1]);
+            int low = hex_value(text[i + 2]);
+            if (high < 0 || low < 0 || (high == 0 && low == 0)) {
+                return false;
+            }
+            out.push_back(static_cast<char>(high * 16 + low));
+            i += 2;
+        }
+        return true;
+    }
+    
+    int http_status_of(const Error& error) {
+        switch (error.code()) {
+            case ErrorCode::FileNotFound:
+            case ErrorCode::DirectoryNotFound:
+            case ErrorCode::NotDirectory:
+                return brpc::HTTP_STATUS_NOT_FOUND;
+            case ErrorCode::InvalidPath:
+                return brpc::HTTP_STATUS_BAD_REQUEST;
+            case ErrorCode::Busy:
+                return brpc::HTTP_STATUS_SERVICE_UNAVAILABLE;
+            default:
+                return brpc::HTTP_STATUS_INTERNAL_SERVER_ERROR;
+        }
+    }
+}
+
+commands::Status BrpcAdmission::admit(brpc::Controller* cntl, bool carries_payload, size_t bytes,
+                                      Ticket& ticket) const {
+    auto no_wait = std::chrono::milliseconds(0);
+    ticket.client = butil::ip2str(cntl->remote_side().ip).c_str();
+    
+    if (rate_limiter && rate_limiter->enabled()) {
+        std::chrono::microseconds delay{0};
+        if (!rate_limiter->acquire(ticket.client, bytes, std::chrono::milliseconds(wait_ms), delay)) {
+            return commands::Status::THROTTLED;
+        }
+        if (delay.count() > 0) {
+            bthread_usleep(static_cast<uint64_t>(delay.count()));
+        }
+    }
+    if (budget) {
+        ticket.lease = BudgetLease(*budget, bytes, no_wait);
+        if (!ticket.lease) {
+            return commands::Status::BUSY;
+        }
+    }
+    if (lanes) {
+        Lane lane = carries_payload && bytes >= bulk_threshold ? Lane::BULK : Lane::INTERACTIVE;
+        ticket.slot.emplace(*lanes, lane, std::hash<std::string>()(ticket.client), bytes, no_wait);
+        if (!*ticket.slot) {
+            return commands::Status::BUSY;
+        }
+    }
+    return commands::Status::OK;
+}
+
+void BrpcAdmission::charge(const Ticket& ticket, size_t bytes) const {
+    if (rate_limiter && rate_limiter->enabled() && bytes > 0) {
+        rate_limiter->charge(ticket.client, bytes);
+    }
+}
+
+FileServiceImpl::FileServiceImpl(std::shared_ptr<StateMachine> state_machine, size_t max_request_bytes,
+                                 const BrpcAdmission& admission)
+    : state_machine_(std::move(state_machine)), max_request_bytes_(max_request_bytes),
+      admission_(admission) {}
+
+void FileServiceImpl::CreateFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                 proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::CREATE_FILE, cntl, request, response, done);
+}
+
+void FileServiceImpl::WriteFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::WRITE_FILE, cntl, request, response, done);
+}
+
+void FileServiceImpl::AppendFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                 proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::APPEND_FILE, cntl, request, response, done);
+}
+
+void FileServiceImpl::ReadFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                               proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::READ_FILE, cntl, request, response, done);
+}
+
+void FileServiceImpl::DeleteFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                 proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::DELETE_FILE, cntl, request, response, done);
+}
+
+void FileServiceImpl::CreateDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::CREATE_DIR, cntl, request, response, done);
+}
+
+void FileServiceImpl::ListDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                              proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::LIST_DIR, cntl, request, response, done);
+}
+
+void FileServiceImpl::DeleteDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::DELETE_DIR, cntl, request, response, done);
+}
+
+void FileServiceImpl::Rename(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                             proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::RENAME, cntl, request, response, done);
+}
+
+void FileServiceImpl::Copy(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                           proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::COPY, cntl, request, response, done);
+}
+
+void FileServiceImpl::Truncate(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                               proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::TRUNCATE, cntl, request, response, done);
+}
+
+void FileServiceImpl::PunchHole(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                                proto::FileResponse* response, google::protobuf::Closure* done) {
+    serve(commands::Type::PUNCH_HOLE, cntl, request, response, done);
+}
+
+// Traces and slow log timings are not attached here: they live in thread
+// locals, which do not follow a bthread that resumes on another worker
+void FileServiceImpl::serve(commands::Type type, google::protobuf::RpcController* controller,
+                            const proto::FileRequest* request, proto::FileResponse* response,
+                            google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    auto* cntl = static_cast<brpc::Controller*>(controller);
+    metrics::Stopwatch total_watch;
+    
+    const butil::IOBuf& attachment = cntl->request_attachment();
+    size_t size = attachment.size();
+    metrics::record_request(type, size);
+    if (size > max_request_bytes_) {
+        response->set_success(false);
+        response->set_status(proto::STATUS_ERROR);
+        response->set_error("Request too large");
+        return;
+    }
+    
+    BrpcAdmission::Ticket ticket;
+    commands::Status admitted = admission_.admit(cntl, commands::is_write(type), size, ticket);
+    if (admitted != commands::Status::OK) {
+        response->set_success(false);
+        response->set_status(static_cast<proto::Status>(admitted));
+        response->set_error(Error(admitted == commands::Status::THROTTLED ? ErrorCode::Throttled
+                                                                          : ErrorCode::Busy).to_string());
+        return;
+    }
+    
+    commands::CommandView cmd;
+    cmd.type = type;
+    cmd.path = request->path();
+    cmd.new_path = request->new_path();
+    cmd.trace_id = request->trace_id();
+    
+    // Extents come from the message, packed as the TCP protocol carries them;
+    // a payload in one block is used in place, a fragmented one is joined
+    msgpack::sbuffer extent;
+    std::vector<uint8_t> joined;
+    if (type == commands::Type::TRUNCATE || type == commands::Type::PUNCH_HOLE) {
+        commands::Extent range;
+        range.offset = request->offset();
+        range.length = request->length();
+        msgpack::pack(extent, range);
+        cmd.contents = reinterpret_cast<const uint8_t*>(extent.data());
+        cmd.contents_size = extent.size();
+    } else if (size > 0 && commands::is_write(type)) {
+        if (attachment.backing_block_num() == 1) {
+            cmd.contents = reinterpret_cast<const uint8_t*>(attachment.backing_block(0).data());
+        } else {
+            joined.resize(size);
+            attachment.copy_to(joined.data(), size);
+            cmd.contents = joined.data();
+        }
+        cmd.contents_size = size;
+    }
+    
+    SPDLOG_DEBUG("brpc command: type={}, path={}", static_cast<int>(type), cmd.path);
+    
+    commands::Response resp = commands::is_write(type)
+        ? state_machine_->apply_write_command(cmd)
+        : state_machine_->apply_read_command(cmd);
+    metrics::record_response(type, resp.success, resp.data.size());
+    admission_.charge(ticket, resp.data.size());
+    
+    response->set_success(resp.success);
+    if (!resp.error.empty()) {
+        response->set_error(resp.error);
+    }
+    response->set_status(static_cast<proto::Status>(resp.status));
+    for (auto& entry : resp.entries) {
+        response->add_entries(std::move(entry));
+    }
+    if (!resp.data.empty()) {
+        cntl->response_attachment().append(resp.data.data(), resp.data.size());
+    }
+    metrics::record_latency(type, metrics::Stage::Total, total_watch.elapsed_us());
+}
+
+FileGatewayImpl::FileGatewayImpl(std::shared_ptr<StateMachine> state_machine, const BrpcAdmission& admission,
+                                 size_t max_range_bytes)
+    : state_machine_(std::move(state_machine)), admission_(admission), max_range_bytes_(max_range_bytes) {}
+
+void FileGatewayImpl::Get(google::protobuf::RpcController* controller, const proto::HttpRequest*,
+                          proto::HttpResponse*, google::protobuf::Closure* done) {
+    brpc::ClosureGuard done_guard(done);
+    auto* cntl = static_cast<brpc::Controller*>(controller);
+    const brpc::HttpHeader& request = cntl->http_request();
+    brpc::HttpHeader& response = cntl->http_response();
+    metrics::Stopwatch total_watch;
+    
+    if (request.method() != brpc::HTTP_METHOD_GET) {
+        response.set_status_code(brpc::HTTP_STATUS_METHOD_NOT_ALLOWED);
+        response.SetHeader("Allow", "GET");
+        return;
+    }
+    
+    std::string path;
+    if (!percent_decode(request.unresolved_path(), path)) {
+        response.set_status_code(brpc::HTTP_STATUS_BAD_REQUEST);
+        cntl->response_attachment().append("Malformed path\n");
+        return;
+    }
+    metrics::record_request(commands::Type::READ_FILE, 0);
+    
+    // The body's size is charged to the rate limits once it is known
+    BrpcAdmission::Ticket ticket;
+    commands::Status admitted = admission_.admit(cntl, false, 0, ticket);
+    if (admitted == commands::Status::THROTTLED) {
+        response.set_status_code(HTTP_STATUS_TOO_MANY_REQUESTS);
+        response.SetHeader("Retry-After", "1");
+        cntl->response_attachment().append("Rate limit exceeded\n");
+        return;
+    }
+    if (admitted != commands::Status::OK) {
+        response.set_status_code(brpc::HTTP_STATUS_SERVICE_UNAVAILABLE);
+        response.SetHeader("Retry-After", "1");
+        cntl->response_attachment().append("Server busy\n");
+        return;
+    }
+    
+    const std::string* if_none_match = request.GetHeader("If-None-Match");
+    const std::string* range_header = request.GetHeader("Range");
+    const std::string* if_range = request.GetHeader("If-Range");
+    
+    size_t body_bytes = 0;
+    auto result = state_machine_->storage().read_open(path, [&](int fd, const FileStat& stat) -> Result<void> {
+        std::string etag = etag_of(stat);
+        response.SetHeader("ETag", etag);
+        response.SetHeader("Accept-Ranges", "bytes");
+        response.SetHeader("Cache-Control", "no-cache");
+        
+        if (if_none_match && http::etag_matches(*if_none_match, etag)) {
+            response.set_status_code(brpc::HTTP_STATUS_NOT_MODIFIED);
+            return Result<void>();
+        }
+        
+        // A stale If-Range asks for the whole file instead of the range
+        uint64_t offset = 0;
+        uint64_t length = stat.size;
+        http::Range range = http::Range::NONE;
+        if (range_header && (!if_range || http::trim(*if_range) == etag)) {
+            range = http::parse_range(*range_header, stat.size, offset, length);
+        }
+        if (range == http::Range::UNSATISFIABLE) {
+            response.set_status_code(brpc::HTTP_STATUS_REQUESTED_RANGE_NOT_SATISFIABLE);
+            response.SetHeader("Content-Range", "bytes */" + std::to_string(stat.size));
+            return Result<void>();
+        }
+        // Larger bodies are cut to the first max_range_bytes and sent as a
+        // partial response, from which clients continue with further ranges.
+        // Only a client that sent Range expects 206; others are refused.
+        if (length > max_range_bytes_) {
+            if (!range_header) {
+                response.set_status_code(brpc::HTTP_STATUS_REQUEST_ENTITY_TOO_LARGE);
+                cntl->response_attachment().append(
+                    "File exceeds " + std::to_string(max_range_bytes_) + " bytes, request it in ranges\n");
+                return Result<void>();
+            }
+            length = max_range_bytes_;
+            range = http::Range::SATISFIABLE;
+        }
+        if (admission_.budget) {
+            ticket.lease = BudgetLease(*admission_.budget, length, std::chrono::milliseconds(0));
+            if (!ticket.lease) {
+                return Error(ErrorCode::Busy);
+            }
+        }
+        if (range == http::Range::SATISFIABLE) {
+            response.set_status_code(brpc::HTTP_STATUS_PARTIAL_CONTENT);
+            response.SetHeader("Content-Range", "bytes " + std::to_string(offset) + "-" +
+                               std::to_string(offset + length - 1) + "/" + std::to_string(stat.size));
+        } else {
+            response.set_status_code(brpc::HTTP_STATUS_OK);
+        }
+        response.set_content_type("application/octet-stream");
+        
+        // pread straight into IOBuf blocks, which brpc writes out as they are
+        butil::IOPortal body;
+        while (body.size() < length) {
+            ssize_t n = body.pappend_from_file_descriptor(
+                fd, static_cast<off_t>(offset + body.size()), length - body.size());
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return Error::from_errno(errno);
+            }
+            if (n == 0) {
+                return Error(ErrorCode::IoError, "File shorter than its size");
+            }
+        }
+        body_bytes = body.size();
+        cntl->response_attachment().swap(body);
+        return Result<void>();
+    });
+    
+    if (!result.ok()) {
+        response.set_status_code(http_status_of(result.error()));
+        response.RemoveHeader("ETag");
+        if (result.error().code() == ErrorCode::Busy) {
+            response.SetHeader("Retry-After", "1");
+        }
+        cntl->response_attachment().clear();
+        cntl->response_attachment().append(result.error().to_string() + "\n");
+    }
+    admission_.charge(ticket, body_bytes);
+    metrics::record_response(commands::Type::READ_FILE, result.ok(), body_bytes);
+    metrics::record_latency(commands::Type::READ_FILE, metrics::Stage::Total, total_watch.elapsed_us());
+}
+
+BrpcServer::BrpcServer(const std::string& address, uint16_t port,
+                       std::shared_ptr<StateMachine> state_machine, const Options& options)
+    : address_(address), port_(port), options_(options),
+      file_service_(state_machine, options.max_request_bytes, options.admission),
+      file_gateway_(std::move(state_machine), options.admission, options.http_max_range_bytes) {}
+
+BrpcServer::~BrpcServer() {
+    stop();
+}
+
+bool BrpcServer::start() {
+    // brpc rejects bodies above its max_body_size flag, 64MB by default
+    std::string max_body;
+    if (gflags::GetCommandLineOption("max_body_size", &max_body) &&
+        std::stoull(max_body) < options_.max_request_bytes + 64 * 1024) {
+        gflags::SetCommandLineOption("max_body_size",
+                                     std::to_string(options_.max_request_bytes + 64 * 1024).c_str());
+    }
+    
+    butil::EndPoint endpoint;
+    if (butil::str2endpoint(address_.c_str(), port_, &endpoint) != 0) {
+        spdlog::error("Invalid brpc address {}:{}", address_, port_);
+        return false;
+    }
+    
+    server_ = std::make_unique<brpc::Server>();
+    if (server_->AddService(&file_service_, brpc::SERVER_DOESNT_OWN_SERVICE) != 0) {
+        spdlog::error("Failed to add file service to brpc server");
+        server_.reset();
+        return false;
+    }
+    if (options_.http_gateway &&
+        server_->AddService(&file_gateway_, brpc::SERVER_DOESNT_OWN_SERVICE, "/files/* => Get") != 0) {
+        spdlog::error("Failed to add HTTP file gateway to brpc server");
+        server_.reset();
+        return false;
+    }
+    
+    brpc::ServerOptions opts;
+    if (options_.num_threads > 0) {
+        opts.num_threads = options_.num_threads;
+    }
+    // 0 caps requests at one per bthread worker
+    opts.max_concurrency = options_.max_concurrency;
+    if (opts.max_concurrency == 0) {
+        opts.max_concurrency = options_.num_threads > 0 ? options_.num_threads : bthread_getconcurrency();
+    }
+    if (server_->Start(endpoint, &opts) != 0) {
+        spdlog::error("Failed to start brpc server on {}:{}", address_, port_);
+        server_.reset();
+        return false;
+    }
+    
+    spdlog::info("brpc file service listening on {}:{}", address_, port_);
+    return true;
+}
+
+void BrpcServer::stop() {
+    if (server_) {
+        server_->Stop(0);
+        server_->Join();
+        server_.reset();
+    }
+}
+
+bool BrpcServer::is_running() const {
+    return server_ && server_->IsRunning();
+}
+
+}
@@ -1,5 +1,6 @@
 
 #include "diarkis/config.h"
+#include "diarkis/compression.h"
 #include "spdlog/spdlog.h"
 #include "yaml-cpp/yaml.h"
 #include "gflags/gflags.h"
@@ -11,11 +12,49 @@ DEFINE_string(peer_addr, "", "Raft peer address (IP:PORT)");
 DEFINE_string(initial_conf, "", "Raft initial configuration (comma-separated peers)");
 DEFINE_int32(election_timeout, 0, "Raft election timeout in milliseconds");
 DEFINE_int32(snapshot_interval, 0, "Raft snapshot interval in seconds");
+DEFINE_int32(raft_max_pending_tasks, 0, "Raft writes in flight before new writes are rejected as overloaded");
+DEFINE_int32(raft_max_pending_mb, 0, "Raft write bytes in flight before new writes are rejected as overloaded");
 DEFINE_string(rpc_addr, "", "RPC bind address");
 DEFINE_int32(rpc_port, 0, "RPC bind port");
+DEFINE_int32(rpc_max_inflight_mb, 0, "Memory budget for in-flight requests in MB");
+DEFINE_int32(rpc_max_request_mb, 0, "Largest accepted request in MB");
+DEFINE_int32(rpc_admission_wait_ms, -1, "Time a request may wait for memory budget before it is rejected as busy");
+DEFINE_int32(rpc_max_batch_commands, 0, "Most commands accepted in one BATCH request");
+DEFINE_int32(rpc_batch_read_threads, 0, "Threads serving BATCH reads, shared by all connections");
+DEFINE_int32(rpc_idle_timeout_s, -1, "Close RPC connections that send nothing for this many seconds (0 uses the socket receive timeout)");
+DEFINE_int32(rpc_listeners, -1, "TCP listener sockets sharing the RPC port with SO_REUSEPORT (0 for one per CPU)");
+DEFINE_string(rpc_unix_path, "", "Also listen on this Unix domain socket path");
+DEFINE_string(rpc_unix_socket_mode, "", "Octal permissions of the Unix domain socket file");
+DEFINE_int32(brpc_port, 0, "Serve the file operations as a brpc service on this port");
+DEFINE_int32(brpc_max_concurrency, -1, "Requests the brpc file service executes at once (0 for one per bthread worker)");
+DEFINE_int32(brpc_http_max_range_mb, 0, "Largest body in MB one HTTP gateway response carries");
+DEFINE_string(compression_raft, "", "Raft log payload compression (none, lz4, zstd)");
+DEFINE_int32(compression_threshold, -1, "Payloads smaller than this many bytes are not compressed");
+DEFINE_int32(lanes_max_active, 0, "Requests executing at once across all priority lanes");
+DEFINE_int32(lanes_bulk_max_active, 0, "Requests with large payloads executing at once");
+DEFINE_double(rate_limit_ops_per_sec, -1.0, "Requests per second allowed per client (0 disables)");
+DEFINE_double(rate_limit_mb_per_sec, -1.0, "Payload MB per second allowed per client (0 disables)");
+DEFINE_double(trace_sample_rate, -1.0, "Fraction of requests traced (0-1)");
+DEFINE_int32(trace_slow_threshold_ms, -1, "Traces slower than this are kept for /vars/diarkis_slow_traces");
+DEFINE_int32(slow_log_threshold_ms, -1, "Operations slower than this are written to the slow op log (0 disables)");
+DEFINE_string(slow_log_path, "", "Slow op log file path (default <raft_path>/slow_ops.log)");
 
 namespace diarkis {
 
+int ServerConfig::unix_socket_mode() const {
+    if (rpc_unix_socket_mode.empty() || rpc_unix_socket_mode.size() > 4) {
+        return -1;
+    }
+    int mode = 0;
+    for (char c : rpc_unix_socket_mode) {
+        if (c < '0' || c > '7') {
+            return -1;
+        }
+        mode = mode * 8 + (c - '0');
+    }
+    return mode <= 0777 ? mode : -1;
+}
+
 Result<void> ServerConfig::validate() const {
     if (base_path.empty()) {
         return Error(ErrorCode::InvalidCommand, "base_path cannot be empty");
@@ -38,12 +77,104 @@ Result<void> ServerConfig::validate() const {
     if (snapshot_interval_s < 0) {
         return Error(ErrorCode::InvalidCommand, "snapshot_interval_s cannot be negative");
     }
+    if (raft_max_pending_tasks <= 0) {
+        return Error(ErrorCode::InvalidCommand, "raft_max_pending_tasks must be positive");
+    }
+    if (raft_max_pending_mb <= 0) {
+        return Error(ErrorCode::InvalidCommand, "raft_max_pending_mb must be positive");
+    }
     if (rpc_addr.empty()) {
         return Error(ErrorCode::InvalidCommand, "rpc_addr cannot be empty");
     }
     if (rpc_port == 0) {
         return Error(ErrorCode::InvalidCommand, "rpc_port must be specified");
     }
+    if (rpc_max_inflight_mb <= 0) {
+        return Error(ErrorCode::InvalidCommand, "rpc_max_inflight_mb must be positive");
+    }
+    if (rpc_max_request_mb <= 0 || rpc_max_request_mb > 100) {
+        return Error(ErrorCode::InvalidCommand, "rpc_max_request_mb must be between 1 and 100");
+    }
+    if (rpc_max_request_mb > rpc_max_inflight_mb) {
+        return Error(ErrorCode::InvalidCommand, "rpc_max_request_mb cannot exceed rpc_max_inflight_mb");
+    }
+    if (rpc_admission_wait_ms < 0) {
+        return Error(ErrorCode::InvalidCommand, "rpc_admission_wait_ms cannot be negative");
+    }
+    if (rpc_max_batch_commands <= 0) {
+        return Error(ErrorCode::InvalidCommand, "rpc_max_batch_commands must be positive");
+    }
+    if (rpc_batch_read_threads <= 0 || rpc_batch_read_threads > 64) {
+        return Error(ErrorCode::InvalidCommand, "rpc_batch_read_threads must be between 1 and 64");
+    }
+    if (rpc_idle_timeout_s < 0) {
+        return Error(ErrorCode::InvalidCommand, "rpc_idle_timeout_s cannot be negative");
+    }
+    if (rpc_listeners < 0 || rpc_listeners > 1024) {
+        return Error(ErrorCode::InvalidCommand, "rpc_listeners must be between 0 and 1024");
+    }
+    if (rpc_unix_path.size() >= 108) {
+        return Error(ErrorCode::InvalidCommand, "rpc_unix_path must be shorter than 108 bytes");
+    }
+    if (unix_socket_mode() < 0) {
+        return Error(ErrorCode::InvalidCommand, "rpc_unix_socket_mode must be an octal mode up to 0777");
+    }
+    if (brpc_port != 0 && brpc_port == rpc_port) {
+        return Error(ErrorCode::InvalidCommand, "brpc_port must differ from rpc_port");
+    }
+    if (brpc_num_threads < 0 || brpc_max_concurrency < 0) {
+        return Error(ErrorCode::InvalidCommand, "brpc_num_threads and brpc_max_concurrency cannot be negative");
+    }
+    if (brpc_http_max_range_mb <= 0) {
+        return Error(ErrorCode::InvalidCommand, "brpc_http_max_range_mb must be positive");
+    }
+    commands::compression::Algorithm algorithm;
+    if (!commands::compression::parse(compression_raft, algorithm)) {
+        return Error(ErrorCode::InvalidCommand, "compression_raft must be none, lz4 or zstd");
+    }
+    // MessagePack entries have nowhere to record the algorithm
+    if (algorithm != commands::compression::Algorithm::NONE && !raft_compact_log) {
+        return Error(ErrorCode::InvalidCommand, "compression_raft requires raft_compact_log");
+    }
+    if (compression_threshold_bytes < 0) {
+        return Error(ErrorCode::InvalidCommand, "compression_threshold_bytes cannot be negative");
+    }
+    if (lanes_max_active <= 0) {
+        return Error(ErrorCode::InvalidCommand, "lanes_max_active must be positive");
+    }
+    if (lanes_bulk_max_active <= 0 || lanes_bulk_max_active > lanes_max_active) {
+        return Error(ErrorCode::InvalidCommand, "lanes_bulk_max_active must be between 1 and lanes_max_active");
+    }
+    if (lanes_bulk_threshold_kb <= 0) {
+        return Error(ErrorCode::InvalidCommand, "lanes_bulk_threshold_kb must be positive");
+    }
+    if (lanes_interactive_weight <= 0) {
+        return Error(ErrorCode::InvalidCommand, "lanes_interactive_weight must be positive");
+    }
+    if (rate_limit_ops_per_sec < 0 || rate_limit_mb_per_sec < 0) {
+        return Error(ErrorCode::InvalidCommand, "rate limits cannot be negative");
+    }
+    if (rate_limit_burst_ms <= 0) {
+        return Error(ErrorCode::InvalidCommand, "rate_limit_burst_ms must be positive");
+    }
+    if (rate_limit_per != "client" && rate_limit_per != "connection") {
+        return Error(ErrorCode::InvalidCommand, "rate_limit_per must be client or connection");
+    }
+    if (trace_sample_rate < 0.0 || trace_sample_rate > 1.0) {
+        return Error(ErrorCode::InvalidCommand, "trace_sample_rate must be between 0 and 1");
+    }
+    if (trace_slow_threshold_ms < 0) {
+        return Error(ErrorCode::InvalidCommand, "trace_slow_threshold_ms cannot be negative");
+    }
+    if (trace_ring_size < 0) {
+        return Error(ErrorCode::InvalidCommand, "trace_ring_size cannot be negative");
+    }
+    if (slow_log_threshold_ms < 0) {
+        return Error(ErrorCode::InvalidCommand, "slow_log_threshold_ms cannot be negative");
+    }
+    if (slow_log_queue_size <= 0) {
+        return Error(ErrorCode::InvalidCommand, "slow_log_queue_size must be positive");
+    }
     return Result<void>();
 }
 
@@ -90,6 +221,15 @@ Result<ServerConfig> ConfigLoader::parse_yaml(const std::string& config_path) {
             if (raft["snapshot_interval"]) {
                 config.snapshot_interval_s = raft["snapshot_interval"].as<int>();
             }
+            if (raft["max_pending_tasks"]) {
+                config.raft_max_pending_tasks = raft["max_pending_tasks"].as<int>();
+            }
+            if (raft["max_pending_mb"]) {
+                config.raft_max_pending_mb = raft["max_pending_mb"].as<int>();
+            }
+            if (raft["compact_log"]) {
+                config.raft_compact_log = raft["compact_log"].as<bool>();
+            }
         }
         
         // Parse RPC section
@@ -101,6 +241,135 @@ Result<ServerConfig> ConfigLoader::parse_yaml(const std::string& config_path) {
             if (rpc["port"]) {
                 config.rpc_port = rpc["port"].as<uint16_t>();
             }
+            if (rpc["max_inflight_mb"]) {
+                config.rpc_max_inflight_mb = rpc["max_inflight_mb"].as<int>();
+            }
+            if (rpc["max_request_mb"]) {
+                config.rpc_max_request_mb = rpc["max_request_mb"].as<int>();
+            }
+            if (rpc["admission_wait_ms"]) {
+                config.rpc_admission_wait_ms = rpc["admission_wait_ms"].as<int>();
+            }
+            if (rpc["max_batch_commands"]) {
+                config.rpc_max_batch_commands = rpc["max_batch_commands"].as<int>();
+            }
+            if (rpc["batch_read_threads"]) {
+                config.rpc_batch_read_threads = rpc["batch_read_threads"].as<int>();
+            }
+            if (rpc["idle_timeout_s"]) {
+                config.rpc_idle_timeout_s = rpc["idle_timeout_s"].as<int>();
+            }
+            if (rpc["listeners"]) {
+                config.rpc_listeners = rpc["listeners"].as<int>();
+            }
+            if (rpc["pin_listeners"]) {
+                config.rpc_pin_listeners = rpc["pin_listeners"].as<bool>();
+            }
+            if (rpc["unix_path"]) {
+                config.rpc_unix_path = rpc["unix_path"].as<std::string>();
+            }
+            if (rpc["unix_socket_mode"]) {
+                config.rpc_unix_socket_mode = rpc["unix_socket_mode"].as<std::string>();
+            }
+            if (rpc["shared_memory"]) {
+                config.rpc_shared_memory = rpc["shared_memory"].as<bool>();
+            }
+        }
+        
+        // Parse brpc section
+        if (yaml["brpc"]) {
+            const auto& brpc = yaml["brpc"];
+            if (brpc["port"]) {
+                config.brpc_port = brpc["port"].as<uint16_t>();
+            }
+            if (brpc["num_threads"]) {
+                config.brpc_num_threads = brpc["num_threads"].as<int>();
+            }
+            if (brpc["max_concurrency"]) {
+                config.brpc_max_concurrency = brpc["max_concurrency"].as<int>();
+            }
+            if (brpc["http_gateway"]) {
+                config.brpc_http_gateway = brpc["http_gateway"].as<bool>();
+            }
+            if (brpc["http_max_range_mb"]) {
+                config.brpc_http_max_range_mb = brpc["http_max_range_mb"].as<int>();
+            }
+        }
+        
+        // Parse compression section
+        if (yaml["compression"]) {
+            const auto& compression = yaml["compression"];
+            if (compression["wire"]) {
+                config.compression_wire = compression["wire"].as<bool>();
+            }
+            if (compression["raft"]) {
+                config.compression_raft = compression["raft"].as<std::string>();
+            }
+            if (compression["threshold_bytes"]) {
+                config.compression_threshold_bytes = compression["threshold_bytes"].as<int>();
+            }
+        }
+        
+        // Parse lanes section
+        if (yaml["lanes"]) {
+            const auto& lanes = yaml["lanes"];
+            if (lanes["max_active"]) {
+                config.lanes_max_active = lanes["max_active"].as<int>();
+            }
+            if (lanes["bulk_max_active"]) {
+                config.lanes_bulk_max_active = lanes["bulk_max_active"].as<int>();
+            }
+            if (lanes["bulk_threshold_kb"]) {
+                config.lanes_bulk_threshold_kb = lanes["bulk_threshold_kb"].as<int>();
+            }
+            if (lanes["interactive_weight"]) {
+                config.lanes_interactive_weight = lanes["interactive_weight"].as<int>();
+            }
+        }
+        
+        // Parse rate_limit section
+        if (yaml["rate_limit"]) {
+            const auto& rate_limit = yaml["rate_limit"];
+            if (rate_limit["ops_per_sec"]) {
+                config.rate_limit_ops_per_sec = rate_limit["ops_per_sec"].as<double>();
+            }
+            if (rate_limit["mb_per_sec"]) {
+                config.rate_limit_mb_per_sec = rate_limit["mb_per_sec"].as<double>();
+            }
+            if (rate_limit["burst_ms"]) {
+                config.rate_limit_burst_ms = rate_limit["burst_ms"].as<int>();
+            }
+            if (rate_limit["per"]) {
+                config.rate_limit_per = rate_limit["per"].as<std::string>();
+            }
+        }
+        
+        // Parse trace section
+        if (yaml["trace"]) {
+            const auto& trace = yaml["trace"];
+            if (trace["sample_rate"]) {
+                config.trace_sample_rate = trace["sample_rate"].as<double>();
+            }
+            if (trace["slow_threshold_ms"]) {
+                config.trace_slow_threshold_ms = trace["slow_threshold_ms"].as<int>();
+            }
+            if (trace["ring_size"]) {
+                config.trace_ring_size = trace["ring_size"].as<int>();
+            }
+        }
+        
+        // Parse slow op log section
+        if (yaml["slow_log"]) {
+            const auto& slow_log = yaml["slow_log"];
+            if (slow_log["threshold_ms"]) {
+                config.slow_log_threshold_ms = slow_log["threshold_ms"].as<int>();
+            }
+            if (slow_log["path"]) {
+                config.slow_log_path = slow_log["path"].as<std::string>();
+            }
+            if (slow_log["queue_size"]) {
+                config.slow_log_queue_size = slow_log["queue_size"].as<int>();
+            }
         }
         
         spdlog::info("Loaded configuration from {}", config_path);
@@ -116,39 +385,135 @@ Result<ServerConfig> ConfigLoader::parse_yaml(const std::string& config_path) {
 void ConfigLoader::apply_command_line_flags(ServerConfig& config) {
     if (!FLAGS_base_path.empty()) {
         config.base_path = FLAGS_base_path;
-        spdlog::debug("Override base_path: {}", config.base_path);
+        SPDLOG_DEBUG("Override base_path: {}", config.base_path);
     }
     if (!FLAGS_raft_path.empty()) {
         config.raft_path = FLAGS_raft_path;
-        spdlog::debug("Override raft_path: {}", config.raft_path);
+        SPDLOG_DEBUG("Override raft_path: {}", config.raft_path);
     }
     if (!FLAGS_group_id.empty()) {
         config.group_id = FLAGS_group_id;
-        spdlog::debug("Override group_id: {}", config.group_id);
+        SPDLOG_DEBUG("Override group_id: {}", config.group_id);
     }
     if (!FLAGS_peer_addr.empty()) {
         config.peer_addr = FLAGS_peer_addr;
-        spdlog::debug("Override peer_addr: {}", config.peer_addr);
+        SPDLOG_DEBUG("Override peer_addr: {}", config.peer_addr);
     }
     if (!FLAGS_initial_conf.empty()) {
         config.initial_conf = FLAGS_initial_conf;
-        spdlog::debug("Override initial_conf: {}", config.initial_conf);
+        SPDLOG_DEBUG("Override initial_conf: {}", config.initial_conf);
     }
     if (FLAGS_election_timeout > 0) {
         config.election_timeout_ms = FLAGS_election_timeout;
-        spdlog::debug("Override election_timeout_ms: {}", config.election_timeout_ms);
+        SPDLOG_DEBUG("Override election_timeout_ms: {}", config.election_timeout_ms);
     }
     if (FLAGS_snapshot_interval > 0) {
         config.snapshot_interval_s = FLAGS_snapshot_interval;
-        spdlog::debug("Override snapshot_interval_s: {}", config.snapshot_interval_s);
+        SPDLOG_DEBUG("Override snapshot_interval_s: {}", config.snapshot_interval_s);
+    }
+    if (FLAGS_raft_max_pending_tasks > 0) {
+        config.raft_max_pending_tasks = FLAGS_raft_max_pending_tasks;
+        SPDLOG_DEBUG("Override raft_max_pending_tasks: {}", config.raft_max_pending_tasks);
+    }
+    if (FLAGS_raft_max_pending_mb > 0) {
+        config.raft_max_pending_mb = FLAGS_raft_max_pending_mb;
+        SPDLOG_DEBUG("Override raft_max_pending_mb: {}", config.raft_max_pending_mb);
     }
     if (!FLAGS_rpc_addr.empty()) {
         config.rpc_addr = FLAGS_rpc_addr;
-        spdlog::debug("Override rpc_addr: {}", config.rpc_addr);
+        SPDLOG_DEBUG("Override rpc_addr: {}", config.rpc_addr);
     }
     if (FLAGS_rpc_port > 0) {
         config.rpc_port = static_cast<uint16_t>(FLAGS_rpc_port);
-        spdlog::debug("Override rpc_port: {}", config.rpc_port);
+        SPDLOG_DEBUG("Override rpc_port: {}", config.rpc_port);
+    }
+    if (FLAGS_rpc_max_inflight_mb > 0) {
+        config.rpc_max_inflight_mb = FLAGS_rpc_max_inflight_mb;
+        SPDLOG_DEBUG("Override rpc_max_inflight_mb: {}", config.rpc_max_inflight_mb);
+    }
+    if (FLAGS_rpc_max_request_mb > 0) {
+        config.rpc_max_request_mb = FLAGS_rpc_max_request_mb;
+        SPDLOG_DEBUG("Override rpc_max_request_mb: {}", config.rpc_max_request_mb);
+    }
+    if (FLAGS_rpc_admission_wait_ms >= 0) {
+        config.rpc_admission_wait_ms = FLAGS_rpc_admission_wait_ms;
+        SPDLOG_DEBUG("Override rpc_admission_wait_ms: {}", config.rpc_admission_wait_ms);
+    }
+    if (FLAGS_rpc_max_batch_commands > 0) {
+        config.rpc_max_batch_commands = FLAGS_rpc_max_batch_commands;
+        SPDLOG_DEBUG("Override rpc_max_batch_commands: {}", config.rpc_max_batch_commands);
+    }
+    if (FLAGS_rpc_batch_read_threads > 0) {
+        config.rpc_batch_read_threads = FLAGS_rpc_batch_read_threads;
+        SPDLOG_DEBUG("Override rpc_batch_read_threads: {}", config.rpc_batch_read_threads);
+    }
+    if (FLAGS_rpc_idle_timeout_s >= 0) {
+        config.rpc_idle_timeout_s = FLAGS_rpc_idle_timeout_s;
+        SPDLOG_DEBUG("Override rpc_idle_timeout_s: {}", config.rpc_idle_timeout_s);
+    }
+    if (FLAGS_rpc_listeners >= 0) {
+        config.rpc_listeners = FLAGS_rpc_listeners;
+        SPDLOG_DEBUG("Override rpc_listeners: {}", config.rpc_listeners);
+    }
+    if (!FLAGS_rpc_unix_path.empty()) {
+        config.rpc_unix_path = FLAGS_rpc_unix_path;
+        SPDLOG_DEBUG("Override rpc_unix_path: {}", config.rpc_unix_path);
+    }
+    if (!FLAGS_rpc_unix_socket_mode.empty()) {
+        config.rpc_unix_socket_mode = FLAGS_rpc_unix_socket_mode;
+        SPDLOG_DEBUG("Override rpc_unix_socket_mode: {}", config.rpc_unix_socket_mode);
+    }
+    if (FLAGS_brpc_port > 0) {
+        config.brpc_port = static_cast<uint16_t>(FLAGS_brpc_port);
+        SPDLOG_DEBUG("Override brpc_port: {}", config.brpc_port);
+    }
+    if (FLAGS_brpc_max_concurrency >= 0) {
+        config.brpc_max_concurrency = FLAGS_brpc_max_concurrency;
+        SPDLOG_DEBUG("Override brpc_max_concurrency: {}", config.brpc_max_concurrency);
+    }
+    if (FLAGS_brpc_http_max_range_mb > 0) {
+        config.brpc_http_max_range_mb = FLAGS_brpc_http_max_range_mb;
+        SPDLOG_DEBUG("Override brpc_http_max_range_mb: {}", config.brpc_http_max_range_mb);
+    }
+    if (!FLAGS_compression_raft.empty()) {
+        config.compression_raft = FLAGS_compression_raft;
+        SPDLOG_DEBUG("Override compression_raft: {}", config.compression_raft);
+    }
+    if (FLAGS_compression_threshold >= 0) {
+        config.compression_threshold_bytes = FLAGS_compression_threshold;
+        SPDLOG_DEBUG("Override compression_threshold_bytes: {}", config.compression_threshold_bytes);
+    }
+    if (FLAGS_lanes_max_active > 0) {
+        config.lanes_max_active = FLAGS_lanes_max_active;
+        SPDLOG_DEBUG("Override lanes_max_active: {}", config.lanes_max_active);
+    }
+    if (FLAGS_lanes_bulk_max_active > 0) {
+        config.lanes_bulk_max_active = FLAGS_lanes_bulk_max_active;
+        SPDLOG_DEBUG("Override lanes_bulk_max_active: {}", config.lanes_bulk_max_active);
+    }
+    if (FLAGS_rate_limit_ops_per_sec >= 0.0) {
+        config.rate_limit_ops_per_sec = FLAGS_rate_limit_ops_per_sec;
+        SPDLOG_DEBUG("Override rate_limit_ops_per_sec: {}", config.rate_limit_ops_per_sec);
+    }
+    if (FLAGS_rate_limit_mb_per_sec >= 0.0) {
+        config.rate_limit_mb_per_sec = FLAGS_rate_limit_mb_per_sec;
+        SPDLOG_DEBUG("Override rate_limit_mb_per_sec: {}", config.rate_limit_mb_per_sec);
+    }
+    if (FLAGS_trace_sample_rate >= 0.0) {
+        config.trace_sample_rate = FLAGS_trace_sample_rate;
+        SPDLOG_DEBUG("Override trace_sample_rate: {}", config.trace_sample_rate);
+    }
+    if (FLAGS_trace_slow_threshold_ms >= 0) {
+        config.trace_slow_threshold_ms = FLAGS_trace_slow_threshold_ms;
+        SPDLOG_DEBUG("Override trace_slow_threshold_ms: {}", config.trace_slow_threshold_ms);
+    }
+    if (FLAGS_slow_log_threshold_ms >= 0) {
+        config.slow_log_threshold_ms = FLAGS_slow_log_threshold_ms;
+        SPDLOG_DEBUG("Override slow_log_threshold_ms: {}", config.slow_log_threshold_ms);
+    }
+    if (!FLAGS_slow_log_path.empty()) {
+        config.slow_log_path = FLAGS_slow_log_path;
+        SPDLOG_DEBUG("Override slow_log_path: {}", config.slow_log_path);
     }
 }
 
@@ -21,6 +21,9 @@ std::string Error::to_string() const {
             case ErrorCode::InvalidCommand: return "Invalid command";
             case ErrorCode::NetworkError: return "Network error";
             case ErrorCode::Timeout: return "Timeout";
+            case ErrorCode::Busy: return "Server busy";
+            case ErrorCode::Overloaded: return "Raft pipeline overloaded";
+            case ErrorCode::Throttled: return "Client rate limit exceeded";
             default: return "Unknown error";
         }
     }
@@ -0,0 +1,82 @@
+#include "diarkis/http.h"
+#include <algorithm>
+#include <charconv>
+
+namespace diarkis::http {
+
+namespace {
+    bool parse_u64(std::string_view text, uint64_t& out) {
+        auto result = std::from_chars(text.data(), text.data() + text.size(), out);
+        return !text.empty() && result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) text.remove_suffix(1);
+    return text;
+}
+
+bool etag_matches(std::string_view header, const std::string& etag) {
+    while (!header.empty()) {
+        size_t comma = header.find(',');
+        std::string_view tag = trim(header.substr(0, comma));
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.substr(0, 2) == "W/") {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+        header = comma == std::string_view::npos ? std::string_view() : header.substr(comma + 1);
+    }
+    return false;
+}
+
+Range parse_range(std::string_view header, uint64_t size, uint64_t& offset, uint64_t& length) {
+    constexpr std::string_view UNIT = "bytes=";
+    header = trim(header);
+    if (header.substr(0, UNIT.size()) != UNIT || header.find(',') != std::string_view::npos) {
+        return Range::NONE;
+    }
+    std::string_view spec = trim(header.substr(UNIT.size()));
+    size_t dash = spec.find('-');
+    if (dash == std::string_view::npos) {
+        return Range::NONE;
+    }
+    std::string_view first_text = spec.substr(0, dash);
+    std::string_view last_text = spec.substr(dash + 1);
+    
+    uint64_t first = 0;
+    uint64_t last = 0;
+    if (first_text.empty()) {
+        uint64_t suffix = 0;
+        if (!parse_u64(last_text, suffix)) {
+            return Range::NONE;
+        }
+        if (suffix == 0 || size == 0) {
+            return Range::UNSATISFIABLE;
+        }
+        length = std::min(suffix, size);
+        offset = size - length;
+        return Range::SATISFIABLE;
+    }
+    if (!parse_u64(first_text, first)) {
+        return Range::NONE;
+    }
+    if (last_text.empty()) {
+        last = size > 0 ? size - 1 : 0;
+    } else if (!parse_u64(last_text, last) || last < first) {
+        return Range::NONE;
+    }
+    if (first >= size) {
+        return Range::UNSATISFIABLE;
+    }
+    offset = first;
+    length = std::min(last, size - 1) - first + 1;
+    return Range::SATISFIABLE;
+}
+
+}
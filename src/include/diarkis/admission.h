@@ -0,0 +1,235 @@
+
+#ifndef DIARKIS_ADMISSION_H
+#define DIARKIS_ADMISSION_H
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace diarkis {
+
+// Bounds the bytes held by requests that were admitted but not yet answered
+class MemoryBudget {
+public:
+    explicit MemoryBudget(size_t capacity) : capacity_(capacity) {}
+    
+    MemoryBudget(const MemoryBudget&) = delete;
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+    
+    // Waits up to `wait` for room; fails at once if bytes exceeds the capacity
+    bool try_acquire(size_t bytes, std::chrono::milliseconds wait);
+    void release(size_t bytes);
+    
+    size_t capacity() const { return capacity_; }
+    size_t in_use() const;
+
+private:
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::condition_variable released_;
+    size_t in_use_ = 0;
+};
+
+// Bytes held against a MemoryBudget for the lifetime of the lease
+class BudgetLease {
+public:
+    BudgetLease() = default;
+    BudgetLease(MemoryBudget& budget, size_t bytes, std::chrono::milliseconds wait)
+        : budget_(budget.try_acquire(bytes, wait) ? &budget : nullptr), bytes_(bytes) {}
+    ~BudgetLease() { release(); }
+    
+    BudgetLease(BudgetLease&& other) noexcept
+        : budget_(other.budget_), bytes_(other.bytes_) {
+        other.budget_ = nullptr;
+    }
+    BudgetLease& operator=(BudgetLease&& other) noexcept {
+        if (this != &other) {
+            release();
+            budget_ = other.budget_;
+            bytes_ = other.bytes_;
+            other.budget_ = nullptr;
+        }
+        return *this;
+    }
+    
+    BudgetLease(const BudgetLease&) = delete;
+    BudgetLease& operator=(const BudgetLease&) = delete;
+    
+    explicit operator bool() const { return budget_ != nullptr; }
+    
+    // Adds bytes to a held lease, waiting up to `wait`; false leaves it as is
+    bool extend(size_t bytes, std::chrono::milliseconds wait) {
+        if (!budget_ || !budget_->try_acquire(bytes, wait)) {
+            return false;
+        }
+        bytes_ += bytes;
+        return true;
+    }
+    
+    void release() {
+        if (budget_) {
+            budget_->release(bytes_);
+            budget_ = nullptr;
+        }
+    }
+
+private:
+    MemoryBudget* budget_ = nullptr;
+    size_t bytes_ = 0;
+};
+
+// Scheduling class of a request: small requests and metadata operations run
+// in the interactive lane, requests carrying large payloads in the bulk lane
+enum class Lane : uint8_t {
+    INTERACTIVE = 0,
+    BULK = 1
+};
+constexpr size_t LANE_COUNT = 2;
+
+const char* lane_name(Lane lane);
+
+// Limits the requests executing at once and, when they queue, grants slots
+// by weighted round robin between the lanes. Bulk requests are also capped
+// on their own, so a burst of uploads always leaves slots for the rest.
+// Within a lane, clients take turns by deficit round robin: each request
+// costs its size plus DRR_REQUEST_COST, and a client's turn is worth
+// DRR_QUANTUM, so one client's backlog cannot starve the others.
+class LaneScheduler {
+public:
+    struct Options {
+        size_t max_active = 64;             // all lanes
+        size_t bulk_max_active = 8;
+        uint32_t interactive_weight = 8;    // interactive grants per bulk grant
+    };
+    
+    static constexpr size_t DRR_QUANTUM = 256 * 1024;
+    static constexpr size_t DRR_REQUEST_COST = 4 * 1024;
+    
+    explicit LaneScheduler(const Options& opts);
+    
+    LaneScheduler(const LaneScheduler&) = delete;
+    LaneScheduler& operator=(const LaneScheduler&) = delete;
+    
+    // Waits up to `wait` for a slot in the lane
+    bool try_acquire(Lane lane, uint64_t client, size_t bytes, std::chrono::milliseconds wait);
+    void release(Lane lane);
+    
+    size_t active(Lane lane) const;
+    size_t queued(Lane lane) const;
+
+private:
+    struct Waiter {
+        std::condition_variable cv;
+        size_t cost = 0;
+        bool granted = false;
+    };
+    
+    // A client with queued requests in one lane
+    struct Flow {
+        uint64_t client = 0;
+        size_t deficit = 0;
+        std::deque<Waiter*> waiters;
+    };
+    
+    struct LaneQueue {
+        std::list<Flow> ring;   // flows in turn order
+        std::unordered_map<uint64_t, std::list<Flow>::iterator> flows;
+        size_t waiting = 0;
+    };
+    
+    bool has_room(Lane lane) const;
+    void grant_waiters();
+    Waiter* next_waiter(LaneQueue& queue);
+    void remove_waiter(LaneQueue& queue, uint64_t client, Waiter* waiter);
+    
+    const Options options_;
+    mutable std::mutex mutex_;
+    std::array<size_t, LANE_COUNT> active_{};
+    std::array<LaneQueue, LANE_COUNT> queues_;
+    size_t total_active_ = 0;
+    uint32_t interactive_streak_ = 0;   // interactive grants since the last bulk one
+};
+
+// A slot held in a LaneScheduler for the lifetime of the object
+class LaneSlot {
+public:
+    LaneSlot(LaneScheduler& scheduler, Lane lane, uint64_t client, size_t bytes, 
+             std::chrono::milliseconds wait)
+        : scheduler_(scheduler.try_acquire(lane, client, bytes, wait) ? &scheduler : nullptr), 
+          lane_(lane) {}
+    ~LaneSlot() {
+        if (scheduler_) {
+            scheduler_->release(lane_);
+        }
+    }
+    
+    LaneSlot(const LaneSlot&) = delete;
+    LaneSlot& operator=(const LaneSlot&) = delete;
+    
+    explicit operator bool() const { return scheduler_ != nullptr; }
+
+private:
+    LaneScheduler* scheduler_;
+    Lane lane_;
+};
+
+// Token buckets per client, one for requests and one for bytes. A rate of
+// 0 disables its bucket. A request may overdraw the bytes bucket, so a
+// payload larger than the burst still passes and later requests wait for
+// the debt to be repaid.
+class RateLimiter {
+public:
+    struct Options {
+        double ops_per_sec = 0;
+        double bytes_per_sec = 0;
+        double burst_sec = 1.0;         // bucket capacity, in seconds of rate
+        size_t max_clients = 65536;     // full buckets beyond this are dropped
+    };
+    
+    explicit RateLimiter(const Options& opts);
+    
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+    
+    bool enabled() const { return options_.ops_per_sec > 0 || options_.bytes_per_sec > 0; }
+    
+    // Reserves one request of `bytes` and sets delay to how long the caller
+    // must wait before sending it on. Reserves nothing and fails when that
+    // would be longer than max_wait.
+    bool acquire(const std::string& client, size_t bytes, std::chrono::milliseconds max_wait,
+                 std::chrono::microseconds& delay);
+    
+    // Charges bytes known only afterwards, such as a read's response
+    void charge(const std::string& client, size_t bytes);
+    
+    size_t clients() const;
+
+private:
+    struct Bucket {
+        double ops;
+        double bytes;
+        int64_t updated_us;
+    };
+    
+    Bucket& bucket(const std::string& client, int64_t now_us);
+    void refill(Bucket& bucket, int64_t now_us) const;
+    void evict_full(int64_t now_us);
+    
+    const Options options_;
+    const double ops_capacity_;
+    const double bytes_capacity_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Bucket> buckets_;
+    int64_t last_eviction_us_ = 0;
+};
+
+}
+
+#endif
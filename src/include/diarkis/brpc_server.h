@@ -0,0 +1,146 @@
+
+#ifndef DIARKIS_BRPC_SERVER_H
+#define DIARKIS_BRPC_SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include "brpc/server.h"
+#include "diarkis/admission.h"
+#include "diarkis/state_machine.h"
+#include "diarkis/commands.h"
+#include "file_service.pb.h"
+
+namespace brpc {
+class Controller;
+}
+
+namespace diarkis {
+
+// Admission shared with RpcServer, so brpc requests draw on the same memory
+// budget, lanes and per-client rate limits as the TCP protocol; clients are
+// keyed on the remote IP. Null members admit everything. Budget and lanes
+// wait on std::condition_variable, which would block a bthread worker, so
+// they admit without waiting and a request that does not fit is BUSY at
+// once; only rate limit delays are slept, with bthread_usleep.
+struct BrpcAdmission {
+    MemoryBudget* budget = nullptr;
+    LaneScheduler* lanes = nullptr;
+    RateLimiter* rate_limiter = nullptr;
+    int wait_ms = 1000;                     // longest rate limit delay
+    size_t bulk_threshold = 1024 * 1024;    // payloads this large run in the bulk lane
+    
+    // Holds what an admitted request reserved until it is answered
+    struct Ticket {
+        std::string client;
+        BudgetLease lease;
+        std::optional<LaneSlot> slot;
+    };
+    
+    // Status::OK with the reservations in ticket, or BUSY or THROTTLED
+    commands::Status admit(brpc::Controller* cntl, bool carries_payload, size_t bytes, Ticket& ticket) const;
+    // Charges bytes known only afterwards, such as a read's response
+    void charge(const Ticket& ticket, size_t bytes) const;
+};
+
+// The file operations as a protobuf service. Payloads travel as attachments:
+// WriteFile and AppendFile take the contents from the request attachment and
+// ReadFile returns them in the response attachment, so they are never copied
+// into or out of a message.
+class FileServiceImpl : public proto::FileService {
+public:
+    FileServiceImpl(std::shared_ptr<StateMachine> state_machine, size_t max_request_bytes,
+                    const BrpcAdmission& admission);
+
+    void CreateFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                    proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void WriteFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                   proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void AppendFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                    proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void ReadFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                  proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void DeleteFile(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                    proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void CreateDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                   proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void ListDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                 proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void DeleteDir(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                   proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void Rename(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void Copy(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+              proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void Truncate(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                  proto::FileResponse* response, google::protobuf::Closure* done) override;
+    void PunchHole(google::protobuf::RpcController* cntl, const proto::FileRequest* request,
+                   proto::FileResponse* response, google::protobuf::Closure* done) override;
+
+private:
+    void serve(commands::Type type, google::protobuf::RpcController* cntl,
+               const proto::FileRequest* request, proto::FileResponse* response,
+               google::protobuf::Closure* done);
+
+    std::shared_ptr<StateMachine> state_machine_;
+    size_t max_request_bytes_;
+    BrpcAdmission admission_;
+};
+
+// Read-only HTTP access to files, mapped to /files/* on the brpc server.
+// Supports single byte ranges, If-Range and If-None-Match against a strong
+// ETag of the file's size and nanosecond mtime; bodies are read from the file
+// straight into the response IOBuf.
+class FileGatewayImpl : public proto::FileGateway {
+public:
+    FileGatewayImpl(std::shared_ptr<StateMachine> state_machine, const BrpcAdmission& admission,
+                    size_t max_range_bytes);
+
+    void Get(google::protobuf::RpcController* cntl, const proto::HttpRequest* request,
+             proto::HttpResponse* response, google::protobuf::Closure* done) override;
+
+private:
+    std::shared_ptr<StateMachine> state_machine_;
+    BrpcAdmission admission_;
+    size_t max_range_bytes_;
+};
+
+// Serves FileServiceImpl, and optionally FileGatewayImpl, on its own brpc
+// server next to the TCP protocol. Requests run in bthreads, at most
+// max_concurrency at once, and pass the admission shared with RpcServer.
+class BrpcServer {
+public:
+    struct Options {
+        int num_threads = 0;            // bthread workers, 0 for brpc's default
+        int max_concurrency = 0;        // requests executing at once, 0 for one per bthread worker
+        size_t max_request_bytes = 100 * 1024 * 1024;
+        bool http_gateway = false;      // also serve GET /files/<path>
+        size_t http_max_range_bytes = 16 * 1024 * 1024;     // largest gateway body
+        BrpcAdmission admission;
+    };
+
+    BrpcServer(const std::string& address, uint16_t port,
+               std::shared_ptr<StateMachine> state_machine, const Options& options);
+    ~BrpcServer();
+
+    BrpcServer(const BrpcServer&) = delete;
+    BrpcServer& operator=(const BrpcServer&) = delete;
+
+    bool start();
+    void stop();
+    bool is_running() const;
+
+private:
+    std::string address_;
+    uint16_t port_;
+    Options options_;
+    FileServiceImpl file_service_;
+    FileGatewayImpl file_gateway_;
+    std::unique_ptr<brpc::Server> server_;
+};
+
+}
+
+#endif
@@ -18,10 +18,64 @@ struct ServerConfig {
     std::string initial_conf = "127.0.0.1:8100";
     int election_timeout_ms = 5000;
     int snapshot_interval_s = 3600;
+    int raft_max_pending_tasks = 1024;  // writes queued in Raft before failing fast
+    int raft_max_pending_mb = 256;
+    bool raft_compact_log = false;      // compact log entries, one per BATCH write run; only
+                                        // once every node decodes them
     
     // RPC configuration
     std::string rpc_addr = "0.0.0.0";
     uint16_t rpc_port = 9100;
+    int rpc_max_inflight_mb = 1024;     // request bytes held across all connections
+    int rpc_max_request_mb = 100;       // largest request a connection may send
+    int rpc_admission_wait_ms = 1000;   // wait for budget before answering busy
+    int rpc_max_batch_commands = 4096;
+    int rpc_batch_read_threads = 8;     // pool serving batched reads, shared by all connections
+    int rpc_idle_timeout_s = 30;        // connections waiting this long for a request are closed; 0 uses SO_RCVTIMEO
+    int rpc_listeners = 1;              // SO_REUSEPORT accept sockets, 0 for one per CPU
+    bool rpc_pin_listeners = false;     // pin each listener and its connections to a CPU
+    std::string rpc_unix_path;          // AF_UNIX listener for local clients, empty disables
+    std::string rpc_unix_socket_mode = "0660";  // octal permissions of the socket file
+    bool rpc_shared_memory = true;      // let Unix socket clients attach shared memory rings
+    
+    // brpc file service configuration, bound to rpc_addr
+    uint16_t brpc_port = 0;             // 0 disables the service
+    int brpc_num_threads = 0;           // bthread workers, 0 for brpc's default
+    int brpc_max_concurrency = 0;       // requests executing at once, 0 for one per bthread worker
+    bool brpc_http_gateway = false;     // serve GET /files/<path> over HTTP
+    int brpc_http_max_range_mb = 16;    // largest body one gateway response carries
+    
+    // Compression configuration
+    bool compression_wire = true;           // offer compression in the HELLO exchange
+    std::string compression_raft = "none";  // none, lz4 or zstd; only once every node decodes it
+    int compression_threshold_bytes = 4096;
+    
+    // Priority lane configuration
+    int lanes_max_active = 64;          // requests executing at once
+    int lanes_bulk_max_active = 8;      // of which carry large payloads
+    int lanes_bulk_threshold_kb = 1024; // payloads from this size run in the bulk lane
+    int lanes_interactive_weight = 8;   // interactive grants per bulk grant when both queue
+    
+    // Per-client rate limit configuration, 0 disables a limit
+    double rate_limit_ops_per_sec = 0;
+    double rate_limit_mb_per_sec = 0;
+    int rate_limit_burst_ms = 1000;         // bucket size, in time at the limit
+    // "client" keys buckets on peer_identity(), the peer address or Unix uid;
+    // the HELLO client_id only labels logs. "connection" keys them per socket.
+    std::string rate_limit_per = "client";
+    
+    // Tracing configuration
+    double trace_sample_rate = 0.01;
+    int trace_slow_threshold_ms = 100;
+    int trace_ring_size = 256;
+    
+    // Slow operation log configuration
+    int slow_log_threshold_ms = 500;
+    std::string slow_log_path;              // empty for <raft_path>/slow_ops.log
+    int slow_log_queue_size = 8192;
+    
+    // rpc_unix_socket_mode as permission bits, -1 if it is not octal up to 0777
+    int unix_socket_mode() const;
     
     // Validation
     Result<void> validate() const;
@@ -21,6 +21,9 @@ enum class ErrorCode {
     InvalidCommand,
     NetworkError,
     Timeout,
+    Busy,
+    Overloaded,
+    Throttled,
     Unknown
 };
 
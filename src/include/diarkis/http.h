@@ -0,0 +1,26 @@
+#ifndef DIARKIS_HTTP_H
+#define DIARKIS_HTTP_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Header parsing for the HTTP file gateway
+namespace diarkis::http {
+
+// Strips the spaces and tabs around a header value or list element
+std::string_view trim(std::string_view text);
+
+// If-None-Match is "*" or a list of tags, compared weakly
+bool etag_matches(std::string_view header, const std::string& etag);
+
+enum class Range { NONE, SATISFIABLE, UNSATISFIABLE };
+
+// Parses a single "bytes=first-last", "bytes=first-" or "bytes=-suffix"
+// against size. Malformed headers, other units and multiple ranges yield
+// NONE, which serves the whole file as RFC 9110 allows.
+Range parse_range(std::string_view header, uint64_t size, uint64_t& offset, uint64_t& length);
+
+}
+
+#endif
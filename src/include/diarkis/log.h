@@ -0,0 +1,60 @@
+
+#ifndef DIARKIS_LOG_H
+#define DIARKIS_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "spdlog/spdlog.h"
+
+namespace diarkis::log {
+
+// Admits at most per_second events per one second window
+class RateLimiter {
+public:
+    explicit RateLimiter(uint32_t per_second) : per_second_(per_second) {}
+    
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+    
+    // suppressed receives the number of events dropped since the last admitted one
+    bool allow(uint64_t& suppressed) {
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t window = window_start_ms_.load(std::memory_order_relaxed);
+        if (now - window >= 1000 &&
+            window_start_ms_.compare_exchange_strong(window, now, std::memory_order_relaxed)) {
+            count_.store(0, std::memory_order_relaxed);
+        }
+        
+        if (count_.fetch_add(1, std::memory_order_relaxed) < per_second_) {
+            suppressed = suppressed_.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+        suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+private:
+    const uint32_t per_second_;
+    std::atomic<int64_t> window_start_ms_{0};
+    std::atomic<uint32_t> count_{0};
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+}
+
+// Error logging for request paths: at most 10 messages per second per call site
+#define DIARKIS_ERROR_RATE_LIMITED(...)                                                \
+    do {                                                                               \
+        static ::diarkis::log::RateLimiter diarkis_rate_limiter_(10);                   \
+        uint64_t diarkis_suppressed_ = 0;                                              \
+        if (diarkis_rate_limiter_.allow(diarkis_suppressed_)) {                        \
+            if (diarkis_suppressed_ > 0) {                                             \
+                spdlog::error("{} similar errors suppressed", diarkis_suppressed_);    \
+            }                                                                          \
+            spdlog::error(__VA_ARGS__);                                                \
+        }                                                                              \
+    } while (0)
+
+#endif
@@ -0,0 +1,62 @@
+
+#ifndef DIARKIS_METRICS_H
+#define DIARKIS_METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "diarkis/commands.h"
+
+namespace diarkis::metrics {
+
+// Request pipeline stages, each exported per command type as a bvar
+// LatencyRecorder named diarkis_<command>_<stage> on the bRPC port.
+enum class Stage : uint8_t {
+    Receive = 0,    // request body read off the socket
+    Decode,         // msgpack unpack + convert
+    Commit,         // Raft apply submitted until closure runs
+    Apply,          // on_apply for a single log entry
+    Storage,        // Storage call on the local filesystem
+    Send,           // response serialization + socket write
+    Total,          // whole request as seen by RpcServer
+    COUNT
+};
+
+const char* stage_name(Stage stage);
+
+void record_latency(commands::Type type, Stage stage, int64_t latency_us);
+void record_request(commands::Type type, size_t request_bytes);
+void record_response(commands::Type type, bool success, size_t payload_bytes);
+
+class Stopwatch {
+public:
+    Stopwatch() : start_(std::chrono::steady_clock::now()) {}
+
+    int64_t elapsed_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+    }
+
+    void reset() { start_ = std::chrono::steady_clock::now(); }
+
+private:
+    std::chrono::steady_clock::time_point start_;
+};
+
+class ScopedLatency {
+public:
+    ScopedLatency(commands::Type type, Stage stage) : type_(type), stage_(stage) {}
+    ~ScopedLatency() { record_latency(type_, stage_, watch_.elapsed_us()); }
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+    commands::Type type_;
+    Stage stage_;
+    Stopwatch watch_;
+};
+
+}
+
+#endif
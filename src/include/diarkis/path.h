@@ -0,0 +1,18 @@
+
+#ifndef DIARKIS_PATH_H
+#define DIARKIS_PATH_H
+
+#include <string>
+
+namespace diarkis {
+
+// Rejects absolute paths and any ".." component.
+bool is_safe_path(const std::string& path);
+
+// Collapses repeated slashes, drops "." components and strips leading and
+// trailing slashes, so every spelling of a safe path maps to one string.
+std::string normalize_path(const std::string& path);
+
+}
+
+#endif
@@ -3,31 +3,52 @@
 #define DIARKIS_RAFT_CLOSURE_H
 
 #include "braft/raft.h"
+#include "bthread/condition_variable.h"
+#include "bthread/mutex.h"
+#include "diarkis/trace.h"
 #include <mutex>
-#include <condition_variable>
+#include <vector>
 
 namespace diarkis {
 
+// Waiting suspends a bthread instead of blocking its worker, and blocks a
+// plain thread like a std::condition_variable would
 class RaftClosure : public braft::Closure {
 public:
-    RaftClosure() : done_(false) {}
+    RaftClosure() : done_(false), trace_(nullptr), timings_(nullptr), batch_status_(nullptr) {}
     ~RaftClosure() override = default;
     
     void Run() override {
-        std::unique_lock<std::mutex> lock(mutex_);
+        std::unique_lock<bthread::Mutex> lock(mutex_);
         done_ = true;
         cv_.notify_one();
     }
     
     void wait() {
-        std::unique_lock<std::mutex> lock(mutex_);
-        cv_.wait(lock, [this] { return done_; });
+        std::unique_lock<bthread::Mutex> lock(mutex_);
+        while (!done_) {
+            cv_.wait(lock);
+        }
     }
+    
+    // Trace of the waiting request; on_apply records its spans here
+    void set_trace(trace::Trace* trace) { trace_ = trace; }
+    trace::Trace* trace() const { return trace_; }
+    
+    void set_timings(slowlog::Timings* timings) { timings_ = timings; }
+    slowlog::Timings* timings() const { return timings_; }
+    
+    // For BATCH entries, on_apply appends one status per command here
+    void set_batch_status(std::vector<butil::Status>* status) { batch_status_ = status; }
+    std::vector<butil::Status>* batch_status() const { return batch_status_; }
 
 private:
-    std::mutex mutex_;
-    std::condition_variable cv_;
+    bthread::Mutex mutex_;
+    bthread::ConditionVariable cv_;
     bool done_;
+    trace::Trace* trace_;
+    slowlog::Timings* timings_;
+    std::vector<butil::Status>* batch_status_;
 };
 
 }
@@ -2,32 +2,82 @@
 #ifndef DIARKIS_RPC_H
 #define DIARKIS_RPC_H
 
+#include <array>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <cstdint>
+#include "bvar/bvar.h"
+#include "diarkis/admission.h"
+#include "diarkis/worker_pool.h"
 #include "diarkis/tcp.h"
 #include "diarkis/state_machine.h"
 #include "diarkis/commands.h"
+#include "diarkis/codec.h"
+#include "diarkis/shm.h"
 
 namespace diarkis {
 
-// Protocol: [4 bytes length (network order)][msgpack data]
+// Protocol: [4 bytes length (network order)][msgpack or compact data]
+// With CAP_MULTIPLEX negotiated: [4 bytes length][4 bytes request id][data]
 class MessageProtocol {
 public:
     static constexpr size_t MAX_MESSAGE_SIZE = 100 * 1024 * 1024; // 100MB
     
-    static bool receive_message(std::shared_ptr<TcpConnection> conn, std::vector<uint8_t>& message);
+    // receive_us, when set, gets the time spent reading the body after the length arrived
+    static bool receive_message(std::shared_ptr<TcpConnection> conn, std::vector<uint8_t>& message,
+                                int64_t* receive_us = nullptr);
     static bool send_message(std::shared_ptr<TcpConnection> conn, const std::vector<uint8_t>& message);
     
-private:
     static bool receive_length(std::shared_ptr<TcpConnection> conn, uint32_t& length);
     static bool receive_data(std::shared_ptr<TcpConnection> conn, std::vector<uint8_t>& data, size_t length);
+    // Reads and drops a message body without buffering it
+    static bool discard_data(std::shared_ptr<TcpConnection> conn, size_t length);
 };
 
 class RpcServer {
 public:
+    struct Options {
+        size_t max_inflight_bytes = 1024ULL * 1024 * 1024;           // all connections
+        size_t max_request_bytes = MessageProtocol::MAX_MESSAGE_SIZE; // per connection
+        int admission_wait_ms = 1000;   // how long a request may wait for budget
+        
+        // Offered to clients in the HELLO exchange
+        uint32_t capabilities = commands::compression_capabilities() | commands::CAP_MULTIPLEX |
+                                commands::CAP_SHM;
+        size_t compression_threshold = 4096;    // smaller responses are sent as is
+        
+        // Writes and batches with at least bulk_threshold payload bytes run
+        // in the bulk lane, everything else in the interactive lane
+        LaneScheduler::Options lanes;
+        size_t bulk_threshold = 1024 * 1024;
+        
+        // Token buckets per client, keyed by the peer address or Unix socket
+        // uid, or per connection when rate_limit_per_connection
+        RateLimiter::Options rate_limit;
+        bool rate_limit_per_connection = false;
+        
+        size_t max_batch_commands = 4096;   // per BATCH request
+        size_t batch_read_threads = 8;      // threads serving batched reads, shared by all connections
+        
+        int idle_timeout_sec = 30;      // close connections idle this long; 0 uses SO_RCVTIMEO
+        
+        // TCP listener sockets sharing the port, 0 for one per CPU; pinned
+        // listeners keep their connections on their own core
+        int listeners = 1;
+        bool pin_listeners = false;
+        
+        // Also accept co-located clients on this AF_UNIX socket path
+        std::string unix_path;
+        uint32_t unix_socket_mode = 0660;   // permissions of the socket file
+        bool shared_memory = true;          // offer CAP_SHM on the Unix socket
+    };
+    
     RpcServer(const std::string& address, uint16_t port, 
               std::shared_ptr<StateMachine> state_machine);
+    RpcServer(const std::string& address, uint16_t port, 
+              std::shared_ptr<StateMachine> state_machine,
+              const Options& options);
     ~RpcServer();
     
     RpcServer(const RpcServer&) = delete;
@@ -37,22 +87,111 @@ public:
     void stop();
     bool is_running() const;
     size_t active_connections() const;
+    
+    // Admission state, shared with other front ends such as BrpcServer so
+    // their requests draw on the same budget, lanes and rate limits
+    MemoryBudget& inflight_budget() { return inflight_budget_; }
+    LaneScheduler& lanes() { return lanes_; }
+    RateLimiter& rate_limiter() { return rate_limiter_; }
 
 private:
+    // Per-connection state negotiated by HELLO
+    struct Session {
+        bool negotiated = false;
+        uint32_t version = 0;
+        uint32_t capabilities = 0;
+        commands::compression::Algorithm compression = commands::compression::Algorithm::NONE;
+        bool multiplexed = false;
+        size_t max_response_bytes = MessageProtocol::MAX_MESSAGE_SIZE;
+        uint32_t request_id = 0;    // of the request being answered
+        bool local = false;         // connected over the Unix socket
+        std::string client;         // rate limit and fair queuing identity
+        uint64_t client_key = 0;    // hash of client
+        std::string label;          // client id offered in HELLO, for logs only
+        uint64_t requests = 0;      // received on this connection
+        bool uncharged = false;     // rate limited once decoded, see throttle()
+        bool closing = false;       // end the connection after this response
+        
+        // Rings attached by ATTACH_SHM; all later traffic uses them
+        std::unique_ptr<commands::shm::Channel> shm;
+        std::unique_ptr<commands::shm::Channel> pending_shm;
+    };
+    
     void handle_connection(std::shared_ptr<TcpConnection> conn);
-    bool process_request(std::shared_ptr<TcpConnection> conn);
+    bool process_request(std::shared_ptr<TcpConnection> conn, Session& session);
+    bool process_shm_request(std::shared_ptr<TcpConnection> conn, Session& session);
+    bool serve_request(std::shared_ptr<TcpConnection> conn, Session& session, int64_t receive_us);
+    Lane classify(const commands::CommandView& cmd) const;
+    void set_client(Session& session, std::string client);
+    // Takes the client's rate limit tokens for a request of length bytes,
+    // sleeping through short delays; false if the request is throttled.
+    // A first frame that may be HELLO is left to charge() once decoded.
+    bool throttle(Session& session, size_t length);
+    bool charge(Session& session, size_t length);
+    commands::Response handle_hello(const commands::CommandView& cmd, Session& session);
+    commands::Response handle_attach_shm(std::shared_ptr<TcpConnection> conn, Session& session);
+    void compress_response(commands::Response& resp, const Session& session);
+    // Both discard the length body bytes still in the socket, 0 if none
+    bool reject_request(std::shared_ptr<TcpConnection> conn, const Session& session, size_t length,
+                        commands::Status status, const std::string& error);
+    bool reject_oversize(std::shared_ptr<TcpConnection> conn, const Session& session, size_t length);
+    
+    // Bytes of read results a batch holds until its response is sent; they
+    // are charged to the in-flight budget and capped at the response size
+    struct BatchResults {
+        std::mutex mutex;
+        BudgetLease lease;
+        size_t bytes = 0;
+        size_t max_bytes = 0;
+        commands::Status status = commands::Status::OK;
+        std::string error;      // set once a result did not fit
+    };
     
-    commands::Response dispatch_command(const commands::Command& cmd);
-    commands::Response handle_write_command(const commands::Command& cmd);
-    commands::Response handle_read_command(const commands::Command& cmd);
+    // Result bytes stay charged to results_lease until it is released
+    commands::Response handle_batch(const commands::CommandView& cmd, commands::codec::Decoder& decoder,
+                                    size_t max_response_bytes, BudgetLease& results_lease);
+    void run_batch_reads(const commands::CommandView* cmds, commands::Response* results, size_t count,
+                         BatchResults& held);
     
-    bool send_response(std::shared_ptr<TcpConnection> conn, 
+    commands::Response dispatch_command(const commands::CommandView& cmd);
+    commands::Response handle_write_command(const commands::CommandView& cmd);
+    commands::Response handle_read_command(const commands::CommandView& cmd);
+    
+    bool send_response(std::shared_ptr<TcpConnection> conn, const Session& session,
                       const commands::Response& resp);
-    void send_error_response(std::shared_ptr<TcpConnection> conn, 
+    bool send_shm_response(std::shared_ptr<TcpConnection> conn, const Session& session,
+                           const commands::Response& resp);
+    void send_error_response(std::shared_ptr<TcpConnection> conn, const Session& session,
                             const std::string& error);
 
+    static int64_t get_inflight_bytes(void* arg);
+    // Lane gauges, arg is the RpcServer
+    static int64_t get_interactive_active(void* arg);
+    static int64_t get_interactive_queued(void* arg);
+    static int64_t get_bulk_active(void* arg);
+    static int64_t get_bulk_queued(void* arg);
+    static int64_t get_rate_limited_clients(void* arg);
+
+    Options options_;
+    std::unique_ptr<WorkerPool> read_pool_;     // helpers for batched reads
     std::unique_ptr<TcpServer> tcp_server_;
+    std::unique_ptr<TcpServer> unix_server_;
     std::shared_ptr<StateMachine> state_machine_;
+    
+    MemoryBudget inflight_budget_;
+    bvar::Adder<int64_t> busy_rejections_;
+    bvar::Adder<int64_t> oversize_rejections_;
+    std::unique_ptr<bvar::PassiveStatus<int64_t>> inflight_bytes_;
+    
+    LaneScheduler lanes_;
+    std::array<bvar::LatencyRecorder, LANE_COUNT> lane_waits_;
+    std::vector<std::unique_ptr<bvar::PassiveStatus<int64_t>>> lane_gauges_;
+    
+    RateLimiter rate_limiter_;
+    std::atomic<uint64_t> next_connection_{0};
+    bvar::Adder<int64_t> throttle_rejections_;
+    bvar::LatencyRecorder throttle_delays_;
+    std::unique_ptr<bvar::PassiveStatus<int64_t>> rate_limited_clients_;
 };
 
 }
@@ -0,0 +1,63 @@
+
+#ifndef DIARKIS_SLOW_LOG_H
+#define DIARKIS_SLOW_LOG_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "diarkis/commands.h"
+
+namespace diarkis::slowlog {
+
+enum class Stage : uint8_t {
+    Queue = 0,      // received until dispatch starts
+    LockWait,       // FileLocker acquisition
+    Consensus,      // Raft commit wait, excluding the apply's lock wait and I/O
+    Io,             // filesystem reads, writes and fsync
+    Send,           // response serialization + socket write
+    COUNT
+};
+
+struct Options {
+    int64_t threshold_us = 0;           // 0 disables the slow log
+    std::string path = "slow_ops.log";
+    size_t queue_size = 8192;           // records buffered before the oldest are dropped
+    size_t max_file_bytes = 64 * 1024 * 1024;
+    size_t max_files = 4;
+};
+
+// Per-request stage timings, always collected (unlike sampled traces)
+struct Timings {
+    std::array<int64_t, static_cast<size_t>(Stage::COUNT)> us{};
+
+    void add(Stage stage, int64_t value_us) { us[static_cast<size_t>(stage)] += value_us; }
+    int64_t get(Stage stage) const { return us[static_cast<size_t>(stage)]; }
+};
+
+void configure(const Options& opts);
+void shutdown();
+
+// Timings of the request being processed on this thread, or nullptr.
+Timings* current();
+
+class ScopedTimings {
+public:
+    explicit ScopedTimings(Timings* timings);
+    ~ScopedTimings();
+
+    ScopedTimings(const ScopedTimings&) = delete;
+    ScopedTimings& operator=(const ScopedTimings&) = delete;
+
+private:
+    Timings* previous_;
+};
+
+// Writes a record to the slow op sink if total_us exceeds the threshold.
+void maybe_log(commands::Type type, std::string_view path, size_t payload_bytes,
+               int64_t total_us, const Timings& timings);
+
+}
+
+#endif
@@ -5,12 +5,15 @@
 #include <atomic>
 #include <memory>
 #include <string>
+#include <vector>
 #include "braft/raft.h"
 #include "braft/storage.h"
 #include "braft/util.h"
 #include "brpc/server.h"
+#include "bvar/bvar.h"
 #include "diarkis/storage.h"
 #include "diarkis/commands.h"
+#include "diarkis/codec.h"
 #include "diarkis/raft_closure.h"
 
 namespace diarkis {
@@ -26,6 +29,21 @@ public:
         int election_timeout_ms = 5000;
         int snapshot_interval_s = 3600;
         
+        // Writes beyond these limits fail fast with ErrorCode::Overloaded
+        int64_t max_pending_tasks = 1024;
+        int64_t max_pending_bytes = 256LL * 1024 * 1024;
+        
+        // Log entries use the compact encoding instead of MessagePack, and a
+        // run of BATCH writes becomes one entry instead of one per command.
+        // Nodes older than the encoding cannot apply such entries, so this is
+        // only turned on once the whole cluster has been upgraded.
+        bool compact_log = false;
+        
+        // Write payloads at least this large are compressed in the Raft log;
+        // requires compact_log
+        commands::compression::Algorithm log_compression = commands::compression::Algorithm::NONE;
+        size_t compression_threshold = 4096;
+        
         // Validation
         bool validate() const;
     };
@@ -44,8 +62,16 @@ public:
     braft::PeerId leader_id() const;
 
     // Command application
-    commands::Response apply_write_command(const commands::Command& cmd);
-    commands::Response apply_read_command(const commands::Command& cmd);
+    commands::Response apply_write_command(const commands::CommandView& cmd);
+    commands::Response apply_read_command(const commands::CommandView& cmd);
+    
+    // Commits count write commands as a single log entry and returns one
+    // response per command. Commands are applied in order but not atomically.
+    std::vector<commands::Response> apply_write_batch(const commands::CommandView* cmds, size_t count);
+    
+    // Local replica, for reads served outside the command path; like
+    // apply_read_command they may lag the leader
+    Storage& storage() { return *storage_; }
 
     // bRaft StateMachine interface
     void on_apply(braft::Iterator& iter) override;
@@ -64,16 +90,80 @@ private:
     Result<void> init_raft_directories();
     Result<void> init_raft_node();
     Result<void> init_brpc_server();
+    void init_metrics();
     
-    void apply_command(const commands::Command& cmd, RaftClosure* done);
-    commands::Response handle_read_file(const commands::Command& cmd);
-    commands::Response handle_list_directory(const commands::Command& cmd);
+    // bvar::PassiveStatus getters, arg is the StateMachine
+    static int64_t get_term(void* arg);
+    static int64_t get_committed_index(void* arg);
+    static int64_t get_applied_index(void* arg);
+    static int64_t get_apply_lag(void* arg);
+    static int64_t get_pending_tasks(void* arg);
+    static int64_t get_log_disk_bytes(void* arg);
+    static int64_t get_pending_bytes(void* arg);
+    braft::NodeStatus raft_status() const;
+    
+    bool reserve_pending(int64_t bytes);
+    void release_pending(int64_t bytes);
+    
+    // Holds a reserve_pending slot until destroyed or released, so it is
+    // returned on every path out of propose, exceptions included
+    class PendingLease {
+    public:
+        PendingLease(StateMachine& sm, int64_t bytes)
+            : sm_(sm.reserve_pending(bytes) ? &sm : nullptr), bytes_(bytes) {}
+        ~PendingLease() { release(); }
+        
+        PendingLease(const PendingLease&) = delete;
+        PendingLease& operator=(const PendingLease&) = delete;
+        
+        explicit operator bool() const { return sm_ != nullptr; }
+        
+        void release() {
+            if (sm_) {
+                sm_->release_pending(bytes_);
+                sm_ = nullptr;
+            }
+        }
+        
+    private:
+        StateMachine* sm_;
+        int64_t bytes_;
+    };
+    
+    bool check_leader(commands::Response& resp) const;
+    commands::Response propose(commands::CommandView entry, std::vector<butil::Status>* batch_status);
+    void apply_batch(const commands::CommandView& cmd, RaftClosure* done);
+    void apply_command(const commands::CommandView& cmd, butil::Status* status);
+    commands::Response handle_read_file(const commands::CommandView& cmd);
+    commands::Response handle_list_directory(const commands::CommandView& cmd);
     
     Options options_;
     std::unique_ptr<Storage> storage_;
     std::unique_ptr<braft::Node> raft_node_;
     std::unique_ptr<brpc::Server> brpc_server_;
     std::atomic<bool> is_leader_;
+    std::atomic<int64_t> applied_index_;
+    
+    // Used only by on_apply, which braft never runs concurrently
+    commands::codec::Decoder apply_decoder_;
+    std::vector<uint8_t> apply_buffer_;
+    
+    // Writes handed to raft_node_->apply and not yet applied
+    std::atomic<int64_t> pending_tasks_;
+    std::atomic<int64_t> pending_bytes_;
+    
+    // Size of raft_path/log, rescanned at most every LOG_DISK_REFRESH_US and
+    // on the first read after a snapshot, which lets braft truncate the log
+    std::atomic<int64_t> log_disk_bytes_;
+    std::atomic<int64_t> log_disk_scanned_us_;
+    
+    // Raft pipeline health, exported as diarkis_raft_* bvars
+    bvar::IntRecorder apply_batch_size_;
+    bvar::LatencyRecorder snapshot_save_latency_;
+    bvar::LatencyRecorder snapshot_load_latency_;
+    bvar::Adder<int64_t> leader_changes_;
+    bvar::Adder<int64_t> overload_rejections_;
+    std::vector<std::unique_ptr<bvar::PassiveStatus<int64_t>>> raft_gauges_;
 };
 
 }
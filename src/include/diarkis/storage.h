@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <functional>
 #include <string>
 #include <vector>
 #include <mutex>
@@ -19,6 +20,12 @@ struct FileInfo {
     size_t size;
 };
 
+// Identifies the contents of a file; any write changes it
+struct FileStat {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+};
+
 class FileLocker {
 public:
     FileLocker();
@@ -44,6 +51,7 @@ private:
     std::unordered_map<std::string, LockState> locks_;
 };
 
+// Keyed by the normalized path, so every spelling of a path shares one lock
 class ReadLock {
 public:
     ReadLock(FileLocker& locker, const std::string& path);
@@ -72,6 +80,9 @@ private:
 
 class Storage {
 public:
+    // Largest file read into memory, and largest size or offset accepted
+    static constexpr uint64_t MAX_FILE_SIZE = 100 * 1024 * 1024; // 100MB
+    
     explicit Storage(std::string base_path);
     ~Storage() = default;
     
@@ -87,10 +98,25 @@ public:
     Result<void> create_directory(const std::string& path);
     
     Result<std::vector<uint8_t>> read_file(const std::string& path);
+    // Calls reader with a read-only descriptor of the regular file at path and
+    // its stat, under the file's read lock so no write lands in between; the
+    // descriptor is closed once reader returns
+    Result<void> read_open(const std::string& path,
+                           const std::function<Result<void>(int fd, const FileStat& stat)>& reader);
     Result<void> write_file(const std::string& path, const uint8_t* buffer, size_t size);
     Result<void> append_file(const std::string& path, const uint8_t* buffer, size_t size);
     
     Result<void> rename(const std::string& old_path, const std::string& new_path);
+    // Replaces dst_path with a copy of the regular file at src_path, sharing
+    // its extents where the filesystem supports reflinks
+    Result<void> copy_file(const std::string& src_path, const std::string& dst_path);
+    
+    // Sets the size of an existing file, dropping data past it or extending
+    // it with a hole
+    Result<void> truncate_file(const std::string& path, uint64_t size);
+    // Frees the blocks of [offset, offset + length) without changing the size;
+    // the range reads back as zeros
+    Result<void> punch_hole(const std::string& path, uint64_t offset, uint64_t length);
     Result<void> delete_file(const std::string& path);
     Result<void> delete_directory(const std::string& path);
     
@@ -8,6 +8,8 @@
 #include <atomic>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
+#include <unordered_map>
 #include <functional>
 #include <cstdint>
 
@@ -27,17 +29,42 @@ public:
     std::vector<uint8_t> receive(size_t max_size = 65536);
     bool receive_exact(void* buffer, size_t size);
     
+    // Reads one byte carrying SCM_RIGHTS descriptors; returns how many were
+    // stored in fds (extra ones are closed) or -1 on error
+    int receive_fds(int* fds, int max_fds);
+    
+    int socket_fd() const { return socket_fd_; }
+    bool is_local() const { return local_; }    // AF_UNIX peer
     const std::string& remote_address() const { return remote_addr_; }
     uint16_t remote_port() const { return remote_port_; }
+    // Who the kernel says the peer is: the address of a TCP peer, or the
+    // SO_PEERCRED uid of a Unix socket peer. Unlike anything the peer sends,
+    // it cannot be chosen by the client.
+    const std::string& peer_identity() const { return peer_identity_; }
     bool is_connected() const { return connected_.load(std::memory_order_acquire); }
     
+    // Idle tracking for TcpServer's reaper. The receive calls mark the
+    // connection as waiting; code blocking on input elsewhere (e.g. a shared
+    // memory ring) marks it itself. Any bytes moved count as activity.
+    void set_waiting(bool waiting);
+    bool is_waiting() const { return waiting_.load(std::memory_order_acquire); }
+    int64_t last_activity_ms() const { return last_activity_ms_.load(std::memory_order_acquire); }
+    
+    // Safe from any thread; wakes a thread blocked on the socket
     void close();
 
 private:
+    void touch();
+    
     int socket_fd_;
+    bool local_;
     std::atomic<bool> connected_;
+    std::atomic<bool> waiting_;
+    std::atomic<int64_t> last_activity_ms_;     // steady clock
     mutable std::mutex socket_mutex_;
+    std::mutex close_mutex_;                    // serializes close()
     std::string remote_addr_;
+    std::string peer_identity_;
     uint16_t remote_port_;
 };
 
@@ -49,7 +76,20 @@ public:
         std::string address = "0.0.0.0";
         uint16_t port = 0;
         int listen_backlog = 128;
-        int socket_timeout_sec = 30;
+        int socket_timeout_sec = 30;   // send timeout, and receive timeout without idle reaping
+        // Close connections that wait this long for input, checked by a timer
+        // wheel instead of a receive timeout; 0 falls back to SO_RCVTIMEO
+        int idle_timeout_sec = 0;
+        std::string unix_path;      // when set, listen on this AF_UNIX path instead
+        uint32_t unix_socket_mode = 0660;   // permissions of the socket file
+        
+        // SO_REUSEPORT sockets on the same port, each with its own accept
+        // thread; the kernel spreads new connections across them. 0 means
+        // one per CPU. A Unix socket always has a single listener.
+        int listeners = 1;
+        // Pin listener i to the i-th allowed CPU. Connection threads inherit
+        // the affinity, so each listener's connections stay on its core.
+        bool pin_listeners = false;
     };
 
     explicit TcpServer(const Options& opts);
@@ -68,32 +108,67 @@ public:
     
     const std::string& address() const { return options_.address; }
     uint16_t port() const { return options_.port; }
+    std::string endpoint() const;
     size_t active_connections() const;
 
 private:
-    void accept_loop();
-    void handle_connection(std::shared_ptr<TcpConnection> conn);
+    struct Listener {
+        int fd = -1;
+        int cpu = -1;       // pinned CPU, -1 if not pinned
+        std::thread thread;
+    };
     
-    void add_connection(std::shared_ptr<TcpConnection> conn);
-    void remove_connection(std::shared_ptr<TcpConnection> conn);
+    // Idle deadlines in a hashed timer wheel of WHEEL_SLOTS one second
+    // slots; entries due in a later round stay in their slot
+    struct WheelEntry {
+        uint64_t id;
+        uint64_t tick;
+    };
+    static constexpr size_t WHEEL_SLOTS = 64;
+    static constexpr int64_t WHEEL_TICK_MS = 1000;
+    
+    void accept_loop(Listener* listener);
+    void spawn_handler(std::shared_ptr<TcpConnection> conn);
+    void handle_connection(uint64_t id, std::shared_ptr<TcpConnection> conn);
+    
+    uint64_t add_connection(std::shared_ptr<TcpConnection> conn);
+    void remove_connection(uint64_t id);
+    std::shared_ptr<TcpConnection> find_connection(uint64_t id) const;
     void cleanup_connections();
     
-    bool create_socket();
-    bool bind_socket();
-    bool listen_socket();
-    void close_socket();
+    void reap_loop();
+    void schedule_idle_check(uint64_t id, int64_t deadline_ms);  // wheel_mutex_ held
+    
+    size_t listener_count() const;
+    int open_listener();
+    int create_socket();
+    bool bind_socket(int fd);
+    bool bind_unix_socket(int fd);
+    bool listen_socket(int fd);
+    void close_sockets();
     
     Options options_;
-    int server_fd_;
+    bool unix_bound_;   // the socket file is ours to remove
     
     std::atomic<bool> running_;
     std::atomic<bool> should_stop_;
     
-    std::unique_ptr<std::thread> accept_thread_;
-    std::vector<std::thread> connection_threads_;
+    std::vector<std::unique_ptr<Listener>> listeners_;
     
+    // Handler threads are detached and counted, so a finished connection
+    // releases its thread and stack at once; stop() waits for the count
     mutable std::mutex connections_mutex_;
-    std::vector<std::shared_ptr<TcpConnection>> active_connections_;
+    std::condition_variable handlers_done_;
+    std::unordered_map<uint64_t, std::shared_ptr<TcpConnection>> active_connections_;
+    uint64_t next_connection_id_ = 0;
+    size_t running_handlers_ = 0;
+    
+    std::mutex wheel_mutex_;
+    std::condition_variable wheel_cv_;
+    std::vector<std::vector<WheelEntry>> wheel_;
+    uint64_t wheel_tick_ = 0;       // last tick processed
+    int64_t wheel_start_ms_ = 0;
+    std::thread reaper_thread_;
     
     ConnectionHandler connection_handler_;
 };
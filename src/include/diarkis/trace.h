@@ -0,0 +1,121 @@
+
+#ifndef DIARKIS_TRACE_H
+#define DIARKIS_TRACE_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "diarkis/commands.h"
+#include "diarkis/slow_log.h"
+
+namespace diarkis::trace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    double sample_rate = 0.0;           // fraction of requests traced, 0 disables
+    int64_t slow_threshold_us = 100000; // traces slower than this are kept
+    size_t ring_size = 256;             // slow traces kept for the admin endpoint
+};
+
+struct Span {
+    const char* name;
+    int64_t offset_us;      // relative to the trace start
+    int64_t duration_us;
+};
+
+// A single request as seen by one node. Spans may be added from another
+// thread only while the owning thread is blocked on it (e.g. Raft commit).
+class Trace {
+public:
+    Trace(uint64_t id, commands::Type type, std::string path,
+          Clock::time_point start = Clock::now());
+
+    uint64_t id() const { return id_; }
+    commands::Type type() const { return type_; }
+    const std::string& path() const { return path_; }
+    const std::vector<Span>& spans() const { return spans_; }
+    int64_t wall_start_us() const { return wall_start_us_; }
+
+    int64_t offset_us(Clock::time_point t) const;
+    void add_span(const char* name, Clock::time_point start, Clock::time_point end);
+    void finish();
+    int64_t total_us() const { return total_us_; }
+
+private:
+    uint64_t id_;
+    commands::Type type_;
+    std::string path_;
+    Clock::time_point start_;
+    int64_t wall_start_us_;
+    int64_t total_us_ = 0;
+    std::vector<Span> spans_;
+};
+
+void configure(const Options& opts);
+
+// Returns the trace id to use for a request: the client supplied id if any,
+// a fresh id if the request is sampled, otherwise 0.
+uint64_t sample(uint64_t requested_id);
+
+// Finishes the trace and stores it in the slow trace ring if it qualifies.
+void submit(std::unique_ptr<Trace> trace);
+
+// Trace of the request being processed on this thread, or nullptr.
+Trace* current();
+
+class ScopedTrace {
+public:
+    explicit ScopedTrace(Trace* trace);
+    ~ScopedTrace();
+
+    ScopedTrace(const ScopedTrace&) = delete;
+    ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+private:
+    Trace* previous_;
+};
+
+// Records a span on the current trace and, when a stage is given, adds its
+// duration to the current slow log timings. A no-op when neither is active.
+class ScopedSpan {
+public:
+    explicit ScopedSpan(const char* name, slowlog::Stage stage = slowlog::Stage::COUNT)
+        : name_(name), stage_(stage), trace_(current()),
+          timings_(stage != slowlog::Stage::COUNT ? slowlog::current() : nullptr) {
+        if (trace_ || timings_) start_ = Clock::now();
+    }
+    ~ScopedSpan() { finish(); }
+
+    void finish() {
+        if (!trace_ && !timings_) {
+            return;
+        }
+        auto end = Clock::now();
+        if (trace_) {
+            trace_->add_span(name_, start_, end);
+        }
+        if (timings_) {
+            timings_->add(stage_, std::chrono::duration_cast<std::chrono::microseconds>(end - start_).count());
+        }
+        trace_ = nullptr;
+        timings_ = nullptr;
+    }
+
+    ScopedSpan(const ScopedSpan&) = delete;
+    ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+    const char* name_;
+    slowlog::Stage stage_;
+    Trace* trace_;
+    slowlog::Timings* timings_;
+    Clock::time_point start_;
+};
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+
+#ifndef DIARKIS_WORKER_POOL_H
+#define DIARKIS_WORKER_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace diarkis {
+
+// A fixed set of threads shared by all connections. Work is only handed to
+// a thread that is idle, so callers run it inline instead of queueing
+// behind other connections when the pool is saturated.
+class WorkerPool {
+public:
+    explicit WorkerPool(size_t threads);
+    ~WorkerPool();
+    
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    
+    // Starts task on an idle thread, or returns false at once if none is
+    // idle. The task must not throw.
+    bool try_run(std::function<void()> task);
+    
+    size_t size() const { return threads_.size(); }
+
+private:
+    void run();
+    
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> tasks_;
+    size_t idle_ = 0;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+}
+
+#endif
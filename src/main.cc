@@ -3,22 +3,31 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <filesystem>
 #include <memory>
 
 #include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
 #include "gflags/gflags.h"
 
 #include "diarkis/state_machine.h"
 #include "diarkis/rpc.h"
+#include "diarkis/brpc_server.h"
 #include "diarkis/config.h"
+#include "diarkis/trace.h"
+#include "diarkis/slow_log.h"
 
 DEFINE_string(config, "", "Path to YAML configuration file");
 DEFINE_string(log_level, "info", "Log level (trace, debug, info, warn, error, critical)");
+DEFINE_int32(log_queue_size, 8192, "Async log queue capacity (messages)");
+DEFINE_string(log_overflow, "drop", "Behaviour when the log queue is full (drop, block)");
 
 namespace {
     std::atomic<bool> g_running{true};
     std::shared_ptr<diarkis::StateMachine> g_state_machine;
     std::shared_ptr<diarkis::RpcServer> g_rpc_server;
+    std::shared_ptr<diarkis::BrpcServer> g_brpc_server;
 }
 
 void signal_handler(int signum) {
@@ -35,6 +44,20 @@ void setup_signal_handlers() {
 }
 
 void setup_logging(const std::string& level) {
+    // Log lines are formatted and written by a background thread so request
+    // threads never block on stdout
+    size_t queue_size = FLAGS_log_queue_size > 0 ? static_cast<size_t>(FLAGS_log_queue_size) : 8192;
+    spdlog::init_thread_pool(queue_size, 1);
+    
+    auto overflow = FLAGS_log_overflow == "block"
+        ? spdlog::async_overflow_policy::block
+        : spdlog::async_overflow_policy::overrun_oldest;
+    auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto logger = std::make_shared<spdlog::async_logger>(
+        "diarkis", sink, spdlog::thread_pool(), overflow);
+    spdlog::set_default_logger(logger);
+    spdlog::flush_on(spdlog::level::err);
+    
     spdlog::set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%^%l%$] [%t] %v");
     
     // Set log level
@@ -54,6 +77,10 @@ void setup_logging(const std::string& level) {
         spdlog::warn("Unknown log level '{}', using 'info'", level);
         spdlog::set_level(spdlog::level::info);
     }
+    
+    if (FLAGS_log_overflow != "drop" && FLAGS_log_overflow != "block") {
+        spdlog::warn("Unknown log overflow policy '{}', using 'drop'", FLAGS_log_overflow);
+    }
 }
 
 diarkis::Result<diarkis::ServerConfig> load_configuration() {
@@ -74,6 +101,37 @@ diarkis::Result<diarkis::ServerConfig> load_configuration() {
     return config;
 }
 
+void initialize_tracing(const diarkis::ServerConfig& config) {
+    diarkis::trace::Options opts;
+    opts.sample_rate = config.trace_sample_rate;
+    opts.slow_threshold_us = static_cast<int64_t>(config.trace_slow_threshold_ms) * 1000;
+    opts.ring_size = static_cast<size_t>(config.trace_ring_size);
+    diarkis::trace::configure(opts);
+    
+    spdlog::info("Tracing: sample_rate={}, slow_threshold_ms={}", 
+                 config.trace_sample_rate, config.trace_slow_threshold_ms);
+}
+
+void initialize_slow_log(const diarkis::ServerConfig& config) {
+    // Resolved once, so the log does not depend on the working directory
+    std::filesystem::path path = config.slow_log_path.empty()
+        ? std::filesystem::path(config.raft_path) / "slow_ops.log"
+        : std::filesystem::path(config.slow_log_path);
+    std::error_code ec;
+    std::filesystem::path absolute = std::filesystem::absolute(path, ec);
+    
+    diarkis::slowlog::Options opts;
+    opts.threshold_us = static_cast<int64_t>(config.slow_log_threshold_ms) * 1000;
+    opts.path = ec ? path.string() : absolute.lexically_normal().string();
+    opts.queue_size = static_cast<size_t>(config.slow_log_queue_size);
+    diarkis::slowlog::configure(opts);
+    
+    if (opts.threshold_us > 0) {
+        spdlog::info("Slow op log: {} (threshold {} ms)", 
+                     opts.path, config.slow_log_threshold_ms);
+    }
+}
+
 diarkis::Result<void> initialize_state_machine(const diarkis::ServerConfig& config) {
     spdlog::info("Initializing state machine...");
     
@@ -91,6 +149,16 @@ diarkis::Result<void> initialize_state_machine(const diarkis::ServerConfig& conf
     sm_opts.initial_conf = config.initial_conf;
     sm_opts.election_timeout_ms = config.election_timeout_ms;
     sm_opts.snapshot_interval_s = config.snapshot_interval_s;
+    sm_opts.max_pending_tasks = config.raft_max_pending_tasks;
+    sm_opts.max_pending_bytes = static_cast<int64_t>(config.raft_max_pending_mb) * 1024 * 1024;
+    sm_opts.compact_log = config.raft_compact_log;
+    sm_opts.compression_threshold = static_cast<size_t>(config.compression_threshold_bytes);
+    diarkis::commands::compression::parse(config.compression_raft, sm_opts.log_compression);
+    if (!diarkis::commands::compression::available(sm_opts.log_compression)) {
+        spdlog::warn("Raft log compression '{}' is not available in this build, disabled",
+                     config.compression_raft);
+        sm_opts.log_compression = diarkis::commands::compression::Algorithm::NONE;
+    }
     
     g_state_machine = std::make_shared<diarkis::StateMachine>(sm_opts);
     
@@ -107,8 +175,33 @@ diarkis::Result<void> initialize_state_machine(const diarkis::ServerConfig& conf
 diarkis::Result<void> initialize_rpc_server(const diarkis::ServerConfig& config) {
     spdlog::info("Initializing RPC server...");
     
+    diarkis::RpcServer::Options rpc_opts;
+    rpc_opts.max_inflight_bytes = static_cast<size_t>(config.rpc_max_inflight_mb) * 1024 * 1024;
+    rpc_opts.max_request_bytes = static_cast<size_t>(config.rpc_max_request_mb) * 1024 * 1024;
+    rpc_opts.admission_wait_ms = config.rpc_admission_wait_ms;
+    rpc_opts.max_batch_commands = static_cast<size_t>(config.rpc_max_batch_commands);
+    rpc_opts.batch_read_threads = static_cast<size_t>(config.rpc_batch_read_threads);
+    rpc_opts.idle_timeout_sec = config.rpc_idle_timeout_s;
+    rpc_opts.listeners = config.rpc_listeners;
+    rpc_opts.pin_listeners = config.rpc_pin_listeners;
+    rpc_opts.unix_path = config.rpc_unix_path;
+    rpc_opts.unix_socket_mode = static_cast<uint32_t>(config.unix_socket_mode());
+    rpc_opts.shared_memory = config.rpc_shared_memory;
+    rpc_opts.compression_threshold = static_cast<size_t>(config.compression_threshold_bytes);
+    rpc_opts.lanes.max_active = static_cast<size_t>(config.lanes_max_active);
+    rpc_opts.lanes.bulk_max_active = static_cast<size_t>(config.lanes_bulk_max_active);
+    rpc_opts.lanes.interactive_weight = static_cast<uint32_t>(config.lanes_interactive_weight);
+    rpc_opts.bulk_threshold = static_cast<size_t>(config.lanes_bulk_threshold_kb) * 1024;
+    rpc_opts.rate_limit.ops_per_sec = config.rate_limit_ops_per_sec;
+    rpc_opts.rate_limit.bytes_per_sec = config.rate_limit_mb_per_sec * 1024 * 1024;
+    rpc_opts.rate_limit.burst_sec = config.rate_limit_burst_ms / 1000.0;
+    rpc_opts.rate_limit_per_connection = config.rate_limit_per == "connection";
+    if (!config.compression_wire) {
+        rpc_opts.capabilities &= ~(diarkis::commands::CAP_LZ4 | diarkis::commands::CAP_ZSTD);
+    }
+    
     g_rpc_server = std::make_shared<diarkis::RpcServer>(
-        config.rpc_addr, config.rpc_port, g_state_machine);
+        config.rpc_addr, config.rpc_port, g_state_machine, rpc_opts);
     
     if (!g_rpc_server->start()) {
         g_rpc_server.reset();
@@ -120,9 +213,44 @@ diarkis::Result<void> initialize_rpc_server(const diarkis::ServerConfig& config)
     return diarkis::Result<void>();
 }
 
+diarkis::Result<void> initialize_brpc_server(const diarkis::ServerConfig& config) {
+    if (config.brpc_port == 0) {
+        return diarkis::Result<void>();
+    }
+    
+    diarkis::BrpcServer::Options brpc_opts;
+    brpc_opts.num_threads = config.brpc_num_threads;
+    brpc_opts.max_concurrency = config.brpc_max_concurrency;
+    brpc_opts.max_request_bytes = static_cast<size_t>(config.rpc_max_request_mb) * 1024 * 1024;
+    brpc_opts.http_gateway = config.brpc_http_gateway;
+    brpc_opts.http_max_range_bytes = static_cast<size_t>(config.brpc_http_max_range_mb) * 1024 * 1024;
+    brpc_opts.admission.budget = &g_rpc_server->inflight_budget();
+    brpc_opts.admission.lanes = &g_rpc_server->lanes();
+    brpc_opts.admission.rate_limiter = &g_rpc_server->rate_limiter();
+    brpc_opts.admission.wait_ms = config.rpc_admission_wait_ms;
+    brpc_opts.admission.bulk_threshold = static_cast<size_t>(config.lanes_bulk_threshold_kb) * 1024;
+    
+    g_brpc_server = std::make_shared<diarkis::BrpcServer>(
+        config.rpc_addr, config.brpc_port, g_state_machine, brpc_opts);
+    
+    if (!g_brpc_server->start()) {
+        g_brpc_server.reset();
+        return diarkis::Error(diarkis::ErrorCode::NetworkError,
+                            "Failed to start brpc server");
+    }
+    
+    return diarkis::Result<void>();
+}
+
 void shutdown_server() {
     spdlog::info("Shutting down server components...");
     
+    if (g_brpc_server) {
+        spdlog::info("Stopping brpc server...");
+        g_brpc_server->stop();
+        g_brpc_server.reset();
+    }
+    
     if (g_rpc_server) {
         spdlog::info("Stopping RPC server...");
         g_rpc_server->stop();
@@ -137,6 +265,8 @@ void shutdown_server() {
         spdlog::info("State machine shutdown complete");
     }
     
+    diarkis::slowlog::shutdown();
+    
     spdlog::info("Server shutdown complete");
 }
 
@@ -155,6 +285,7 @@ int main(int argc, char* argv[]) {
     if (!config_result.ok()) {
         spdlog::error("Configuration error: {}", config_result.error().to_string());
         gflags::ShutDownCommandLineFlags();
+        spdlog::shutdown();
         return 1;
     }
     
@@ -165,6 +296,15 @@ int main(int argc, char* argv[]) {
     spdlog::info("  Group ID: {}", config.group_id);
     spdlog::info("  Peer address: {}", config.peer_addr);
     spdlog::info("  RPC address: {}:{}", config.rpc_addr, config.rpc_port);
+    if (!config.rpc_unix_path.empty()) {
+        spdlog::info("  RPC unix socket: {}", config.rpc_unix_path);
+    }
+    if (config.brpc_port != 0) {
+        spdlog::info("  brpc address: {}:{}", config.rpc_addr, config.brpc_port);
+    }
+    
+    initialize_tracing(config);
+    initialize_slow_log(config);
     
     // Initialize state machine
     auto sm_result = initialize_state_machine(config);
@@ -172,6 +312,7 @@ int main(int argc, char* argv[]) {
         spdlog::error("Failed to initialize state machine: {}", 
                      sm_result.error().to_string());
         gflags::ShutDownCommandLineFlags();
+        spdlog::shutdown();
         return 1;
     }
     
@@ -182,6 +323,17 @@ int main(int argc, char* argv[]) {
                      rpc_result.error().to_string());
         shutdown_server();
         gflags::ShutDownCommandLineFlags();
+        spdlog::shutdown();
+        return 1;
+    }
+    
+    auto brpc_result = initialize_brpc_server(config);
+    if (!brpc_result.ok()) {
+        spdlog::error("Failed to initialize brpc server: {}", 
+                     brpc_result.error().to_string());
+        shutdown_server();
+        gflags::ShutDownCommandLineFlags();
+        spdlog::shutdown();
         return 1;
     }
     
@@ -198,5 +350,6 @@ int main(int argc, char* argv[]) {
     
     gflags::ShutDownCommandLineFlags();
     spdlog::info("Goodbye!");
+    spdlog::shutdown();
     return 0;
 }
@@ -0,0 +1,97 @@
+
+#include "diarkis/metrics.h"
+#include "bvar/bvar.h"
+#include <array>
+#include <cstring>
+#include <memory>
+#include <string>
+
+namespace diarkis::metrics {
+
+namespace {
+    constexpr size_t MAX_COMMAND_TYPES = 32;
+    constexpr size_t NUM_STAGES = static_cast<size_t>(Stage::COUNT);
+
+    struct CommandMetrics {
+        std::array<bvar::LatencyRecorder, NUM_STAGES> stages;
+        bvar::Adder<int64_t> errors;
+        bvar::Adder<int64_t> bytes_in;
+        bvar::Adder<int64_t> bytes_out;
+    };
+
+    class Registry {
+    public:
+        Registry() {
+            for (size_t i = 1; i < MAX_COMMAND_TYPES; ++i) {
+                const char* name = commands::type_name(static_cast<commands::Type>(i));
+                if (std::strcmp(name, "unknown") == 0) {
+                    continue;
+                }
+                
+                auto metrics = std::make_unique<CommandMetrics>();
+                std::string prefix = std::string("diarkis_") + name;
+                for (size_t s = 0; s < NUM_STAGES; ++s) {
+                    metrics->stages[s].expose(prefix + "_" + stage_name(static_cast<Stage>(s)));
+                }
+                metrics->errors.expose(prefix + "_errors");
+                metrics->bytes_in.expose(prefix + "_bytes_in");
+                metrics->bytes_out.expose(prefix + "_bytes_out");
+                
+                commands_[i] = std::move(metrics);
+            }
+        }
+        
+        CommandMetrics* get(commands::Type type) {
+            size_t index = static_cast<size_t>(type);
+            return index < MAX_COMMAND_TYPES ? commands_[index].get() : nullptr;
+        }
+
+    private:
+        std::array<std::unique_ptr<CommandMetrics>, MAX_COMMAND_TYPES> commands_;
+    };
+    
+    Registry& registry() {
+        static Registry instance;
+        return instance;
+    }
+}
+
+const char* stage_name(Stage stage) {
+    switch (stage) {
+        case Stage::Receive: return "receive";
+        case Stage::Decode: return "decode";
+        case Stage::Commit: return "commit";
+        case Stage::Apply: return "apply";
+        case Stage::Storage: return "storage";
+        case Stage::Send: return "send";
+        case Stage::Total: return "total";
+        default: return "unknown";
+    }
+}
+
+void record_latency(commands::Type type, Stage stage, int64_t latency_us) {
+    auto* metrics = registry().get(type);
+    if (metrics && stage < Stage::COUNT) {
+        metrics->stages[static_cast<size_t>(stage)] << latency_us;
+    }
+}
+
+void record_request(commands::Type type, size_t request_bytes) {
+    auto* metrics = registry().get(type);
+    if (metrics) {
+        metrics->bytes_in << static_cast<int64_t>(request_bytes);
+    }
+}
+
+void record_response(commands::Type type, bool success, size_t payload_bytes) {
+    auto* metrics = registry().get(type);
+    if (!metrics) {
+        return;
+    }
+    if (!success) {
+        metrics->errors << 1;
+    }
+    metrics->bytes_out << static_cast<int64_t>(payload_bytes);
+}
+
+}
@@ -0,0 +1,56 @@
+
+#include "diarkis/path.h"
+#include <sstream>
+#include <vector>
+
+namespace diarkis {
+
+bool is_safe_path(const std::string& path) {
+    if (!path.empty() && path[0] == '/') {
+        return false;
+    }
+    
+    std::vector<std::string> components;
+    std::istringstream iss(path);
+    std::string component;
+    
+    while (std::getline(iss, component, '/')) {
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        
+        if (component == "..") {
+            return false;
+        }
+        
+        components.push_back(component);
+    }
+    
+    for (const auto& comp : components) {
+        if (comp.find('\0') != std::string::npos) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+std::string normalize_path(const std::string& path) {
+    std::string result;
+    std::istringstream iss(path);
+    std::string component;
+    
+    while (std::getline(iss, component, '/')) {
+        if (component.empty() || component == ".") {
+            continue;
+        }
+        if (!result.empty()) {
+            result += '/';
+        }
+        result += component;
+    }
+    
+    return result;
+}
+
+}
@@ -1,11 +1,105 @@
 
 #include "diarkis/rpc.h"
+#include "diarkis/metrics.h"
+#include "diarkis/trace.h"
+#include "diarkis/slow_log.h"
+#include "diarkis/log.h"
 #include "spdlog/spdlog.h"
 #include "msgpack.hpp"
 #include <arpa/inet.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <optional>
+#include <thread>
+#include <unistd.h>
 
 namespace diarkis {
 
+namespace {
+    constexpr size_t MAX_RETAINED_BUFFER = 64 * 1024;
+    
+    // Fewer batched reads than this per thread are not worth a thread
+    constexpr size_t MIN_READS_PER_THREAD = 8;
+    
+    // Longer HELLO client ids are ignored
+    constexpr size_t MAX_CLIENT_ID = 256;
+    
+    // A HELLO is four fields; anything larger is rejected before unpacking
+    constexpr size_t MAX_HELLO_SIZE = 1024;
+    
+    // Bound on a whole HELLO frame: the Hello plus the command's header and
+    // empty paths. Larger frames are rate limited before they are received.
+    constexpr size_t MAX_HELLO_FRAME = MAX_HELLO_SIZE + 64;
+    
+    // How long a response may wait for room in a client's shared memory ring
+    constexpr int SHM_SEND_TIMEOUT_MS = 30000;
+    
+    // Each connection thread reuses its receive buffer and decoder zone, so
+    // small requests avoid malloc entirely; large buffers are not kept
+    thread_local std::vector<uint8_t> t_request_data;
+    thread_local commands::codec::Decoder t_decoder;
+    
+    // Descriptors passed with ATTACH_SHM, closed unless released to a channel
+    struct PassedFds {
+        int fds[3] = {-1, -1, -1};
+        int count = 0;
+        
+        PassedFds() = default;
+        PassedFds(const PassedFds&) = delete;
+        PassedFds& operator=(const PassedFds&) = delete;
+        ~PassedFds() {
+            for (int i = 0; i < count; ++i) {
+                ::close(fds[i]);
+            }
+        }
+        
+        void release() { count = 0; }
+    };
+    
+    // Payload bytes of a response, including those of batched results
+    size_t response_bytes(const commands::Response& resp) {
+        size_t bytes = resp.data.size();
+        for (const auto& result : resp.results) {
+            bytes += result.data.size();
+        }
+        return bytes;
+    }
+    
+    // Memory a response holds in file contents and directory entries
+    size_t held_bytes(const commands::Response& resp) {
+        size_t bytes = resp.data.size();
+        for (const auto& entry : resp.entries) {
+            bytes += entry.size();
+        }
+        return bytes;
+    }
+    
+    struct BufferTrim {
+        ~BufferTrim() {
+            if (t_request_data.capacity() > MAX_RETAINED_BUFFER) {
+                std::vector<uint8_t>().swap(t_request_data);
+            }
+            t_decoder.trim(MAX_RETAINED_BUFFER);
+        }
+    };
+    
+    // msgpack streams used to pack a response straight into a ring
+    struct CountingStream {
+        size_t size = 0;
+        void write(const char*, size_t n) { size += n; }
+    };
+    
+    struct MemoryStream {
+        uint8_t* out;
+        void write(const char* data, size_t n) {
+            std::memcpy(out, data, n);
+            out += n;
+        }
+    };
+}
+
 bool MessageProtocol::receive_length(std::shared_ptr<TcpConnection> conn, uint32_t& length) {
     uint32_t length_net;
     if (!conn->receive_exact(&length_net, sizeof(length_net))) {
@@ -15,7 +109,7 @@ bool MessageProtocol::receive_length(std::shared_ptr<TcpConnection> conn, uint32
     length = ntohl(length_net);
     
     if (length == 0 || length > MAX_MESSAGE_SIZE) {
-        spdlog::error("Invalid message length: {}", length);
+        DIARKIS_ERROR_RATE_LIMITED("Invalid message length: {}", length);
         return false;
     }
     
@@ -28,20 +122,38 @@ bool MessageProtocol::receive_data(std::shared_ptr<TcpConnection> conn,
     return conn->receive_exact(data.data(), length);
 }
 
+bool MessageProtocol::discard_data(std::shared_ptr<TcpConnection> conn, size_t length) {
+    uint8_t scratch[64 * 1024];
+    while (length > 0) {
+        size_t chunk = std::min(length, sizeof(scratch));
+        if (!conn->receive_exact(scratch, chunk)) {
+            return false;
+        }
+        length -= chunk;
+    }
+    return true;
+}
+
 bool MessageProtocol::receive_message(std::shared_ptr<TcpConnection> conn, 
-                                     std::vector<uint8_t>& message) {
+                                     std::vector<uint8_t>& message,
+                                     int64_t* receive_us) {
     uint32_t length;
     if (!receive_length(conn, length)) {
         return false;
     }
     
-    return receive_data(conn, message, length);
+    metrics::Stopwatch watch;
+    bool ok = receive_data(conn, message, length);
+    if (receive_us) {
+        *receive_us = watch.elapsed_us();
+    }
+    return ok;
 }
 
 bool MessageProtocol::send_message(std::shared_ptr<TcpConnection> conn, 
                                   const std::vector<uint8_t>& message) {
     if (message.size() > MAX_MESSAGE_SIZE) {
-        spdlog::error("Message too large: {} bytes", message.size());
+        DIARKIS_ERROR_RATE_LIMITED("Message too large: {} bytes", message.size());
         return false;
     }
     
@@ -58,18 +170,72 @@ bool MessageProtocol::send_message(std::shared_ptr<TcpConnection> conn,
 // RpcServer implementation
 RpcServer::RpcServer(const std::string& address, uint16_t port, 
                      std::shared_ptr<StateMachine> state_machine)
-    : state_machine_(std::move(state_machine)) {
+    : RpcServer(address, port, std::move(state_machine), Options()) {
+}
+
+RpcServer::RpcServer(const std::string& address, uint16_t port, 
+                     std::shared_ptr<StateMachine> state_machine,
+                     const Options& options)
+    : options_(options),
+      state_machine_(std::move(state_machine)),
+      inflight_budget_(options.max_inflight_bytes),
+      lanes_(options.lanes),
+      rate_limiter_(options.rate_limit) {
+    
+    if (!options_.shared_memory) {
+        options_.capabilities &= ~static_cast<uint32_t>(commands::CAP_SHM);
+    }
+    
+    // A request larger than the whole budget could never be admitted
+    options_.max_request_bytes = std::min({options_.max_request_bytes,
+                                           options_.max_inflight_bytes,
+                                           MessageProtocol::MAX_MESSAGE_SIZE});
+    
+    busy_rejections_.expose("diarkis_rpc_busy_rejections");
+    oversize_rejections_.expose("diarkis_rpc_oversize_rejections");
+    inflight_bytes_ = std::make_unique<bvar::PassiveStatus<int64_t>>(
+        "diarkis_rpc_inflight_bytes", &RpcServer::get_inflight_bytes, this);
+    
+    for (size_t i = 0; i < LANE_COUNT; ++i) {
+        lane_waits_[i].expose(std::string("diarkis_rpc_lane_") + lane_name(static_cast<Lane>(i)) + "_wait");
+    }
+    const std::pair<const char*, int64_t (*)(void*)> gauges[] = {
+        {"diarkis_rpc_lane_interactive_active", &RpcServer::get_interactive_active},
+        {"diarkis_rpc_lane_interactive_queued", &RpcServer::get_interactive_queued},
+        {"diarkis_rpc_lane_bulk_active", &RpcServer::get_bulk_active},
+        {"diarkis_rpc_lane_bulk_queued", &RpcServer::get_bulk_queued},
+    };
+    for (const auto& [name, getter] : gauges) {
+        lane_gauges_.push_back(std::make_unique<bvar::PassiveStatus<int64_t>>(name, getter, this));
+    }
+    
+    throttle_rejections_.expose("diarkis_rpc_throttle_rejections");
+    throttle_delays_.expose("diarkis_rpc_throttle_delay");
+    rate_limited_clients_ = std::make_unique<bvar::PassiveStatus<int64_t>>(
+        "diarkis_rpc_rate_limited_clients", &RpcServer::get_rate_limited_clients, this);
+    
+    read_pool_ = std::make_unique<WorkerPool>(options_.batch_read_threads);
     
     TcpServer::Options opts;
     opts.address = address;
     opts.port = port;
+    opts.idle_timeout_sec = options_.idle_timeout_sec;
+    opts.listeners = options_.listeners;
+    opts.pin_listeners = options_.pin_listeners;
     
+    auto handler = [this](std::shared_ptr<TcpConnection> conn) {
+        this->handle_connection(conn);
+    };
     tcp_server_ = std::make_unique<TcpServer>(opts);
-    tcp_server_->set_connection_handler(
-        [this](std::shared_ptr<TcpConnection> conn) {
-            this->handle_connection(conn);
-        }
-    );
+    tcp_server_->set_connection_handler(handler);
+    
+    // Local clients skip the loopback TCP stack; the protocol is the same
+    if (!options_.unix_path.empty()) {
+        opts.unix_path = options_.unix_path;
+        opts.unix_socket_mode = options_.unix_socket_mode;
+        unix_server_ = std::make_unique<TcpServer>(opts);
+        unix_server_->set_connection_handler(handler);
+    }
 }
 
 RpcServer::~RpcServer() {
@@ -78,11 +244,21 @@ RpcServer::~RpcServer() {
 
 bool RpcServer::start() {
     spdlog::info("Starting RPC server");
-    return tcp_server_->start();
+    if (!tcp_server_->start()) {
+        return false;
+    }
+    if (unix_server_ && !unix_server_->start()) {
+        tcp_server_->stop();
+        return false;
+    }
+    return true;
 }
 
 void RpcServer::stop() {
     spdlog::info("Stopping RPC server");
+    if (unix_server_) {
+        unix_server_->stop();
+    }
     if (tcp_server_) {
         tcp_server_->stop();
     }
@@ -93,65 +269,626 @@ bool RpcServer::is_running() const {
 }
 
 size_t RpcServer::active_connections() const {
-    return tcp_server_ ? tcp_server_->active_connections() : 0;
+    size_t count = tcp_server_ ? tcp_server_->active_connections() : 0;
+    if (unix_server_) {
+        count += unix_server_->active_connections();
+    }
+    return count;
 }
 
 void RpcServer::handle_connection(std::shared_ptr<TcpConnection> conn) {
-    spdlog::info("New RPC connection from {}:{}", 
+    SPDLOG_DEBUG("New RPC connection from {}:{}", 
                  conn->remote_address(), conn->remote_port());
     
+    Session session;
+    session.local = conn->is_local();
+    if (options_.rate_limit_per_connection) {
+        set_client(session, "conn:" + std::to_string(next_connection_.fetch_add(1)));
+    } else {
+        set_client(session, conn->peer_identity());
+    }
     while (conn->is_connected()) {
-        if (!process_request(conn)) {
-            if (conn->is_connected()) {
-                spdlog::error("Failed to process request from {}:{}", 
+        bool ok = session.shm ? process_shm_request(conn, session) : process_request(conn, session);
+        if (!ok) {
+            if (conn->is_connected() && !session.closing) {
+                DIARKIS_ERROR_RATE_LIMITED("Failed to process request from {}:{}", 
                              conn->remote_address(), conn->remote_port());
             }
             break;
         }
     }
     
-    spdlog::info("RPC connection closed: {}:{}", 
+    SPDLOG_DEBUG("RPC connection closed: {}:{}", 
                  conn->remote_address(), conn->remote_port());
 }
 
-bool RpcServer::process_request(std::shared_ptr<TcpConnection> conn) {
-    std::vector<uint8_t> request_data;
+int64_t RpcServer::get_inflight_bytes(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->inflight_budget_.in_use());
+}
+
+int64_t RpcServer::get_interactive_active(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->lanes_.active(Lane::INTERACTIVE));
+}
+
+int64_t RpcServer::get_interactive_queued(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->lanes_.queued(Lane::INTERACTIVE));
+}
+
+int64_t RpcServer::get_bulk_active(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->lanes_.active(Lane::BULK));
+}
+
+int64_t RpcServer::get_bulk_queued(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->lanes_.queued(Lane::BULK));
+}
+
+int64_t RpcServer::get_rate_limited_clients(void* arg) {
+    return static_cast<int64_t>(static_cast<RpcServer*>(arg)->rate_limiter_.clients());
+}
+
+void RpcServer::set_client(Session& session, std::string client) {
+    session.client_key = std::hash<std::string>()(client);
+    session.client = std::move(client);
+}
+
+bool RpcServer::reject_request(std::shared_ptr<TcpConnection> conn, const Session& session, size_t length,
+                               commands::Status status, const std::string& error) {
+    // Keep the stream in sync so the client can read the rejection and retry
+    if (!MessageProtocol::discard_data(conn, length)) {
+        return false;
+    }
+    
+    commands::Response resp;
+    resp.success = false;
+    resp.status = status;
+    resp.error = error;
+    return send_response(conn, session, resp);
+}
+
+bool RpcServer::reject_oversize(std::shared_ptr<TcpConnection> conn, const Session& session, size_t length) {
+    oversize_rejections_ << 1;
+    return reject_request(conn, session, length, commands::Status::ERROR,
+                          "Request exceeds " + std::to_string(options_.max_request_bytes) + " bytes");
+}
+
+bool RpcServer::throttle(Session& session, size_t length) {
+    // HELLO is optional, so a small first frame is charged once it has been
+    // decoded and turns out to be something else; a HELLO is never charged
+    session.uncharged = session.requests++ == 0 && !session.negotiated &&
+                        length <= MAX_HELLO_FRAME;
+    if (session.uncharged) {
+        return true;
+    }
+    return charge(session, length);
+}
+
+bool RpcServer::charge(Session& session, size_t length) {
+    if (!rate_limiter_.enabled()) {
+        return true;
+    }
     
-    if (!MessageProtocol::receive_message(conn, request_data)) {
+    std::chrono::microseconds delay{0};
+    if (!rate_limiter_.acquire(session.client, length,
+                               std::chrono::milliseconds(options_.admission_wait_ms), delay)) {
+        throttle_rejections_ << 1;
         return false;
     }
+    if (delay.count() > 0) {
+        throttle_delays_ << delay.count();
+        std::this_thread::sleep_for(delay);
+    }
+    return true;
+}
+
+commands::Response RpcServer::handle_hello(const commands::CommandView& cmd, Session& session) {
+    commands::Response resp;
+    if (session.negotiated) {
+        resp.success = false;
+        resp.error = "HELLO already negotiated";
+        return resp;
+    }
+    
+    // Unpacked with limits so a malformed HELLO cannot make the server
+    // allocate; Hello is a flat array of four fields
+    commands::Hello offered;
+    bool valid = cmd.contents_size <= MAX_HELLO_SIZE;
+    if (valid) {
+        try {
+            msgpack::unpack_limit limit(8, 0, MAX_HELLO_SIZE, 0, 0, 2);
+            msgpack::object_handle oh = msgpack::unpack(
+                reinterpret_cast<const char*>(cmd.contents), cmd.contents_size, nullptr, nullptr, limit);
+            oh.get().convert(offered);
+        } catch (const std::exception&) {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        resp.success = false;
+        resp.error = Error(ErrorCode::InvalidCommand, "Malformed HELLO").to_string();
+        return resp;
+    }
+    
+    commands::Hello accepted;
+    accepted.version = std::min(offered.version, commands::PROTOCOL_VERSION);
+    accepted.capabilities = offered.capabilities & options_.capabilities;
+    accepted.max_frame_size = static_cast<uint32_t>(options_.max_request_bytes);
+    
+    // Version 0 peers only know about compression
+    if (accepted.version == 0) {
+        accepted.capabilities &= commands::CAP_LZ4 | commands::CAP_ZSTD;
+    }
+    if (!session.local) {
+        accepted.capabilities &= ~static_cast<uint32_t>(commands::CAP_SHM);
+    }
+    // The id is chosen by the client, so it only labels the connection in
+    // logs; rate limits stay keyed on the peer's identity
+    if (!offered.client_id.empty() && offered.client_id.size() <= MAX_CLIENT_ID) {
+        session.label = offered.client_id;
+    }
+    
+    session.negotiated = true;
+    session.version = accepted.version;
+    session.capabilities = accepted.capabilities;
+    session.compression = commands::pick_compression(accepted.capabilities);
+    if (offered.max_frame_size > 0) {
+        session.max_response_bytes = std::min<size_t>(offered.max_frame_size, 
+                                                      MessageProtocol::MAX_MESSAGE_SIZE);
+    }
+    
+    SPDLOG_DEBUG("Hello from {} ({}): version={}, offered caps={:#x}, accepted caps={:#x}", 
+                 session.client, session.label, accepted.version, offered.capabilities,
+                 accepted.capabilities);
+    
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, accepted);
+    resp.success = true;
+    resp.data.assign(sbuf.data(), sbuf.data() + sbuf.size());
+    return resp;
+}
+
+commands::Response RpcServer::handle_attach_shm(std::shared_ptr<TcpConnection> conn, Session& session) {
+    commands::Response resp;
+    resp.success = false;
+    
+    // The descriptors ride on a single byte sent right after the request.
+    // Peers that may not attach never get them into this process; the byte
+    // is left unread, so the connection ends with this response.
+    if (!(session.capabilities & commands::CAP_SHM) || session.shm) {
+        resp.error = session.shm ? "Shared memory already attached" : "Shared memory not negotiated";
+        session.closing = true;
+        return resp;
+    }
+    
+    PassedFds passed;
+    passed.count = conn->receive_fds(passed.fds, 3);
+    if (passed.count < 0) {
+        passed.count = 0;
+        resp.error = "Failed to receive shared memory descriptors";
+        return resp;
+    }
+    if (passed.count != 3) {
+        resp.error = "Expected 3 descriptors";
+        return resp;
+    }
+    
+    // The channel owns the descriptors from here, even if attaching fails
+    std::string error;
+    passed.release();
+    session.pending_shm = commands::shm::Channel::attach(passed.fds[0], passed.fds[1], passed.fds[2], error);
+    if (!session.pending_shm) {
+        resp.error = error;
+        return resp;
+    }
+    resp.success = true;
+    return resp;
+}
+
+void RpcServer::compress_response(commands::Response& resp, const Session& session) {
+    if (session.compression == commands::compression::Algorithm::NONE ||
+        resp.data.size() < options_.compression_threshold) {
+        return;
+    }
+    
+    thread_local std::vector<uint8_t> compressed;
+    if (commands::compression::compress(session.compression, resp.data.data(), 
+                                        resp.data.size(), compressed)) {
+        resp.data.swap(compressed);
+        resp.compression = session.compression;
+    }
+    if (compressed.capacity() > MAX_RETAINED_BUFFER) {
+        std::vector<uint8_t>().swap(compressed);
+    }
+}
+
+bool RpcServer::process_request(std::shared_ptr<TcpConnection> conn, Session& session) {
+    uint32_t length;
+    if (!MessageProtocol::receive_length(conn, length)) {
+        return false;
+    }
+    
+    // Multiplexed frames start with the request id echoed in the response
+    if (session.multiplexed) {
+        uint32_t id_net;
+        if (length < sizeof(id_net) || !conn->receive_exact(&id_net, sizeof(id_net))) {
+            return false;
+        }
+        session.request_id = ntohl(id_net);
+        length -= sizeof(id_net);
+    }
+    
+    if (length > options_.max_request_bytes) {
+        return reject_oversize(conn, session, length);
+    }
+    
+    // Rate limits and budget are both waited for with the body still in the
+    // socket, so a burst of large uploads is throttled by TCP flow control
+    // rather than memory, and a delayed client holds no budget while it waits
+    if (!throttle(session, length)) {
+        return reject_request(conn, session, length, commands::Status::THROTTLED,
+                              Error(ErrorCode::Throttled).to_string());
+    }
+    
+    BudgetLease lease(inflight_budget_, length,
+                      std::chrono::milliseconds(options_.admission_wait_ms));
+    if (!lease) {
+        busy_rejections_ << 1;
+        return reject_request(conn, session, length, commands::Status::BUSY,
+                              Error(ErrorCode::Busy).to_string());
+    }
+    
+    BufferTrim trim;
+    metrics::Stopwatch receive_watch;
+    if (!MessageProtocol::receive_data(conn, t_request_data, length)) {
+        return false;
+    }
+    return serve_request(conn, session, receive_watch.elapsed_us());
+}
+
+bool RpcServer::process_shm_request(std::shared_ptr<TcpConnection> conn, Session& session) {
+    BufferTrim trim;
+    size_t length = 0;
+    
+    // Copied out of the ring, as the client could change it while it is decoded.
+    // Waiting on the ring counts as idle; the idle reaper ends the wait by
+    // shutting down the socket. As on the socket path, rate limits and then
+    // the budget are waited for before the copy, so the frame stays in the
+    // ring and a delayed or rejected client holds no buffer.
+    conn->set_waiting(true);
+    bool throttled = false;
+    BudgetLease lease;
+    bool received = session.shm->receive([&](const uint8_t* data, size_t size, uint32_t request_id) {
+        conn->set_waiting(false);
+        length = size;
+        session.request_id = request_id;
+        if (size > options_.max_request_bytes) {
+            return;
+        }
+        throttled = !throttle(session, size);
+        if (throttled) {
+            return;
+        }
+        lease = BudgetLease(inflight_budget_, size,
+                            std::chrono::milliseconds(options_.admission_wait_ms));
+        if (lease) {
+            t_request_data.assign(data, data + size);
+        }
+    }, -1, conn->socket_fd());
+    conn->set_waiting(false);
+    if (!received) {
+        return false;
+    }
+    
+    // The frame is already consumed from the ring, so nothing is discarded
+    if (length > options_.max_request_bytes) {
+        return reject_oversize(conn, session, 0);
+    }
+    if (throttled) {
+        commands::Response resp;
+        resp.success = false;
+        resp.status = commands::Status::THROTTLED;
+        resp.error = Error(ErrorCode::Throttled).to_string();
+        return send_response(conn, session, resp);
+    }
+    if (!lease) {
+        busy_rejections_ << 1;
+        commands::Response resp;
+        resp.success = false;
+        resp.status = commands::Status::BUSY;
+        resp.error = Error(ErrorCode::Busy).to_string();
+        return send_response(conn, session, resp);
+    }
+    return serve_request(conn, session, 0);
+}
+
+bool RpcServer::serve_request(std::shared_ptr<TcpConnection> conn, Session& session, int64_t receive_us) {
+    std::vector<uint8_t>& request_data = t_request_data;
+    commands::codec::Decoder& decoder = t_decoder;
+    
+    auto received_at = trace::Clock::now();
+    metrics::Stopwatch total_watch;
     
     try {
-        msgpack::object_handle oh = msgpack::unpack(
-            reinterpret_cast<const char*>(request_data.data()), 
-            request_data.size()
-        );
+        // Compressed contents are charged at their declared size before they
+        // are inflated, so a small frame cannot claim memory past the budget
+        BudgetLease inflate_lease;
+        size_t inflated = commands::codec::inflated_size(request_data.data(), request_data.size());
+        if (inflated > options_.max_request_bytes) {
+            return reject_oversize(conn, session, 0);
+        }
+        if (inflated > 0) {
+            inflate_lease = BudgetLease(inflight_budget_, inflated,
+                                        std::chrono::milliseconds(options_.admission_wait_ms));
+            if (!inflate_lease) {
+                busy_rejections_ << 1;
+                commands::Response resp;
+                resp.success = false;
+                resp.status = commands::Status::BUSY;
+                resp.error = Error(ErrorCode::Busy).to_string();
+                return send_response(conn, session, resp);
+            }
+        }
+        decoder.set_max_inflated(options_.max_request_bytes);
         
-        commands::Command cmd;
-        oh.get().convert(cmd);
+        metrics::Stopwatch decode_watch;
+        commands::CommandView cmd;
+        if (!decoder.decode(request_data.data(), request_data.size(), cmd)) {
+            DIARKIS_ERROR_RATE_LIMITED("Malformed command ({} bytes)", request_data.size());
+            send_error_response(conn, session, "Deserialization error");
+            return false;
+        }
         
-        spdlog::debug("Received command: type={}, path={}", 
+        if (session.uncharged) {
+            session.uncharged = false;
+            if (cmd.type != commands::Type::HELLO && !charge(session, request_data.size())) {
+                commands::Response resp;
+                resp.success = false;
+                resp.status = commands::Status::THROTTLED;
+                resp.error = Error(ErrorCode::Throttled).to_string();
+                return send_response(conn, session, resp);
+            }
+        }
+        
+        metrics::record_latency(cmd.type, metrics::Stage::Receive, receive_us);
+        metrics::record_latency(cmd.type, metrics::Stage::Decode, decode_watch.elapsed_us());
+        metrics::record_request(cmd.type, request_data.size());
+        
+        SPDLOG_DEBUG("Received command: type={}, path={}", 
                      static_cast<int>(cmd.type), cmd.path);
         
-        commands::Response resp = dispatch_command(cmd);
-        return send_response(conn, resp);
+        // The sampled id travels with the command into the Raft log
+        cmd.trace_id = trace::sample(cmd.trace_id);
+        std::unique_ptr<trace::Trace> request_trace;
+        if (cmd.trace_id != 0) {
+            auto receive_start = received_at - std::chrono::microseconds(receive_us);
+            request_trace = std::make_unique<trace::Trace>(cmd.trace_id, cmd.type,
+                                                           std::string(cmd.path), receive_start);
+            request_trace->add_span("rpc.receive", receive_start, received_at);
+            request_trace->add_span("rpc.decode", received_at, trace::Clock::now());
+        }
+        
+        // HELLO and ATTACH_SHM only touch the session, so they are not
+        // queued; rate limits were already applied by throttle()
+        std::optional<LaneSlot> slot;
+        bool scheduled = cmd.type != commands::Type::HELLO && cmd.type != commands::Type::ATTACH_SHM;
+        if (scheduled) {
+            Lane lane = classify(cmd);
+            auto queued_at = trace::Clock::now();
+            metrics::Stopwatch lane_watch;
+            slot.emplace(lanes_, lane, session.client_key, request_data.size(),
+                         std::chrono::milliseconds(options_.admission_wait_ms));
+            lane_waits_[static_cast<size_t>(lane)] << lane_watch.elapsed_us();
+            if (request_trace) {
+                request_trace->add_span("rpc.queue", queued_at, trace::Clock::now());
+            }
+            if (!*slot) {
+                busy_rejections_ << 1;
+                commands::Response resp;
+                resp.success = false;
+                resp.status = commands::Status::BUSY;
+                resp.error = Error(ErrorCode::Busy).to_string();
+                return send_response(conn, session, resp);
+            }
+        }
+        
+        slowlog::Timings timings;
+        timings.add(slowlog::Stage::Queue, total_watch.elapsed_us());
+        
+        bool sent;
+        size_t payload_bytes = cmd.contents_size;
+        BudgetLease batch_lease;
+        {
+            trace::ScopedTrace trace_scope(request_trace.get());
+            slowlog::ScopedTimings timings_scope(&timings);
+            
+            commands::Response resp;
+            if (cmd.type == commands::Type::HELLO) {
+                resp = handle_hello(cmd, session);
+            } else if (cmd.type == commands::Type::BATCH) {
+                resp = handle_batch(cmd, decoder, session.max_response_bytes, batch_lease);
+            } else if (cmd.type == commands::Type::ATTACH_SHM) {
+                resp = handle_attach_shm(conn, session);
+            } else {
+                resp = dispatch_command(cmd);
+            }
+            // A slow reader must not hold a slot while its response drains
+            slot.reset();
+            if (scheduled && rate_limiter_.enabled()) {
+                rate_limiter_.charge(session.client, response_bytes(resp));
+            }
+            metrics::record_response(cmd.type, resp.success, resp.data.size());
+            payload_bytes = std::max(payload_bytes, resp.data.size());
+            compress_response(resp, session);
+            
+            trace::ScopedSpan send_span("rpc.send", slowlog::Stage::Send);
+            metrics::ScopedLatency send_latency(cmd.type, metrics::Stage::Send);
+            sent = send_response(conn, session, resp);
+        }
+        // The HELLO response itself is never multiplexed
+        if (session.negotiated && !session.multiplexed) {
+            session.multiplexed = (session.capabilities & commands::CAP_MULTIPLEX) != 0;
+        }
+        // Likewise the ATTACH_SHM response still goes over the socket
+        if (session.pending_shm) {
+            session.shm = std::move(session.pending_shm);
+            session.max_response_bytes = std::min(session.max_response_bytes, session.shm->max_payload());
+            session.compression = commands::compression::Algorithm::NONE;
+            SPDLOG_DEBUG("Shared memory attached for {}", conn->remote_address());
+        }
+        int64_t total_us = total_watch.elapsed_us();
+        metrics::record_latency(cmd.type, metrics::Stage::Total, total_us);
+        slowlog::maybe_log(cmd.type, cmd.path, payload_bytes, receive_us + total_us, timings);
+        trace::submit(std::move(request_trace));
+        return sent && !session.closing;
         
     } catch (const msgpack::unpack_error& e) {
-        spdlog::error("MessagePack unpack error: {}", e.what());
-        send_error_response(conn, "Deserialization error");
+        DIARKIS_ERROR_RATE_LIMITED("MessagePack unpack error: {}", e.what());
+        send_error_response(conn, session, "Deserialization error");
         return false;
     } catch (const msgpack::type_error& e) {
-        spdlog::error("MessagePack type error: {}", e.what());
-        send_error_response(conn, "Type conversion error");
+        DIARKIS_ERROR_RATE_LIMITED("MessagePack type error: {}", e.what());
+        send_error_response(conn, session, "Type conversion error");
         return false;
     } catch (const std::exception& e) {
-        spdlog::error("Error processing command: {}", e.what());
-        send_error_response(conn, std::string("Processing error: ") + e.what());
+        DIARKIS_ERROR_RATE_LIMITED("Error processing command: {}", e.what());
+        send_error_response(conn, session, std::string("Processing error: ") + e.what());
         return false;
     }
 }
 
-commands::Response RpcServer::dispatch_command(const commands::Command& cmd) {
+Lane RpcServer::classify(const commands::CommandView& cmd) const {
+    bool carries_payload = commands::is_write(cmd.type) || cmd.type == commands::Type::BATCH;
+    return carries_payload && cmd.contents_size >= options_.bulk_threshold ? Lane::BULK : Lane::INTERACTIVE;
+}
+
+commands::Response RpcServer::handle_batch(const commands::CommandView& cmd, commands::codec::Decoder& decoder,
+                                           size_t max_response_bytes, BudgetLease& results_lease) {
+    commands::Response resp;
+    std::vector<commands::CommandView> cmds;
+    if (!decoder.decode_batch(cmd.contents, cmd.contents_size, cmds)) {
+        resp.success = false;
+        resp.error = "Malformed batch";
+        return resp;
+    }
+    std::vector<commands::BatchRun> runs;
+    if (!commands::plan_batch(cmds, options_.max_batch_commands, runs)) {
+        resp.success = false;
+        resp.error = "Batch exceeds " + std::to_string(options_.max_batch_commands) + " commands";
+        return resp;
+    }
+    
+    // Reads run until their results would outgrow the response or the budget
+    BatchResults held;
+    held.lease = BudgetLease(inflight_budget_, 0, std::chrono::milliseconds(0));
+    held.max_bytes = max_response_bytes;
+    
+    resp.results.resize(cmds.size());
+    for (const auto& run : runs) {
+        size_t count = run.end - run.begin;
+        if (run.kind == commands::BatchRun::OTHER) {
+            resp.results[run.begin].success = false;
+            resp.results[run.begin].error = "Command not allowed in a batch";
+        } else if (run.kind == commands::BatchRun::READ) {
+            run_batch_reads(&cmds[run.begin], &resp.results[run.begin], count, held);
+        } else if (count == 1) {
+            resp.results[run.begin] = handle_write_command(cmds[run.begin]);
+        } else {
+            auto results = state_machine_->apply_write_batch(&cmds[run.begin], count);
+            std::move(results.begin(), results.end(), resp.results.begin() + run.begin);
+        }
+    }
+    
+    SPDLOG_DEBUG("Batch of {} commands processed, {} result bytes", cmds.size(), held.bytes);
+    results_lease = std::move(held.lease);
+    resp.success = true;
+    return resp;
+}
+
+void RpcServer::run_batch_reads(const commands::CommandView* cmds, commands::Response* results, 
+                                size_t count, BatchResults& held) {
+    size_t threads = std::min(options_.batch_read_threads, 
+                              (count + MIN_READS_PER_THREAD - 1) / MIN_READS_PER_THREAD);
+    
+    // Once one result does not fit, the reads not yet started fail unrun;
+    // a result is kept only if its bytes fit both limits
+    auto fail = [&](commands::Response& result) {
+        result = commands::Response();
+        result.success = false;
+        result.status = held.status;
+        result.error = held.error;
+    };
+    auto admit = [&](commands::Response& result) {
+        std::lock_guard<std::mutex> lock(held.mutex);
+        size_t bytes = held_bytes(result);
+        if (held.error.empty()) {
+            if (held.bytes + bytes > held.max_bytes) {
+                held.status = commands::Status::ERROR;
+                held.error = "Batch response exceeds " + std::to_string(held.max_bytes) + " bytes";
+            } else if (!held.lease.extend(bytes, std::chrono::milliseconds(0))) {
+                held.status = commands::Status::BUSY;
+                held.error = Error(ErrorCode::Busy).to_string();
+            } else {
+                held.bytes += bytes;
+                return;
+            }
+        }
+        fail(result);
+    };
+    auto stopped = [&](commands::Response& result) {
+        std::lock_guard<std::mutex> lock(held.mutex);
+        if (held.error.empty()) {
+            return false;
+        }
+        fail(result);
+        return true;
+    };
+    
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        for (size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            if (stopped(results[i])) {
+                continue;
+            }
+            try {
+                results[i] = handle_read_command(cmds[i]);
+                admit(results[i]);
+            } catch (const std::exception& e) {
+                results[i].success = false;
+                results[i].error = std::string("Processing error: ") + e.what();
+            }
+        }
+    };
+    
+    // Helpers are idle threads of the pool shared by all connections, so
+    // concurrent batches cannot create threads without bound. The connection
+    // thread works too, and alone when the pool is busy; helpers finish
+    // before returning, as they use this frame.
+    std::mutex helpers_mutex;
+    std::condition_variable helpers_done;
+    size_t helpers = 0;
+    for (size_t t = 1; t < threads; ++t) {
+        {
+            std::lock_guard<std::mutex> lock(helpers_mutex);
+            ++helpers;
+        }
+        bool started = read_pool_->try_run([&] {
+            worker();
+            std::lock_guard<std::mutex> lock(helpers_mutex);
+            if (--helpers == 0) {
+                helpers_done.notify_one();
+            }
+        });
+        if (!started) {
+            std::lock_guard<std::mutex> lock(helpers_mutex);
+            --helpers;
+            break;
+        }
+    }
+    worker();
+    std::unique_lock<std::mutex> lock(helpers_mutex);
+    helpers_done.wait(lock, [&] { return helpers == 0; });
+}
+
+commands::Response RpcServer::dispatch_command(const commands::CommandView& cmd) {
     switch (cmd.type) {
         case commands::Type::WRITE_FILE:
         case commands::Type::APPEND_FILE:
@@ -160,6 +897,9 @@ commands::Response RpcServer::dispatch_command(const commands::Command& cmd) {
         case commands::Type::DELETE_FILE:
         case commands::Type::DELETE_DIR:
         case commands::Type::RENAME:
+        case commands::Type::COPY:
+        case commands::Type::TRUNCATE:
+        case commands::Type::PUNCH_HOLE:
             return handle_write_command(cmd);
             
         case commands::Type::READ_FILE:
@@ -167,7 +907,7 @@ commands::Response RpcServer::dispatch_command(const commands::Command& cmd) {
             return handle_read_command(cmd);
             
         default:
-            spdlog::error("Unknown command type: {}", static_cast<int>(cmd.type));
+            DIARKIS_ERROR_RATE_LIMITED("Unknown command type: {}", static_cast<int>(cmd.type));
             commands::Response resp;
             resp.success = false;
             resp.error = "Unknown command type";
@@ -175,35 +915,82 @@ commands::Response RpcServer::dispatch_command(const commands::Command& cmd) {
     }
 }
 
-commands::Response RpcServer::handle_write_command(const commands::Command& cmd) {
+commands::Response RpcServer::handle_write_command(const commands::CommandView& cmd) {
     return state_machine_->apply_write_command(cmd);
 }
 
-commands::Response RpcServer::handle_read_command(const commands::Command& cmd) {
+commands::Response RpcServer::handle_read_command(const commands::CommandView& cmd) {
     return state_machine_->apply_read_command(cmd);
 }
 
-bool RpcServer::send_response(std::shared_ptr<TcpConnection> conn, 
+bool RpcServer::send_response(std::shared_ptr<TcpConnection> conn, const Session& session,
                               const commands::Response& resp) {
+    if (session.shm) {
+        return send_shm_response(conn, session, resp);
+    }
+    
     try {
         msgpack::sbuffer sbuf;
         msgpack::pack(sbuf, resp);
         
-        std::vector<uint8_t> response_data(sbuf.data(), sbuf.data() + sbuf.size());
+        if (sbuf.size() > session.max_response_bytes) {
+            commands::Response too_large;
+            too_large.success = false;
+            too_large.error = "Response exceeds the negotiated frame size";
+            sbuf.clear();
+            msgpack::pack(sbuf, too_large);
+        }
+        
+        std::vector<uint8_t> response_data;
+        response_data.reserve(sizeof(uint32_t) + sbuf.size());
+        if (session.multiplexed) {
+            uint32_t id_net = htonl(session.request_id);
+            auto* id_bytes = reinterpret_cast<const uint8_t*>(&id_net);
+            response_data.insert(response_data.end(), id_bytes, id_bytes + sizeof(id_net));
+        }
+        response_data.insert(response_data.end(), sbuf.data(), sbuf.data() + sbuf.size());
         return MessageProtocol::send_message(conn, response_data);
         
     } catch (const std::exception& e) {
-        spdlog::error("Error serializing response: {}", e.what());
+        DIARKIS_ERROR_RATE_LIMITED("Error serializing response: {}", e.what());
+        return false;
+    }
+}
+
+bool RpcServer::send_shm_response(std::shared_ptr<TcpConnection> conn, const Session& session,
+                                  const commands::Response& resp) {
+    try {
+        // Sized first, then packed directly into the ring without a staging copy
+        CountingStream counter;
+        msgpack::pack(counter, resp);
+        
+        commands::Response too_large;
+        const commands::Response* out = &resp;
+        if (counter.size > session.max_response_bytes) {
+            too_large.success = false;
+            too_large.error = "Response exceeds the negotiated frame size";
+            out = &too_large;
+            counter = CountingStream();
+            msgpack::pack(counter, too_large);
+        }
+        
+        return session.shm->send(counter.size, session.request_id, [&](uint8_t* dest) {
+            MemoryStream stream{dest};
+            msgpack::pack(stream, *out);
+        }, SHM_SEND_TIMEOUT_MS, conn->socket_fd());
+        
+    } catch (const std::exception& e) {
+        DIARKIS_ERROR_RATE_LIMITED("Error serializing response: {}", e.what());
         return false;
     }
 }
 
-void RpcServer::send_error_response(std::shared_ptr<TcpConnection> conn, 
+void RpcServer::send_error_response(std::shared_ptr<TcpConnection> conn, const Session& session,
                                     const std::string& error) {
     commands::Response resp;
     resp.success = false;
     resp.error = error;
-    send_response(conn, resp);
+    send_response(conn, session, resp);
 }
 
 }
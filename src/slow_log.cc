@@ -0,0 +1,103 @@
+
+#include "diarkis/slow_log.h"
+#include "spdlog/spdlog.h"
+#include "spdlog/async.h"
+#include "spdlog/sinks/rotating_file_sink.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace diarkis::slowlog {
+
+namespace {
+    thread_local Timings* t_current = nullptr;
+    
+    std::atomic<int64_t> g_threshold_us{0};
+    std::mutex g_mutex;
+    std::shared_ptr<spdlog::details::thread_pool> g_thread_pool;
+    std::shared_ptr<spdlog::logger> g_logger;
+}
+
+void configure(const Options& opts) {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    
+    g_threshold_us.store(0, std::memory_order_release);
+    g_logger.reset();
+    g_thread_pool.reset();
+    
+    if (opts.threshold_us <= 0) {
+        return;
+    }
+    
+    try {
+        // A dedicated pool so slow op records never queue behind server logs
+        g_thread_pool = std::make_shared<spdlog::details::thread_pool>(opts.queue_size, 1);
+        auto sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+            opts.path, opts.max_file_bytes, opts.max_files);
+        g_logger = std::make_shared<spdlog::async_logger>(
+            "slow_ops", std::move(sink), g_thread_pool, spdlog::async_overflow_policy::overrun_oldest);
+        g_logger->set_pattern("[%Y-%m-%d %H:%M:%S.%e] %v");
+        g_logger->flush_on(spdlog::level::err);
+    } catch (const spdlog::spdlog_ex& e) {
+        spdlog::error("Failed to open slow op log {}: {}", opts.path, e.what());
+        g_logger.reset();
+        g_thread_pool.reset();
+        return;
+    }
+    
+    g_threshold_us.store(opts.threshold_us, std::memory_order_release);
+}
+
+void shutdown() {
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_threshold_us.store(0, std::memory_order_release);
+    if (g_logger) {
+        g_logger->flush();
+    }
+    g_logger.reset();
+    g_thread_pool.reset();
+}
+
+Timings* current() {
+    return t_current;
+}
+
+ScopedTimings::ScopedTimings(Timings* timings) : previous_(t_current) {
+    t_current = timings;
+}
+
+ScopedTimings::~ScopedTimings() {
+    t_current = previous_;
+}
+
+void maybe_log(commands::Type type, std::string_view path, size_t payload_bytes,
+               int64_t total_us, const Timings& timings) {
+    int64_t threshold = g_threshold_us.load(std::memory_order_acquire);
+    if (threshold <= 0 || total_us < threshold) {
+        return;
+    }
+    
+    std::shared_ptr<spdlog::logger> logger;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        logger = g_logger;
+    }
+    if (!logger) {
+        return;
+    }
+    
+    // Apply-side lock wait and I/O happen inside the commit wait
+    int64_t consensus = timings.get(Stage::Consensus);
+    if (consensus > 0) {
+        consensus -= timings.get(Stage::LockWait) + timings.get(Stage::Io);
+        if (consensus < 0) consensus = 0;
+    }
+    
+    logger->warn("cmd={} path={} bytes={} total_us={} queue_us={} lock_wait_us={} "
+                 "consensus_us={} io_us={} send_us={}",
+                 commands::type_name(type), path, payload_bytes, total_us,
+                 timings.get(Stage::Queue), timings.get(Stage::LockWait), consensus,
+                 timings.get(Stage::Io), timings.get(Stage::Send));
+}
+
+}
@@ -1,14 +1,76 @@
 
 #include "diarkis/state_machine.h"
+#include "diarkis/metrics.h"
+#include "diarkis/trace.h"
 #include "spdlog/spdlog.h"
 #include "msgpack.hpp"
 #include "butil/files/file_path.h"
 #include "butil/files/file.h"
+#include "butil/files/file_util.h"
+#include <algorithm>
+#include <chrono>
 
 namespace diarkis {
 
 namespace {
     constexpr size_t MAX_LOG_ENTRY_SIZE = 100 * 1024 * 1024; // 100MB
+    constexpr size_t MAX_RETAINED_APPLY_BUFFER = 1024 * 1024;
+    constexpr int64_t LOG_DISK_REFRESH_US = 10 * 1000 * 1000;
+    
+    int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // Contents of TRUNCATE and PUNCH_HOLE; false when malformed
+    bool unpack_extent(const commands::CommandView& cmd, commands::Extent& out) {
+        try {
+            msgpack::object_handle oh = msgpack::unpack(
+                reinterpret_cast<const char*>(cmd.contents), cmd.contents_size);
+            oh.get().convert(out);
+            return true;
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    
+    // msgpack streams for packing a log entry straight into its IOBuf
+    struct IOBufStream {
+        butil::IOBuf& buf;
+        void write(const char* data, size_t n) { buf.append(data, n); }
+    };
+    
+    struct CountingStream {
+        size_t size = 0;
+        void write(const char*, size_t n) { size += n; }
+    };
+    
+    // Packs the entry exactly as msgpack::pack would pack the Command
+    template <typename Stream>
+    void pack_legacy(const commands::CommandView& entry, Stream& stream) {
+        msgpack::packer<Stream> pk(stream);
+        pk.pack_array(5);
+        pk.pack(static_cast<int>(entry.type));
+        pk.pack_str(static_cast<uint32_t>(entry.path.size()));
+        pk.pack_str_body(entry.path.data(), static_cast<uint32_t>(entry.path.size()));
+        pk.pack_str(static_cast<uint32_t>(entry.new_path.size()));
+        pk.pack_str_body(entry.new_path.data(), static_cast<uint32_t>(entry.new_path.size()));
+        pk.pack_bin(static_cast<uint32_t>(entry.contents_size));
+        pk.pack_bin_body(reinterpret_cast<const char*>(entry.contents),
+                         static_cast<uint32_t>(entry.contents_size));
+        pk.pack(entry.trace_id);
+    }
+    
+    size_t legacy_entry_size(const commands::CommandView& entry) {
+        CountingStream counter;
+        pack_legacy(entry, counter);
+        return counter.size;
+    }
+    
+    void pack_legacy_entry(const commands::CommandView& entry, butil::IOBuf& out) {
+        IOBufStream stream{out};
+        pack_legacy(entry, stream);
+    }
 }
 
 bool StateMachine::Options::validate() const {
@@ -32,11 +94,16 @@ bool StateMachine::Options::validate() const {
         spdlog::error("Invalid election_timeout_ms: {}", election_timeout_ms);
         return false;
     }
+    if (log_compression != commands::compression::Algorithm::NONE && !compact_log) {
+        spdlog::error("log_compression requires compact_log");
+        return false;
+    }
     return true;
 }
 
 StateMachine::StateMachine(const Options& opts)
-    : options_(opts), is_leader_(false) {
+    : options_(opts), is_leader_(false), applied_index_(0),
+      pending_tasks_(0), pending_bytes_(0), log_disk_bytes_(0), log_disk_scanned_us_(0) {
 }
 
 StateMachine::~StateMachine() {
@@ -60,6 +127,8 @@ Result<void> StateMachine::init() {
     result = init_raft_node();
     if (!result.ok()) return result;
     
+    init_metrics();
+    
     spdlog::info("StateMachine initialized - peer: {}, group: {}", 
                  options_.peer_id.to_string(), options_.group_id);
     return Result<void>();
@@ -131,7 +200,101 @@ Result<void> StateMachine::init_raft_node() {
     return Result<void>();
 }
 
+void StateMachine::init_metrics() {
+    apply_batch_size_.expose("diarkis_raft_apply_batch_size");
+    snapshot_save_latency_.expose("diarkis_raft_snapshot_save");
+    snapshot_load_latency_.expose("diarkis_raft_snapshot_load");
+    leader_changes_.expose("diarkis_raft_leader_changes");
+    overload_rejections_.expose("diarkis_raft_overload_rejections");
+    
+    const std::pair<const char*, int64_t (*)(void*)> gauges[] = {
+        {"diarkis_raft_term", &StateMachine::get_term},
+        {"diarkis_raft_committed_index", &StateMachine::get_committed_index},
+        {"diarkis_raft_applied_index", &StateMachine::get_applied_index},
+        {"diarkis_raft_apply_lag", &StateMachine::get_apply_lag},
+        {"diarkis_raft_pending_tasks", &StateMachine::get_pending_tasks},
+        {"diarkis_raft_log_disk_bytes", &StateMachine::get_log_disk_bytes},
+        {"diarkis_raft_pending_bytes", &StateMachine::get_pending_bytes},
+    };
+    for (const auto& [name, getter] : gauges) {
+        raft_gauges_.push_back(
+            std::make_unique<bvar::PassiveStatus<int64_t>>(name, getter, this));
+    }
+}
+
+braft::NodeStatus StateMachine::raft_status() const {
+    braft::NodeStatus status;
+    if (raft_node_) {
+        raft_node_->get_status(&status);
+    }
+    return status;
+}
+
+int64_t StateMachine::get_term(void* arg) {
+    return static_cast<StateMachine*>(arg)->raft_status().term;
+}
+
+int64_t StateMachine::get_committed_index(void* arg) {
+    return static_cast<StateMachine*>(arg)->raft_status().committed_index;
+}
+
+int64_t StateMachine::get_applied_index(void* arg) {
+    return static_cast<StateMachine*>(arg)->applied_index_.load(std::memory_order_relaxed);
+}
+
+int64_t StateMachine::get_apply_lag(void* arg) {
+    auto* sm = static_cast<StateMachine*>(arg);
+    int64_t committed = sm->raft_status().committed_index;
+    int64_t applied = sm->applied_index_.load(std::memory_order_relaxed);
+    return committed > applied ? committed - applied : 0;
+}
+
+int64_t StateMachine::get_pending_tasks(void* arg) {
+    return static_cast<StateMachine*>(arg)->raft_status().pending_queue_size;
+}
+
+int64_t StateMachine::get_log_disk_bytes(void* arg) {
+    auto* sm = static_cast<StateMachine*>(arg);
+    
+    // Walking the log directory is too slow for every bvar read; one reader
+    // rescans when the cached size is stale, the others return it as is
+    int64_t now = now_us();
+    int64_t scanned = sm->log_disk_scanned_us_.load(std::memory_order_relaxed);
+    if ((scanned == 0 || now - scanned >= LOG_DISK_REFRESH_US) &&
+        sm->log_disk_scanned_us_.compare_exchange_strong(scanned, now, std::memory_order_relaxed)) {
+        sm->log_disk_bytes_.store(
+            butil::ComputeDirectorySize(butil::FilePath(sm->options_.raft_path).Append("log")),
+            std::memory_order_relaxed);
+    }
+    return sm->log_disk_bytes_.load(std::memory_order_relaxed);
+}
+
+int64_t StateMachine::get_pending_bytes(void* arg) {
+    return static_cast<StateMachine*>(arg)->pending_bytes_.load(std::memory_order_relaxed);
+}
+
+bool StateMachine::reserve_pending(int64_t bytes) {
+    int64_t tasks = pending_tasks_.fetch_add(1, std::memory_order_relaxed) + 1;
+    int64_t total = pending_bytes_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    
+    // A single oversized entry is still admitted when nothing else is queued
+    if (tasks > options_.max_pending_tasks ||
+        (total > options_.max_pending_bytes && tasks > 1)) {
+        release_pending(bytes);
+        return false;
+    }
+    return true;
+}
+
+void StateMachine::release_pending(int64_t bytes) {
+    pending_tasks_.fetch_sub(1, std::memory_order_relaxed);
+    pending_bytes_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
 void StateMachine::shutdown() {
+    // Hide the gauges first, they read from raft_node_
+    raft_gauges_.clear();
+    
     if (raft_node_) {
         spdlog::info("Shutting down Raft node...");
         raft_node_->shutdown(nullptr);
@@ -158,60 +321,182 @@ braft::PeerId StateMachine::leader_id() const {
     return raft_node_->leader_id();
 }
 
-commands::Response StateMachine::apply_write_command(const commands::Command& cmd) {
+bool StateMachine::check_leader(commands::Response& resp) const {
+    if (is_leader()) {
+        return true;
+    }
+    resp.success = false;
+    braft::PeerId leader = leader_id();
+    if (leader.is_empty()) {
+        resp.error = "No leader available";
+    } else {
+        resp.error = "Not leader, redirect to: " + leader.to_string();
+    }
+    return false;
+}
+
+commands::Response StateMachine::apply_write_command(const commands::CommandView& cmd) {
     commands::Response resp;
+    if (!check_leader(resp)) {
+        return resp;
+    }
     
-    if (!is_leader()) {
+    try {
+        return propose(cmd, nullptr);
+    } catch (const std::exception& e) {
         resp.success = false;
-        braft::PeerId leader = leader_id();
-        if (leader.is_empty()) {
-            resp.error = "No leader available";
-        } else {
-            resp.error = "Not leader, redirect to: " + leader.to_string();
+        resp.error = std::string("Exception: ") + e.what();
+        spdlog::error("Exception applying write command: {}", e.what());
+    }
+    
+    return resp;
+}
+
+std::vector<commands::Response> StateMachine::apply_write_batch(const commands::CommandView* cmds, 
+                                                                size_t count) {
+    std::vector<commands::Response> results(count);
+    commands::Response resp;
+    if (count == 0 || !check_leader(resp)) {
+        std::fill(results.begin(), results.end(), resp);
+        return results;
+    }
+    
+    // Nodes that only read MessagePack entries know nothing of BATCH entries
+    // either, so until the log is compact each command is its own entry
+    if (!options_.compact_log) {
+        for (size_t i = 0; i < count; ++i) {
+            results[i] = apply_write_command(cmds[i]);
         }
-        return resp;
+        return results;
     }
     
     try {
-        msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, cmd);
-        
-        if (sbuf.size() > MAX_LOG_ENTRY_SIZE) {
+        // The entry's contents are the commands back to back in the compact encoding
+        size_t body_size = 0;
+        for (size_t i = 0; i < count; ++i) {
+            body_size += commands::codec::encoded_size(cmds[i]);
+        }
+        if (body_size > MAX_LOG_ENTRY_SIZE) {
             resp.success = false;
             resp.error = "Command too large";
-            return resp;
+            std::fill(results.begin(), results.end(), resp);
+            return results;
         }
         
-        butil::IOBuf log_data;
-        log_data.append(sbuf.data(), sbuf.size());
-        
-        auto closure = std::make_unique<RaftClosure>();
-        auto* closure_ptr = closure.get();
+        std::vector<uint8_t> body;
+        body.reserve(body_size);
+        for (size_t i = 0; i < count; ++i) {
+            commands::CommandView sub = cmds[i];
+            sub.compression = commands::compression::Algorithm::NONE;
+            commands::codec::encode(sub, body);
+        }
         
-        braft::Task task;
-        task.data = &log_data;
-        task.done = closure.release(); // Transfer ownership to Raft
+        commands::CommandView entry;
+        entry.type = commands::Type::BATCH;
+        entry.contents = body.data();
+        entry.contents_size = body.size();
+        entry.trace_id = trace::current() ? trace::current()->id() : 0;
         
-        raft_node_->apply(task);
-        closure_ptr->wait();
-        
-        if (closure_ptr->status().ok()) {
-            resp.success = true;
-        } else {
-            resp.success = false;
-            resp.error = closure_ptr->status().error_cstr();
+        std::vector<butil::Status> batch_status;
+        batch_status.reserve(count);
+        resp = propose(entry, &batch_status);
+        if (resp.success) {
+            for (size_t i = 0; i < count; ++i) {
+                results[i].success = i < batch_status.size() && batch_status[i].ok();
+                if (i >= batch_status.size()) {
+                    results[i].error = "Command not applied";
+                } else if (!batch_status[i].ok()) {
+                    results[i].error = batch_status[i].error_cstr();
+                }
+            }
+            return results;
         }
         
     } catch (const std::exception& e) {
         resp.success = false;
         resp.error = std::string("Exception: ") + e.what();
-        spdlog::error("Exception applying write command: {}", e.what());
+        spdlog::error("Exception applying write batch: {}", e.what());
+    }
+    
+    std::fill(results.begin(), results.end(), resp);
+    return results;
+}
+
+commands::Response StateMachine::propose(commands::CommandView entry,
+                                         std::vector<butil::Status>* batch_status) {
+    commands::Response resp;
+    
+    // Compressible payloads are stored compressed; on_apply inflates them
+    std::vector<uint8_t> compressed;
+    if (entry.contents_size >= options_.compression_threshold &&
+        commands::compression::compress(options_.log_compression, entry.contents,
+                                        entry.contents_size, compressed)) {
+        entry.contents = compressed.data();
+        entry.contents_size = compressed.size();
+        entry.compression = options_.log_compression;
+    }
+    
+    // MessagePack entries are what nodes without the compact encoding read
+    size_t entry_size = options_.compact_log ? commands::codec::encoded_size(entry)
+                                             : legacy_entry_size(entry);
+    if (entry_size > MAX_LOG_ENTRY_SIZE) {
+        resp.success = false;
+        resp.error = "Command too large";
+        return resp;
+    }
+    
+    // Fail fast instead of queueing behind a slow follower or disk
+    PendingLease pending(*this, static_cast<int64_t>(entry_size));
+    if (!pending) {
+        overload_rejections_ << 1;
+        resp.success = false;
+        resp.status = commands::Status::OVERLOADED;
+        resp.error = Error(ErrorCode::Overloaded).to_string();
+        return resp;
+    }
+    
+    // Either way the payload is copied into the entry once
+    butil::IOBuf log_data;
+    if (options_.compact_log) {
+        uint8_t header[commands::codec::HEADER_SIZE];
+        commands::codec::write_header(entry, header);
+        log_data.append(header, sizeof(header));
+        log_data.append(entry.path.data(), entry.path.size());
+        log_data.append(entry.new_path.data(), entry.new_path.size());
+        log_data.append(entry.contents, entry.contents_size);
+    } else {
+        pack_legacy_entry(entry, log_data);
+    }
+    
+    auto closure = std::make_unique<RaftClosure>();
+    auto* closure_ptr = closure.get();
+    closure->set_trace(trace::current());
+    closure->set_timings(slowlog::current());
+    closure->set_batch_status(batch_status);
+    
+    braft::Task task;
+    task.data = &log_data;
+    task.done = closure.release(); // Transfer ownership to Raft
+    
+    {
+        trace::ScopedSpan commit_span("raft.commit", slowlog::Stage::Consensus);
+        metrics::ScopedLatency commit_latency(entry.type, metrics::Stage::Commit);
+        raft_node_->apply(task);
+        closure_ptr->wait();
+    }
+    pending.release();
+    
+    if (closure_ptr->status().ok()) {
+        resp.success = true;
+    } else {
+        resp.success = false;
+        resp.error = closure_ptr->status().error_cstr();
     }
     
     return resp;
 }
 
-commands::Response StateMachine::apply_read_command(const commands::Command& cmd) {
+commands::Response StateMachine::apply_read_command(const commands::CommandView& cmd) {
     try {
         switch (cmd.type) {
             case commands::Type::READ_FILE:
@@ -233,9 +518,11 @@ commands::Response StateMachine::apply_read_command(const commands::Command& cmd
     }
 }
 
-commands::Response StateMachine::handle_read_file(const commands::Command& cmd) {
+commands::Response StateMachine::handle_read_file(const commands::CommandView& cmd) {
     commands::Response resp;
-    auto result = storage_->read_file(cmd.path);
+    metrics::Stopwatch storage_watch;
+    auto result = storage_->read_file(std::string(cmd.path));
+    metrics::record_latency(cmd.type, metrics::Stage::Storage, storage_watch.elapsed_us());
     
     if (result.ok()) {
         resp.success = true;
@@ -248,9 +535,11 @@ commands::Response StateMachine::handle_read_file(const commands::Command& cmd)
     return resp;
 }
 
-commands::Response StateMachine::handle_list_directory(const commands::Command& cmd) {
+commands::Response StateMachine::handle_list_directory(const commands::CommandView& cmd) {
     commands::Response resp;
-    auto result = storage_->list_directory(cmd.path);
+    metrics::Stopwatch storage_watch;
+    auto result = storage_->list_directory(std::string(cmd.path));
+    metrics::record_latency(cmd.type, metrics::Stage::Storage, storage_watch.elapsed_us());
     
     if (result.ok()) {
         resp.success = true;
@@ -266,29 +555,71 @@ commands::Response StateMachine::handle_list_directory(const commands::Command&
 }
 
 void StateMachine::on_apply(braft::Iterator& iter) {
+    int64_t batch_size = 0;
+    
     for (; iter.valid(); iter.next()) {
         braft::AsyncClosureGuard closure_guard(iter.done());
+        applied_index_.store(iter.index(), std::memory_order_relaxed);
+        batch_size++;
         auto* done = dynamic_cast<RaftClosure*>(iter.done());
         
+        metrics::Stopwatch apply_watch;
+        
         try {
-            std::string data = iter.data().to_string();
-            
-            if (data.size() > MAX_LOG_ENTRY_SIZE) {
-                spdlog::error("Log entry too large: {} bytes", data.size());
+            const butil::IOBuf& entry = iter.data();
+            if (entry.size() > MAX_LOG_ENTRY_SIZE) {
+                spdlog::error("Log entry too large: {} bytes", entry.size());
                 if (done) {
                     done->status().set_error(EINVAL, "Log entry too large");
                 }
                 continue;
             }
             
-            msgpack::object_handle oh = msgpack::unpack(data.data(), data.size());
-            commands::Command cmd;
-            oh.get().convert(cmd);
+            // Decode in place when the entry is contiguous, otherwise flatten it
+            // into a buffer reused across entries
+            const uint8_t* data;
+            if (entry.backing_block_num() == 1) {
+                data = reinterpret_cast<const uint8_t*>(entry.backing_block(0).data());
+            } else {
+                apply_buffer_.resize(entry.size());
+                entry.copy_to(apply_buffer_.data(), entry.size());
+                data = apply_buffer_.data();
+            }
+            
+            commands::CommandView cmd;
+            if (!apply_decoder_.decode(data, entry.size(), cmd)) {
+                spdlog::error("Malformed log entry at index {}", iter.index());
+                if (done) {
+                    done->status().set_error(EINVAL, "Deserialization error");
+                }
+                continue;
+            }
             
-            spdlog::debug("Applying command: type={}, path={}", 
+            SPDLOG_DEBUG("Applying command: type={}, path={}", 
                          static_cast<int>(cmd.type), cmd.path);
             
-            apply_command(cmd, done);
+            // On the leader the proposing request's trace is reachable through
+            // the closure; followers trace sampled entries on their own
+            trace::Trace* entry_trace = done ? done->trace() : nullptr;
+            std::unique_ptr<trace::Trace> follower_trace;
+            if (!entry_trace && cmd.trace_id != 0) {
+                follower_trace = std::make_unique<trace::Trace>(cmd.trace_id, cmd.type,
+                                                                std::string(cmd.path));
+                entry_trace = follower_trace.get();
+            }
+            
+            {
+                trace::ScopedTrace trace_scope(entry_trace);
+                slowlog::ScopedTimings timings_scope(done ? done->timings() : nullptr);
+                trace::ScopedSpan apply_span("raft.apply");
+                if (cmd.type == commands::Type::BATCH) {
+                    apply_batch(cmd, done);
+                } else {
+                    apply_command(cmd, done ? &done->status() : nullptr);
+                }
+            }
+            metrics::record_latency(cmd.type, metrics::Stage::Apply, apply_watch.elapsed_us());
+            trace::submit(std::move(follower_trace));
             
         } catch (const msgpack::unpack_error& e) {
             spdlog::error("MessagePack unpack error: {}", e.what());
@@ -307,40 +638,97 @@ void StateMachine::on_apply(braft::Iterator& iter) {
             }
         }
     }
+    
+    if (batch_size > 0) {
+        apply_batch_size_ << batch_size;
+    }
+    if (apply_buffer_.capacity() > MAX_RETAINED_APPLY_BUFFER) {
+        std::vector<uint8_t>().swap(apply_buffer_);
+    }
+    apply_decoder_.trim(MAX_RETAINED_APPLY_BUFFER);
 }
 
-void StateMachine::apply_command(const commands::Command& cmd, RaftClosure* done) {
+void StateMachine::apply_batch(const commands::CommandView& cmd, RaftClosure* done) {
+    std::vector<butil::Status>* batch_status = done ? done->batch_status() : nullptr;
+    const uint8_t* p = cmd.contents;
+    size_t remaining = cmd.contents_size;
+    
+    while (remaining > 0) {
+        // Commands inside a batch are never compressed on their own
+        commands::CommandView sub;
+        size_t size = commands::codec::frame_size(p, remaining);
+        if (size == 0 || !commands::codec::decode(p, size, sub) ||
+            sub.compression != commands::compression::Algorithm::NONE) {
+            spdlog::error("Malformed batch entry, {} bytes left", remaining);
+            if (done) {
+                done->status().set_error(EINVAL, "Malformed batch entry");
+            }
+            return;
+        }
+        
+        if (batch_status) {
+            batch_status->emplace_back();
+            apply_command(sub, &batch_status->back());
+        } else {
+            apply_command(sub, nullptr);
+        }
+        p += size;
+        remaining -= size;
+    }
+}
+
+void StateMachine::apply_command(const commands::CommandView& cmd, butil::Status* status) {
     Result<void> result;
+    metrics::Stopwatch storage_watch;
+    
+    std::string path(cmd.path);
     
     switch (cmd.type) {
         case commands::Type::CREATE_FILE:
-            result = storage_->create_file(cmd.path);
+            result = storage_->create_file(path);
             break;
             
         case commands::Type::WRITE_FILE:
-            result = storage_->write_file(cmd.path, cmd.contents.data(), cmd.contents.size());
+            result = storage_->write_file(path, cmd.contents, cmd.contents_size);
             break;
             
         case commands::Type::APPEND_FILE:
-            result = storage_->append_file(cmd.path, cmd.contents.data(), cmd.contents.size());
+            result = storage_->append_file(path, cmd.contents, cmd.contents_size);
             break;
             
         case commands::Type::DELETE_FILE:
-            result = storage_->delete_file(cmd.path);
+            result = storage_->delete_file(path);
             break;
             
         case commands::Type::CREATE_DIR:
-            result = storage_->create_directory(cmd.path);
+            result = storage_->create_directory(path);
             break;
             
         case commands::Type::DELETE_DIR:
-            result = storage_->delete_directory(cmd.path);
+            result = storage_->delete_directory(path);
             break;
             
         case commands::Type::RENAME:
-            result = storage_->rename(cmd.path, cmd.new_path);
+            result = storage_->rename(path, std::string(cmd.new_path));
             break;
             
+        case commands::Type::COPY:
+            result = storage_->copy_file(path, std::string(cmd.new_path));
+            break;
+            
+        case commands::Type::TRUNCATE:
+        case commands::Type::PUNCH_HOLE: {
+            commands::Extent extent;
+            if (!unpack_extent(cmd, extent)) {
+                result = Error(ErrorCode::InvalidCommand, "Malformed extent");
+            } else if (cmd.type == commands::Type::TRUNCATE) {
+                result = storage_->truncate_file(path, extent.offset);
+            } else {
+                result = storage_->punch_hole(path, extent.offset, extent.length);
+            }
+            break;
+        }
+            
         case commands::Type::READ_FILE:
         case commands::Type::LIST_DIR:
             spdlog::warn("Read-only command in apply: type={}", static_cast<int>(cmd.type));
@@ -348,18 +736,20 @@ void StateMachine::apply_command(const commands::Command& cmd, RaftClosure* done
             
         default:
             spdlog::error("Unknown command type in apply: {}", static_cast<int>(cmd.type));
-            if (done) {
-                done->status().set_error(EINVAL, "Unknown command type");
+            if (status) {
+                status->set_error(EINVAL, "Unknown command type");
             }
             return;
     }
     
-    if (done) {
+    metrics::record_latency(cmd.type, metrics::Stage::Storage, storage_watch.elapsed_us());
+    
+    if (status) {
         if (result.ok()) {
-            spdlog::debug("Command applied successfully");
+            SPDLOG_DEBUG("Command applied successfully");
         } else {
             const std::string& error_msg = result.error().to_string();
-            done->status().set_error(EINVAL, error_msg.c_str());
+            status->set_error(EINVAL, error_msg.c_str());
             spdlog::error("Command failed: {}", error_msg);
         }
     }
@@ -371,6 +761,7 @@ void StateMachine::on_shutdown() {
 
 void StateMachine::on_leader_start(int64_t term) {
     is_leader_.store(true, std::memory_order_release);
+    leader_changes_ << 1;
     spdlog::info("Node became leader at term {}", term);
 }
 
@@ -397,6 +788,7 @@ void StateMachine::on_configuration_committed(const braft::Configuration& conf)
 }
 
 void StateMachine::on_start_following(const braft::LeaderChangeContext& ctx) {
+    leader_changes_ << 1;
     spdlog::info("Started following leader: {}", ctx.leader_id().to_string());
 }
 
@@ -406,8 +798,11 @@ void StateMachine::on_stop_following(const braft::LeaderChangeContext& ctx) {
 
 void StateMachine::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closure* done) {
     (void)writer;
+    metrics::Stopwatch watch;
     spdlog::info("Saving snapshot...");
     // TODO: Implement actual snapshot saving
+    snapshot_save_latency_ << watch.elapsed_us();
+    log_disk_scanned_us_.store(0, std::memory_order_relaxed);
     if (done) {
         done->Run();
     }
@@ -415,8 +810,11 @@ void StateMachine::on_snapshot_save(braft::SnapshotWriter* writer, braft::Closur
 
 int StateMachine::on_snapshot_load(braft::SnapshotReader* reader) {
     (void)reader;
+    metrics::Stopwatch watch;
     spdlog::info("Loading snapshot...");
     // TODO: Implement actual snapshot loading
+    snapshot_load_latency_ << watch.elapsed_us();
+    log_disk_scanned_us_.store(0, std::memory_order_relaxed);
     return 0;
 }
 
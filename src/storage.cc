@@ -1,20 +1,24 @@
 
 #include "diarkis/storage.h"
+#include "diarkis/path.h"
+#include "diarkis/trace.h"
+#include "diarkis/log.h"
 #include "spdlog/spdlog.h"
+#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <linux/fs.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
 #include <cerrno>
 #include <cstring>
-#include <sstream>
 #include <algorithm>
+#include <optional>
 
 namespace diarkis {
 
 namespace {
-    constexpr off_t MAX_FILE_SIZE = 100 * 1024 * 1024; // 100MB
     constexpr mode_t FILE_MODE = 0644;
     constexpr mode_t DIR_MODE = 0755;
     
@@ -34,58 +38,57 @@ namespace {
         int fd_;
     };
     
-    bool is_safe_path(const std::string& path) {
-        if (!path.empty() && path[0] == '/') {
-            return false;
-        }
-        
-        std::vector<std::string> components;
-        std::istringstream iss(path);
-        std::string component;
-        
-        while (std::getline(iss, component, '/')) {
-            if (component.empty() || component == ".") {
+    constexpr size_t IO_BUFFER_SIZE = 64 * 1024;
+    
+    // Copies size bytes in the kernel with copy_file_range, which may also
+    // share extents; falls back to pread/pwrite when the kernel or the pair
+    // of filesystems does not support it
+    Result<void> copy_contents(int src, int dst, off_t size) {
+        loff_t offset = 0;
+        while (offset < size) {
+            loff_t in_offset = offset;
+            loff_t out_offset = offset;
+            ssize_t n = ::copy_file_range(src, &in_offset, dst, &out_offset,
+                                          static_cast<size_t>(size - offset), 0);
+            if (n > 0) {
+                offset += n;
                 continue;
             }
-            
-            if (component == "..") {
-                return false;
+            if (n == 0) {
+                return Error(ErrorCode::IoError, "Source file shorter than its size");
             }
-            
-            components.push_back(component);
-        }
-        
-        for (const auto& comp : components) {
-            if (comp.find('\0') != std::string::npos) {
-                return false;
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP) {
+                return Error::from_errno(errno);
             }
+            break;
         }
         
-        return true;
-    }
-    
-    std::string normalize_path(const std::string& path) {
-        std::string result;
-        bool last_was_slash = false;
-        
-        for (char c : path) {
-            if (c == '/') {
-                if (!last_was_slash && !result.empty()) {
-                    result += c;
+        std::vector<uint8_t> buffer(offset < size ? IO_BUFFER_SIZE : 0);
+        while (offset < size) {
+            size_t chunk = std::min(buffer.size(), static_cast<size_t>(size - offset));
+            ssize_t n = ::pread(src, buffer.data(), chunk, offset);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return Error::from_errno(errno);
+            }
+            if (n == 0) {
+                return Error(ErrorCode::IoError, "Source file shorter than its size");
+            }
+            ssize_t written = 0;
+            while (written < n) {
+                ssize_t w = ::pwrite(dst, buffer.data() + written, n - written, offset + written);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return Error::from_errno(errno);
                 }
-                last_was_slash = true;
-            } else {
-                result += c;
-                last_was_slash = false;
+                written += w;
             }
+            offset += n;
         }
-        
-        // Remove trailing slash
-        if (!result.empty() && result.back() == '/') {
-            result.pop_back();
-        }
-        
-        return result;
+        return Result<void>();
     }
 }
 
@@ -170,7 +173,7 @@ void FileLocker::unlock_write(const std::string& path) {
 }
 
 ReadLock::ReadLock(FileLocker& locker, const std::string& path)
-    : locker_(locker), path_(path) {
+    : locker_(locker), path_(normalize_path(path)) {
     locker_.lock_read(path_);
 }
 
@@ -179,7 +182,7 @@ ReadLock::~ReadLock() {
 }
 
 WriteLock::WriteLock(FileLocker& locker, const std::string& path)
-    : locker_(locker), path_(path) {
+    : locker_(locker), path_(normalize_path(path)) {
     locker_.lock_write(path_);
 }
 
@@ -233,7 +236,7 @@ Result<void> Storage::validate_path(const std::string& path) const {
     }
     
     if (!is_safe_path(path)) {
-        spdlog::error("Path traversal attempt detected: {}", path);
+        DIARKIS_ERROR_RATE_LIMITED("Path traversal attempt detected: {}", path);
         return Error(ErrorCode::InvalidPath, "Invalid path: contains path traversal");
     }
     
@@ -256,11 +259,11 @@ Result<void> Storage::create_file(const std::string& path) {
         if (err == EEXIST) {
             return Result<void>();
         }
-        spdlog::error("Failed to create file {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to create file {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
-    spdlog::debug("Created file: {}", path);
+    SPDLOG_DEBUG("Created file: {}", path);
     return Result<void>();
 }
 
@@ -273,7 +276,7 @@ Result<void> Storage::create_directory(const std::string& path) {
     std::string full_path = resolve_path(path);
     
     if (::mkdir(full_path.c_str(), DIR_MODE) == 0) {
-        spdlog::debug("Created directory: {}", path);
+        SPDLOG_DEBUG("Created directory: {}", path);
         return Result<void>();
     }
     
@@ -282,7 +285,7 @@ Result<void> Storage::create_directory(const std::string& path) {
         return Result<void>();
     }
     
-    spdlog::error("Failed to create directory {}: {}", path, std::strerror(err));
+    DIARKIS_ERROR_RATE_LIMITED("Failed to create directory {}: {}", path, std::strerror(err));
     return Error::from_errno(err);
 }
 
@@ -292,26 +295,29 @@ Result<std::vector<uint8_t>> Storage::read_file(const std::string& path) {
         return validation.error();
     }
     
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
     ReadLock file_lock(file_locker_, path);
+    lock_span.finish();
     
+    trace::ScopedSpan read_span("storage.read", slowlog::Stage::Io);
     std::string full_path = resolve_path(path);
     FileDescriptor fd(::open(full_path.c_str(), O_RDONLY));
     
     if (!fd.valid()) {
         int err = errno;
-        spdlog::error("Failed to open file {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
     struct stat st;
     if (::fstat(fd.get(), &st) != 0) {
         int err = errno;
-        spdlog::error("Failed to stat file {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to stat file {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
-    if (st.st_size > MAX_FILE_SIZE) {
-        spdlog::error("File too large: {} ({} bytes)", path, st.st_size);
+    if (static_cast<uint64_t>(st.st_size) > MAX_FILE_SIZE) {
+        DIARKIS_ERROR_RATE_LIMITED("File too large: {} ({} bytes)", path, st.st_size);
         return Error(ErrorCode::IoError, "File too large");
     }
     
@@ -323,7 +329,7 @@ Result<std::vector<uint8_t>> Storage::read_file(const std::string& path) {
         if (n < 0) {
             if (errno == EINTR) continue;
             int err = errno;
-            spdlog::error("Failed to read file {}: {}", path, std::strerror(err));
+            DIARKIS_ERROR_RATE_LIMITED("Failed to read file {}: {}", path, std::strerror(err));
             return Error::from_errno(err);
         }
         if (n == 0) break;
@@ -331,24 +337,63 @@ Result<std::vector<uint8_t>> Storage::read_file(const std::string& path) {
     }
     
     buffer.resize(total_read);
-    spdlog::debug("Read {} bytes from {}", total_read, path);
+    SPDLOG_DEBUG("Read {} bytes from {}", total_read, path);
     return buffer;
 }
 
+Result<void> Storage::read_open(const std::string& path,
+                                const std::function<Result<void>(int fd, const FileStat& stat)>& reader) {
+    auto validation = validate_path(path);
+    if (!validation.ok()) {
+        return validation;
+    }
+    
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
+    ReadLock file_lock(file_locker_, path);
+    lock_span.finish();
+    
+    std::string full_path = resolve_path(path);
+    FileDescriptor fd(::open(full_path.c_str(), O_RDONLY));
+    
+    if (!fd.valid()) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to stat file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return Error(ErrorCode::FileNotFound, "Not a regular file");
+    }
+    
+    FileStat stat;
+    stat.size = static_cast<uint64_t>(st.st_size);
+    stat.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return reader(fd.get(), stat);
+}
+
 Result<void> Storage::write_file(const std::string& path, const uint8_t* buffer, size_t size) {
     auto validation = validate_path(path);
     if (!validation.ok()) {
         return validation;
     }
     
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
     WriteLock file_lock(file_locker_, path);
+    lock_span.finish();
     
+    trace::ScopedSpan write_span("storage.write", slowlog::Stage::Io);
     std::string full_path = resolve_path(path);
     FileDescriptor fd(::open(full_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, FILE_MODE));
     
     if (!fd.valid()) {
         int err = errno;
-        spdlog::error("Failed to open file for writing {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file for writing {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
@@ -358,19 +403,22 @@ Result<void> Storage::write_file(const std::string& path, const uint8_t* buffer,
         if (n < 0) {
             if (errno == EINTR) continue;
             int err = errno;
-            spdlog::error("Failed to write to file {}: {}", path, std::strerror(err));
+            DIARKIS_ERROR_RATE_LIMITED("Failed to write to file {}: {}", path, std::strerror(err));
             return Error::from_errno(err);
         }
         total_written += n;
     }
     
+    write_span.finish();
+    
+    trace::ScopedSpan fsync_span("storage.fsync", slowlog::Stage::Io);
     if (::fsync(fd.get()) != 0) {
         int err = errno;
-        spdlog::error("Failed to sync file {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to sync file {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
-    spdlog::debug("Wrote {} bytes to {}", size, path);
+    SPDLOG_DEBUG("Wrote {} bytes to {}", size, path);
     return Result<void>();
 }
 
@@ -380,14 +428,17 @@ Result<void> Storage::append_file(const std::string& path, const uint8_t* buffer
         return validation;
     }
     
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
     WriteLock file_lock(file_locker_, path);
+    lock_span.finish();
     
+    trace::ScopedSpan write_span("storage.write", slowlog::Stage::Io);
     std::string full_path = resolve_path(path);
     FileDescriptor fd(::open(full_path.c_str(), O_WRONLY | O_APPEND | O_CREAT, FILE_MODE));
     
     if (!fd.valid()) {
         int err = errno;
-        spdlog::error("Failed to open file for appending {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file for appending {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
@@ -397,19 +448,22 @@ Result<void> Storage::append_file(const std::string& path, const uint8_t* buffer
         if (n < 0) {
             if (errno == EINTR) continue;
             int err = errno;
-            spdlog::error("Failed to append to file {}: {}", path, std::strerror(err));
+            DIARKIS_ERROR_RATE_LIMITED("Failed to append to file {}: {}", path, std::strerror(err));
             return Error::from_errno(err);
         }
         total_written += n;
     }
     
+    write_span.finish();
+    
+    trace::ScopedSpan fsync_span("storage.fsync", slowlog::Stage::Io);
     if (::fsync(fd.get()) != 0) {
         int err = errno;
-        spdlog::error("Failed to sync file {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to sync file {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
-    spdlog::debug("Appended {} bytes to {}", size, path);
+    SPDLOG_DEBUG("Appended {} bytes to {}", size, path);
     return Result<void>();
 }
 
@@ -424,22 +478,246 @@ Result<void> Storage::rename(const std::string& old_path, const std::string& new
         return validation;
     }
     
-    WriteLock old_lock(file_locker_, old_path);
-    WriteLock new_lock(file_locker_, new_path);
+    // Taken in path order, and once when both names are the same file
+    std::string old_key = normalize_path(old_path);
+    std::string new_key = normalize_path(new_path);
+    std::optional<WriteLock> first_lock;
+    std::optional<WriteLock> second_lock;
+    first_lock.emplace(file_locker_, std::min(old_key, new_key));
+    if (old_key != new_key) {
+        second_lock.emplace(file_locker_, std::max(old_key, new_key));
+    }
     
     std::string full_old = resolve_path(old_path);
     std::string full_new = resolve_path(new_path);
     
     if (::rename(full_old.c_str(), full_new.c_str()) == 0) {
-        spdlog::debug("Renamed {} to {}", old_path, new_path);
+        SPDLOG_DEBUG("Renamed {} to {}", old_path, new_path);
         return Result<void>();
     }
     
     int err = errno;
-    spdlog::error("Failed to rename {} to {}: {}", old_path, new_path, std::strerror(err));
+    DIARKIS_ERROR_RATE_LIMITED("Failed to rename {} to {}: {}", old_path, new_path, std::strerror(err));
     return Error::from_errno(err);
 }
 
+Result<void> Storage::copy_file(const std::string& src_path, const std::string& dst_path) {
+    auto validation = validate_path(src_path);
+    if (!validation.ok()) {
+        return validation;
+    }
+    
+    validation = validate_path(dst_path);
+    if (!validation.ok()) {
+        return validation;
+    }
+    
+    // Locks are keyed by the normalized path (see ReadLock), so aliases such
+    // as "a//b" and "./a/b" share one lock; they are taken in path order
+    std::string src_key = normalize_path(src_path);
+    std::string dst_key = normalize_path(dst_path);
+    if (src_key == dst_key) {
+        return Error(ErrorCode::InvalidPath, "Source and destination are the same");
+    }
+    
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
+    std::optional<ReadLock> src_lock;
+    std::optional<WriteLock> dst_lock;
+    if (src_key < dst_key) {
+        src_lock.emplace(file_locker_, src_key);
+        dst_lock.emplace(file_locker_, dst_key);
+    } else {
+        dst_lock.emplace(file_locker_, dst_key);
+        src_lock.emplace(file_locker_, src_key);
+    }
+    lock_span.finish();
+    
+    trace::ScopedSpan copy_span("storage.copy", slowlog::Stage::Io);
+    std::string full_src = resolve_path(src_path);
+    FileDescriptor src(::open(full_src.c_str(), O_RDONLY));
+    if (!src.valid()) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file {}: {}", src_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    struct stat st;
+    if (::fstat(src.get(), &st) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to stat file {}: {}", src_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return Error(ErrorCode::FileNotFound, "Not a regular file");
+    }
+    
+    // Not truncated on open: if the destination is the source under another
+    // name (a hard link, a symlinked directory), truncating would destroy it
+    std::string full_dst = resolve_path(dst_path);
+    FileDescriptor dst(::open(full_dst.c_str(), O_WRONLY | O_CREAT, FILE_MODE));
+    if (!dst.valid()) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file for writing {}: {}", dst_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    struct stat dst_st;
+    if (::fstat(dst.get(), &dst_st) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to stat file {}: {}", dst_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    if (dst_st.st_dev == st.st_dev && dst_st.st_ino == st.st_ino) {
+        return Error(ErrorCode::InvalidPath, "Source and destination are the same");
+    }
+    
+    // A reflink shares the source's extents on CoW filesystems such as Btrfs
+    // and XFS, so the copy costs metadata only
+    bool cloned = ::ioctl(dst.get(), FICLONE, src.get()) == 0;
+    if (!cloned) {
+        auto copied = copy_contents(src.get(), dst.get(), st.st_size);
+        if (!copied.ok()) {
+            DIARKIS_ERROR_RATE_LIMITED("Failed to copy {} to {}: {}", src_path, dst_path,
+                                       copied.error().to_string());
+            return copied;
+        }
+    }
+    
+    // Drops whatever the destination held beyond the copied size
+    if (::ftruncate(dst.get(), st.st_size) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to truncate file {}: {}", dst_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    copy_span.finish();
+    
+    trace::ScopedSpan fsync_span("storage.fsync", slowlog::Stage::Io);
+    if (::fsync(dst.get()) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to sync file {}: {}", dst_path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    SPDLOG_DEBUG("Copied {} to {} ({} bytes, {})", src_path, dst_path, st.st_size,
+                 cloned ? "reflink" : "copy");
+    return Result<void>();
+}
+
+Result<void> Storage::truncate_file(const std::string& path, uint64_t size) {
+    auto validation = validate_path(path);
+    if (!validation.ok()) {
+        return validation;
+    }
+    
+    if (size > MAX_FILE_SIZE) {
+        return Error(ErrorCode::IoError, "File too large");
+    }
+    
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
+    WriteLock file_lock(file_locker_, path);
+    lock_span.finish();
+    
+    trace::ScopedSpan truncate_span("storage.truncate", slowlog::Stage::Io);
+    std::string full_path = resolve_path(path);
+    FileDescriptor fd(::open(full_path.c_str(), O_WRONLY));
+    
+    if (!fd.valid()) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file for writing {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    if (::ftruncate(fd.get(), static_cast<off_t>(size)) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to truncate file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    truncate_span.finish();
+    
+    trace::ScopedSpan fsync_span("storage.fsync", slowlog::Stage::Io);
+    if (::fsync(fd.get()) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to sync file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    SPDLOG_DEBUG("Truncated {} to {} bytes", path, size);
+    return Result<void>();
+}
+
+Result<void> Storage::punch_hole(const std::string& path, uint64_t offset, uint64_t length) {
+    auto validation = validate_path(path);
+    if (!validation.ok()) {
+        return validation;
+    }
+    
+    if (offset > MAX_FILE_SIZE || length > MAX_FILE_SIZE) {
+        return Error(ErrorCode::IoError, "Range beyond the largest file size");
+    }
+    
+    trace::ScopedSpan lock_span("storage.lock_wait", slowlog::Stage::LockWait);
+    WriteLock file_lock(file_locker_, path);
+    lock_span.finish();
+    
+    trace::ScopedSpan punch_span("storage.punch_hole", slowlog::Stage::Io);
+    std::string full_path = resolve_path(path);
+    FileDescriptor fd(::open(full_path.c_str(), O_WRONLY));
+    
+    if (!fd.valid()) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open file for writing {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to stat file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    // Nothing past the end of the file is allocated
+    uint64_t end = std::min(offset + length, static_cast<uint64_t>(st.st_size));
+    if (offset >= end) {
+        return Result<void>();
+    }
+    
+    if (::fallocate(fd.get(), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                    static_cast<off_t>(offset), static_cast<off_t>(end - offset)) != 0) {
+        int err = errno;
+        if (err != EOPNOTSUPP) {
+            DIARKIS_ERROR_RATE_LIMITED("Failed to punch hole in {}: {}", path, std::strerror(err));
+            return Error::from_errno(err);
+        }
+        
+        // Filesystems without hole punching still read back zeros, at the
+        // cost of writing them
+        std::vector<uint8_t> zeros(std::min<uint64_t>(end - offset, IO_BUFFER_SIZE));
+        for (uint64_t pos = offset; pos < end; ) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(zeros.size(), end - pos));
+            ssize_t n = ::pwrite(fd.get(), zeros.data(), chunk, static_cast<off_t>(pos));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                err = errno;
+                DIARKIS_ERROR_RATE_LIMITED("Failed to zero range in {}: {}", path, std::strerror(err));
+                return Error::from_errno(err);
+            }
+            pos += static_cast<uint64_t>(n);
+        }
+    }
+    punch_span.finish();
+    
+    trace::ScopedSpan fsync_span("storage.fsync", slowlog::Stage::Io);
+    if (::fsync(fd.get()) != 0) {
+        int err = errno;
+        DIARKIS_ERROR_RATE_LIMITED("Failed to sync file {}: {}", path, std::strerror(err));
+        return Error::from_errno(err);
+    }
+    
+    SPDLOG_DEBUG("Punched hole in {} at {} ({} bytes)", path, offset, end - offset);
+    return Result<void>();
+}
+
 Result<void> Storage::delete_file(const std::string& path) {
     auto validation = validate_path(path);
     if (!validation.ok()) {
@@ -451,7 +729,7 @@ Result<void> Storage::delete_file(const std::string& path) {
     std::string full_path = resolve_path(path);
     
     if (::unlink(full_path.c_str()) == 0) {
-        spdlog::debug("Deleted file: {}", path);
+        SPDLOG_DEBUG("Deleted file: {}", path);
         return Result<void>();
     }
     
@@ -460,7 +738,7 @@ Result<void> Storage::delete_file(const std::string& path) {
         return Result<void>();
     }
     
-    spdlog::error("Failed to delete file {}: {}", path, std::strerror(err));
+    DIARKIS_ERROR_RATE_LIMITED("Failed to delete file {}: {}", path, std::strerror(err));
     return Error::from_errno(err);
 }
 
@@ -473,7 +751,7 @@ Result<void> Storage::delete_directory(const std::string& path) {
     std::string full_path = resolve_path(path);
     
     if (::rmdir(full_path.c_str()) == 0) {
-        spdlog::debug("Deleted directory: {}", path);
+        SPDLOG_DEBUG("Deleted directory: {}", path);
         return Result<void>();
     }
     
@@ -482,7 +760,7 @@ Result<void> Storage::delete_directory(const std::string& path) {
         return Result<void>();
     }
     
-    spdlog::error("Failed to delete directory {}: {}", path, std::strerror(err));
+    DIARKIS_ERROR_RATE_LIMITED("Failed to delete directory {}: {}", path, std::strerror(err));
     return Error::from_errno(err);
 }
 
@@ -498,7 +776,7 @@ Result<std::vector<FileInfo>> Storage::list_directory(const std::string& path) {
     DIR* dir = ::opendir(full_path.c_str());
     if (!dir) {
         int err = errno;
-        spdlog::error("Failed to open directory {}: {}", path, std::strerror(err));
+        DIARKIS_ERROR_RATE_LIMITED("Failed to open directory {}: {}", path, std::strerror(err));
         return Error::from_errno(err);
     }
     
@@ -524,7 +802,7 @@ Result<std::vector<FileInfo>> Storage::list_directory(const std::string& path) {
     }
     
     ::closedir(dir);
-    spdlog::debug("Listed {} items in {}", items.size(), path);
+    SPDLOG_DEBUG("Listed {} items in {}", items.size(), path);
     return items;
 }
 
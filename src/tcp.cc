@@ -1,37 +1,96 @@
 
 #include "diarkis/tcp.h"
+#include "diarkis/log.h"
 #include <spdlog/spdlog.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
 #include <cstring>
 #include <algorithm>
+#include <chrono>
+#include <system_error>
 
 namespace diarkis {
 
+namespace {
+    // CPUs this process may run on, in order
+    std::vector<int> allowed_cpus() {
+        std::vector<int> cpus;
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+    
+    int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    class WaitScope {
+    public:
+        explicit WaitScope(TcpConnection& conn) : conn_(conn) { conn_.set_waiting(true); }
+        ~WaitScope() { conn_.set_waiting(false); }
+        
+    private:
+        TcpConnection& conn_;
+    };
+}
+
 TcpConnection::TcpConnection(int socket_fd) 
     : socket_fd_(socket_fd), 
+      local_(false),
       connected_(true), 
+      waiting_(false),
+      last_activity_ms_(now_ms()),
       remote_port_(0) {
     
-    sockaddr_in addr;
+    sockaddr_storage addr;
     socklen_t addr_len = sizeof(addr);
     if (getpeername(socket_fd_, (sockaddr*)&addr, &addr_len) == 0) {
-        char ip_str[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &addr.sin_addr, ip_str, INET_ADDRSTRLEN);
-        remote_addr_ = ip_str;
-        remote_port_ = ntohs(addr.sin_port);
+        if (addr.ss_family == AF_INET) {
+            auto* in_addr = reinterpret_cast<sockaddr_in*>(&addr);
+            char ip_str[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &in_addr->sin_addr, ip_str, INET_ADDRSTRLEN);
+            remote_addr_ = ip_str;
+            remote_port_ = ntohs(in_addr->sin_port);
+            peer_identity_ = remote_addr_;
+        } else if (addr.ss_family == AF_UNIX) {
+            remote_addr_ = "unix";
+            local_ = true;
+            
+            // Every local peer shares the address, so they are told apart by
+            // the credentials the kernel recorded at connect()
+            ucred cred{};
+            socklen_t cred_len = sizeof(cred);
+            if (getsockopt(socket_fd_, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) {
+                peer_identity_ = "uid:" + std::to_string(cred.uid);
+                SPDLOG_DEBUG("Unix socket peer: pid={}, uid={}", cred.pid, cred.uid);
+            } else {
+                peer_identity_ = remote_addr_;
+            }
+        }
     }
     
-    spdlog::debug("TcpConnection created: {}:{}", remote_addr_, remote_port_);
+    SPDLOG_DEBUG("TcpConnection created: {}:{}", remote_addr_, remote_port_);
 }
 
 TcpConnection::~TcpConnection() {
     close();
-    spdlog::debug("TcpConnection destroyed: {}:{}", remote_addr_, remote_port_);
+    SPDLOG_DEBUG("TcpConnection destroyed: {}:{}", remote_addr_, remote_port_);
 }
 
 bool TcpConnection::send(const void* data, size_t size) {
@@ -51,7 +110,7 @@ bool TcpConnection::send(const void* data, size_t size) {
             if (errno == EINTR) {
                 continue;
             }
-            spdlog::error("Send failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
+            DIARKIS_ERROR_RATE_LIMITED("Send failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
             connected_.store(false, std::memory_order_release);
             return false;
         }
@@ -63,6 +122,7 @@ bool TcpConnection::send(const void* data, size_t size) {
         }
         
         total_sent += sent;
+        touch();
     }
     
     return true;
@@ -80,6 +140,7 @@ std::vector<uint8_t> TcpConnection::receive(size_t max_size) {
     std::vector<uint8_t> buffer(max_size);
     
     std::lock_guard<std::mutex> lock(socket_mutex_);
+    WaitScope wait(*this);
     
     ssize_t received = ::recv(socket_fd_, buffer.data(), max_size, 0);
     
@@ -87,17 +148,18 @@ std::vector<uint8_t> TcpConnection::receive(size_t max_size) {
         if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
             return {};
         }
-        spdlog::error("Receive failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
+        DIARKIS_ERROR_RATE_LIMITED("Receive failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
         connected_.store(false, std::memory_order_release);
         return {};
     }
     
     if (received == 0) {
-        spdlog::info("Connection closed by peer: {}:{}", remote_addr_, remote_port_);
+        SPDLOG_DEBUG("Connection closed by peer: {}:{}", remote_addr_, remote_port_);
         connected_.store(false, std::memory_order_release);
         return {};
     }
     
+    touch();
     buffer.resize(received);
     return buffer;
 }
@@ -108,6 +170,7 @@ bool TcpConnection::receive_exact(void* buffer, size_t size) {
     }
     
     std::lock_guard<std::mutex> lock(socket_mutex_);
+    WaitScope wait(*this);
     
     size_t total_received = 0;
     uint8_t* ptr = static_cast<uint8_t*>(buffer);
@@ -119,37 +182,108 @@ bool TcpConnection::receive_exact(void* buffer, size_t size) {
             if (errno == EINTR) {
                 continue;
             }
-            spdlog::error("Receive failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
+            DIARKIS_ERROR_RATE_LIMITED("Receive failed on {}:{}: {}", remote_addr_, remote_port_, strerror(errno));
             connected_.store(false, std::memory_order_release);
             return false;
         }
         
         if (received == 0) {
-            spdlog::warn("Connection closed during receive from {}:{}", remote_addr_, remote_port_);
-            connected_.store(false, std::memory_order_release);
+            // Not worth a warning when close() ended the read, e.g. idle reaping
+            if (connected_.exchange(false, std::memory_order_acq_rel)) {
+                spdlog::warn("Connection closed during receive from {}:{}", remote_addr_, remote_port_);
+            }
             return false;
         }
         
         total_received += received;
+        touch();
     }
     
     return true;
 }
 
-void TcpConnection::close() {
-    if (connected_.exchange(false, std::memory_order_acq_rel)) {
-        std::lock_guard<std::mutex> lock(socket_mutex_);
-        if (socket_fd_ >= 0) {
-            ::shutdown(socket_fd_, SHUT_RDWR);
-            ::close(socket_fd_);
-            socket_fd_ = -1;
+int TcpConnection::receive_fds(int* fds, int max_fds) {
+    constexpr int MAX_PASSED_FDS = 4;
+    if (!connected_.load(std::memory_order_acquire) || socket_fd_ < 0) {
+        return -1;
+    }
+    max_fds = std::min(max_fds, MAX_PASSED_FDS);
+    
+    std::lock_guard<std::mutex> lock(socket_mutex_);
+    WaitScope wait(*this);
+    
+    char byte;
+    iovec iov{&byte, 1};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    
+    ssize_t received;
+    do {
+        received = ::recvmsg(socket_fd_, &msg, MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    
+    if (received <= 0) {
+        DIARKIS_ERROR_RATE_LIMITED("Receive of descriptors failed on {}:{}: {}", remote_addr_, remote_port_,
+                                   received == 0 ? "connection closed" : strerror(errno));
+        connected_.store(false, std::memory_order_release);
+        return -1;
+    }
+    
+    touch();
+    
+    int count = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+            continue;
+        }
+        size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (size_t i = 0; i < n; ++i) {
+            int fd;
+            std::memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (count < max_fds) {
+                fds[count++] = fd;
+            } else {
+                ::close(fd);
+            }
         }
     }
+    return count;
+}
+
+void TcpConnection::close() {
+    // The descriptor is closed whatever connected_ says: a failed send or
+    // receive clears the flag but leaves closing to us
+    std::lock_guard<std::mutex> close_lock(close_mutex_);
+    connected_.store(false, std::memory_order_release);
+    if (socket_fd_ < 0) {
+        return;
+    }
+    
+    // Shut down before taking the lock, which a blocked send or receive
+    // holds; close_mutex_ keeps the descriptor open until then
+    ::shutdown(socket_fd_, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(socket_mutex_);
+    ::close(socket_fd_);
+    socket_fd_ = -1;
+}
+
+void TcpConnection::set_waiting(bool waiting) {
+    touch();
+    waiting_.store(waiting, std::memory_order_release);
+}
+
+void TcpConnection::touch() {
+    last_activity_ms_.store(now_ms(), std::memory_order_release);
 }
 
 TcpServer::TcpServer(const Options& opts)
     : options_(opts),
-      server_fd_(-1),
+      unix_bound_(false),
       running_(false),
       should_stop_(false) {
 }
@@ -164,28 +298,40 @@ bool TcpServer::start() {
         return false;
     }
     
-    spdlog::info("Starting TcpServer on {}:{}", options_.address, options_.port);
+    spdlog::info("Starting TcpServer on {}", endpoint());
     
-    if (!create_socket()) {
-        return false;
-    }
-    
-    if (!bind_socket()) {
-        close_socket();
-        return false;
-    }
-    
-    if (!listen_socket()) {
-        close_socket();
-        return false;
+    size_t count = listener_count();
+    std::vector<int> cpus = options_.pin_listeners ? allowed_cpus() : std::vector<int>();
+    for (size_t i = 0; i < count; ++i) {
+        auto listener = std::make_unique<Listener>();
+        listener->fd = open_listener();
+        if (listener->fd < 0) {
+            close_sockets();
+            listeners_.clear();
+            return false;
+        }
+        if (!cpus.empty()) {
+            listener->cpu = cpus[i % cpus.size()];
+        }
+        listeners_.push_back(std::move(listener));
     }
     
     running_.store(true, std::memory_order_release);
     should_stop_.store(false, std::memory_order_release);
     
-    accept_thread_ = std::make_unique<std::thread>(&TcpServer::accept_loop, this);
+    if (options_.idle_timeout_sec > 0) {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        wheel_.assign(WHEEL_SLOTS, {});
+        wheel_tick_ = 0;
+        wheel_start_ms_ = now_ms();
+        reaper_thread_ = std::thread(&TcpServer::reap_loop, this);
+    }
     
-    spdlog::info("TcpServer started successfully");
+    for (auto& listener : listeners_) {
+        listener->thread = std::thread(&TcpServer::accept_loop, this, listener.get());
+    }
+    
+    spdlog::info("TcpServer started successfully with {} listener(s)", count);
     return true;
 }
 
@@ -199,38 +345,65 @@ void TcpServer::stop() {
     should_stop_.store(true, std::memory_order_release);
     running_.store(false, std::memory_order_release);
     
-    close_socket();
+    close_sockets();
     
-    if (accept_thread_ && accept_thread_->joinable()) {
-        accept_thread_->join();
+    for (auto& listener : listeners_) {
+        if (listener->thread.joinable()) {
+            listener->thread.join();
+        }
     }
-    accept_thread_.reset();
-    
-    cleanup_connections();
+    listeners_.clear();
     
-    for (auto& thread : connection_threads_) {
-        if (thread.joinable()) {
-            thread.join();
+    if (reaper_thread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wheel_mutex_);
+            wheel_cv_.notify_all();
         }
+        reaper_thread_.join();
     }
-    connection_threads_.clear();
+    {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        std::vector<std::vector<WheelEntry>>().swap(wheel_);
+    }
+    
+    cleanup_connections();
+    
+    std::unique_lock<std::mutex> lock(connections_mutex_);
+    handlers_done_.wait(lock, [this] { return running_handlers_ == 0; });
     
     spdlog::info("TcpServer stopped");
 }
 
+std::string TcpServer::endpoint() const {
+    if (!options_.unix_path.empty()) {
+        return "unix://" + options_.unix_path;
+    }
+    return options_.address + ":" + std::to_string(options_.port);
+}
+
 size_t TcpServer::active_connections() const {
     std::lock_guard<std::mutex> lock(connections_mutex_);
     return active_connections_.size();
 }
 
-void TcpServer::accept_loop() {
-    spdlog::info("Accept loop started");
+void TcpServer::accept_loop(Listener* listener) {
+    if (listener->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(listener->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) {
+            spdlog::warn("Failed to pin accept loop to CPU {}: {}", listener->cpu, strerror(rc));
+        }
+    }
+    int fd = listener->fd;     // cleared by close_sockets() on stop
+    spdlog::info("Accept loop started (fd {}, cpu {})", fd, listener->cpu);
     
     while (!should_stop_.load(std::memory_order_acquire)) {
-        sockaddr_in client_addr;
+        sockaddr_storage client_addr;
         socklen_t client_len = sizeof(client_addr);
         
-        int client_fd = ::accept(server_fd_, (sockaddr*)&client_addr, &client_len);
+        int client_fd = ::accept(fd, (sockaddr*)&client_addr, &client_len);
         
         if (client_fd < 0) {
             if (should_stop_.load(std::memory_order_acquire)) {
@@ -241,37 +414,48 @@ void TcpServer::accept_loop() {
                 continue;
             }
             
-            spdlog::error("Accept failed: {}", strerror(errno));
+            DIARKIS_ERROR_RATE_LIMITED("Accept failed: {}", strerror(errno));
             continue;
         }
         
-        char client_ip[INET_ADDRSTRLEN];
-        inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-        uint16_t client_port = ntohs(client_addr.sin_port);
-        
-        spdlog::info("New connection from {}:{}", client_ip, client_port);
-        
         // Set TCP_NODELAY to disable Nagle's algorithm
-        int flag = 1;
-        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        if (options_.unix_path.empty()) {
+            int flag = 1;
+            setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        }
     
         struct timeval timeout;
         timeout.tv_sec = options_.socket_timeout_sec;
         timeout.tv_usec = 0;
-        setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (options_.idle_timeout_sec <= 0) {
+            setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        }
         setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
         
-        auto conn = std::make_shared<TcpConnection>(client_fd);
-        add_connection(conn);
-        
-        connection_threads_.emplace_back(&TcpServer::handle_connection, this, conn);
+        spawn_handler(std::make_shared<TcpConnection>(client_fd));
     }
     
-    spdlog::info("Accept loop stopped");
+    spdlog::info("Accept loop stopped (fd {})", fd);
 }
 
-void TcpServer::handle_connection(std::shared_ptr<TcpConnection> conn) {
-    spdlog::debug("Handling connection: {}:{}", conn->remote_address(), conn->remote_port());
+void TcpServer::spawn_handler(std::shared_ptr<TcpConnection> conn) {
+    uint64_t id = add_connection(conn);
+    try {
+        std::thread(&TcpServer::handle_connection, this, id, conn).detach();
+    } catch (const std::system_error& e) {
+        DIARKIS_ERROR_RATE_LIMITED("Failed to start connection thread for {}:{}: {}",
+                                   conn->remote_address(), conn->remote_port(), e.what());
+        conn->close();
+        remove_connection(id);
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        if (--running_handlers_ == 0) {
+            handlers_done_.notify_all();
+        }
+    }
+}
+
+void TcpServer::handle_connection(uint64_t id, std::shared_ptr<TcpConnection> conn) {
+    SPDLOG_DEBUG("Handling connection: {}:{}", conn->remote_address(), conn->remote_port());
     
     try {
         if (connection_handler_) {
@@ -280,65 +464,208 @@ void TcpServer::handle_connection(std::shared_ptr<TcpConnection> conn) {
             spdlog::warn("No connection handler set, closing connection");
         }
     } catch (const std::exception& e) {
-        spdlog::error("Exception in connection handler for {}:{}: {}", 
+        DIARKIS_ERROR_RATE_LIMITED("Exception in connection handler for {}:{}: {}", 
                      conn->remote_address(), conn->remote_port(), e.what());
     }
     
     conn->close();
-    remove_connection(conn);
     
-    spdlog::debug("Connection handler finished: {}:{}", 
+    SPDLOG_DEBUG("Connection handler finished: {}:{}", 
                  conn->remote_address(), conn->remote_port());
+    
+    // Last touch of the server, which stop() may destroy once notified
+    std::lock_guard<std::mutex> lock(connections_mutex_);
+    active_connections_.erase(id);
+    if (--running_handlers_ == 0) {
+        handlers_done_.notify_all();
+    }
+}
+
+// Counts the handler about to start, so stop() waits for it
+uint64_t TcpServer::add_connection(std::shared_ptr<TcpConnection> conn) {
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        id = next_connection_id_++;
+        active_connections_.emplace(id, std::move(conn));
+        ++running_handlers_;
+        SPDLOG_DEBUG("Active connections: {}", active_connections_.size());
+    }
+    
+    if (options_.idle_timeout_sec > 0) {
+        std::lock_guard<std::mutex> lock(wheel_mutex_);
+        schedule_idle_check(id, now_ms() + options_.idle_timeout_sec * 1000LL);
+    }
+    return id;
 }
 
-void TcpServer::add_connection(std::shared_ptr<TcpConnection> conn) {
+void TcpServer::remove_connection(uint64_t id) {
     std::lock_guard<std::mutex> lock(connections_mutex_);
-    active_connections_.push_back(conn);
-    spdlog::debug("Active connections: {}", active_connections_.size());
+    active_connections_.erase(id);
+    SPDLOG_DEBUG("Active connections: {}", active_connections_.size());
 }
 
-void TcpServer::remove_connection(std::shared_ptr<TcpConnection> conn) {
+std::shared_ptr<TcpConnection> TcpServer::find_connection(uint64_t id) const {
     std::lock_guard<std::mutex> lock(connections_mutex_);
-    auto it = std::find(active_connections_.begin(), active_connections_.end(), conn);
-    if (it != active_connections_.end()) {
-        active_connections_.erase(it);
-    }
-    spdlog::debug("Active connections: {}", active_connections_.size());
+    auto it = active_connections_.find(id);
+    return it != active_connections_.end() ? it->second : nullptr;
 }
 
 void TcpServer::cleanup_connections() {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
+    std::vector<std::shared_ptr<TcpConnection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        connections.reserve(active_connections_.size());
+        for (auto& entry : active_connections_) {
+            connections.push_back(entry.second);
+        }
+    }
     
-    spdlog::info("Closing {} active connections", active_connections_.size());
+    spdlog::info("Closing {} active connections", connections.size());
     
-    for (auto& conn : active_connections_) {
+    // Handlers remove themselves as they exit
+    for (auto& conn : connections) {
         conn->close();
     }
+}
+
+void TcpServer::reap_loop() {
+    const int64_t timeout_ms = options_.idle_timeout_sec * 1000LL;
+    std::vector<WheelEntry> due;
+    std::vector<std::pair<uint64_t, int64_t>> rescheduled;
+    
+    std::unique_lock<std::mutex> lock(wheel_mutex_);
+    while (!should_stop_.load(std::memory_order_acquire)) {
+        wheel_cv_.wait_for(lock, std::chrono::milliseconds(WHEEL_TICK_MS));
+        if (should_stop_.load(std::memory_order_acquire)) {
+            break;
+        }
+        
+        // After a long stall, one pass over the wheel covers every slot
+        uint64_t now_tick = static_cast<uint64_t>((now_ms() - wheel_start_ms_) / WHEEL_TICK_MS);
+        if (now_tick > wheel_tick_ + WHEEL_SLOTS) {
+            wheel_tick_ = now_tick - WHEEL_SLOTS;
+        }
+        due.clear();
+        while (wheel_tick_ < now_tick) {
+            ++wheel_tick_;
+            auto& slot = wheel_[wheel_tick_ % WHEEL_SLOTS];
+            size_t kept = 0;
+            for (const auto& entry : slot) {
+                if (entry.tick <= wheel_tick_) {
+                    due.push_back(entry);
+                } else {
+                    slot[kept++] = entry;
+                }
+            }
+            slot.resize(kept);
+        }
+        if (due.empty()) {
+            continue;
+        }
+        lock.unlock();
+        
+        // Closed connections are simply not rescheduled
+        rescheduled.clear();
+        int64_t now = now_ms();
+        for (const auto& entry : due) {
+            auto conn = find_connection(entry.id);
+            if (!conn || !conn->is_connected()) {
+                continue;
+            }
+            if (!conn->is_waiting()) {
+                rescheduled.emplace_back(entry.id, now + timeout_ms);
+                continue;
+            }
+            int64_t deadline = conn->last_activity_ms() + timeout_ms;
+            if (deadline <= now) {
+                SPDLOG_DEBUG("Closing idle connection {}:{}", conn->remote_address(), conn->remote_port());
+                conn->close();
+                continue;
+            }
+            rescheduled.emplace_back(entry.id, deadline);
+        }
+        
+        lock.lock();
+        for (const auto& [id, deadline] : rescheduled) {
+            schedule_idle_check(id, deadline);
+        }
+    }
+}
+
+void TcpServer::schedule_idle_check(uint64_t id, int64_t deadline_ms) {
+    int64_t offset = std::max<int64_t>(0, deadline_ms - wheel_start_ms_);
+    uint64_t tick = static_cast<uint64_t>((offset + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS);
+    tick = std::max(tick, wheel_tick_ + 1);
+    wheel_[tick % WHEEL_SLOTS].push_back({id, tick});
+}
+
+size_t TcpServer::listener_count() const {
+    if (!options_.unix_path.empty()) {
+        return 1;
+    }
+    if (options_.listeners > 0) {
+        return static_cast<size_t>(options_.listeners);
+    }
+    return std::max<size_t>(1, allowed_cpus().size());
+}
+
+int TcpServer::open_listener() {
+    int fd = create_socket();
+    if (fd < 0) {
+        return -1;
+    }
+    if (!bind_socket(fd) || !listen_socket(fd)) {
+        ::close(fd);
+        return -1;
+    }
     
-    active_connections_.clear();
+    // With an ephemeral port, the remaining listeners join the one picked here
+    if (options_.unix_path.empty() && options_.port == 0) {
+        sockaddr_in bound;
+        socklen_t len = sizeof(bound);
+        if (::getsockname(fd, (sockaddr*)&bound, &len) == 0) {
+            options_.port = ntohs(bound.sin_port);
+        }
+    }
+    return fd;
 }
 
-bool TcpServer::create_socket() {
-    server_fd_ = ::socket(AF_INET, SOCK_STREAM, 0);
+int TcpServer::create_socket() {
+    int fd = ::socket(options_.unix_path.empty() ? AF_INET : AF_UNIX, SOCK_STREAM, 0);
     
-    if (server_fd_ < 0) {
+    if (fd < 0) {
         spdlog::error("Failed to create socket: {}", strerror(errno));
-        return false;
+        return -1;
+    }
+    
+    if (!options_.unix_path.empty()) {
+        return fd;
     }
     
     int opt = 1;
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         spdlog::warn("Failed to set SO_REUSEADDR: {}", strerror(errno));
     }
     
-    if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+    // Required for more than one listener on the port
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        if (listener_count() > 1) {
+            spdlog::error("Failed to set SO_REUSEPORT: {}", strerror(errno));
+            ::close(fd);
+            return -1;
+        }
         spdlog::warn("Failed to set SO_REUSEPORT: {}", strerror(errno));
     }
     
-    return true;
+    return fd;
 }
 
-bool TcpServer::bind_socket() {
+bool TcpServer::bind_socket(int fd) {
+    if (!options_.unix_path.empty()) {
+        return bind_unix_socket(fd);
+    }
+    
     sockaddr_in server_addr;
     std::memset(&server_addr, 0, sizeof(server_addr));
     
@@ -354,30 +681,84 @@ bool TcpServer::bind_socket() {
         }
     }
     
-    if (::bind(server_fd_, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    if (::bind(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
         spdlog::error("Failed to bind to {}:{}: {}", options_.address, options_.port, strerror(errno));
         return false;
     }
     
-    spdlog::info("Bound to {}:{}", options_.address, options_.port);
+    SPDLOG_DEBUG("Bound to {}:{}", options_.address, options_.port);
     return true;
 }
 
-bool TcpServer::listen_socket() {
-    if (::listen(server_fd_, options_.listen_backlog) < 0) {
+bool TcpServer::bind_unix_socket(int fd) {
+    sockaddr_un server_addr;
+    std::memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sun_family = AF_UNIX;
+    
+    const std::string& path = options_.unix_path;
+    if (path.size() >= sizeof(server_addr.sun_path)) {
+        spdlog::error("Unix socket path too long: {}", path);
+        return false;
+    }
+    std::memcpy(server_addr.sun_path, path.c_str(), path.size() + 1);
+    
+    // A socket file left behind by a previous run is replaced, a live one is not
+    struct stat st;
+    if (::lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            spdlog::error("{} exists and is not a socket", path);
+            return false;
+        }
+        int probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        bool in_use = probe >= 0 && ::connect(probe, (sockaddr*)&server_addr, sizeof(server_addr)) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (in_use) {
+            spdlog::error("Unix socket {} is in use by another process", path);
+            return false;
+        }
+        ::unlink(path.c_str());
+    }
+    
+    if (::bind(fd, (sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+        spdlog::error("Failed to bind to {}: {}", path, strerror(errno));
+        return false;
+    }
+    unix_bound_ = true;
+    
+    // Nobody can connect before listen(), so the umask's mode is never usable
+    if (::chmod(path.c_str(), static_cast<mode_t>(options_.unix_socket_mode)) < 0) {
+        spdlog::error("Failed to set permissions of {}: {}", path, strerror(errno));
+        return false;
+    }
+    
+    spdlog::info("Bound to unix://{} (mode {:04o})", path, options_.unix_socket_mode);
+    return true;
+}
+
+bool TcpServer::listen_socket(int fd) {
+    if (::listen(fd, options_.listen_backlog) < 0) {
         spdlog::error("Failed to listen: {}", strerror(errno));
         return false;
     }
     
-    spdlog::info("Listening with backlog: {}", options_.listen_backlog);
+    SPDLOG_DEBUG("Listening with backlog: {}", options_.listen_backlog);
     return true;
 }
 
-void TcpServer::close_socket() {
-    if (server_fd_ >= 0) {
-        ::shutdown(server_fd_, SHUT_RDWR);
-        ::close(server_fd_);
-        server_fd_ = -1;
+// Shutting down a listening socket wakes the thread blocked in accept()
+void TcpServer::close_sockets() {
+    for (auto& listener : listeners_) {
+        if (listener->fd >= 0) {
+            ::shutdown(listener->fd, SHUT_RDWR);
+            ::close(listener->fd);
+            listener->fd = -1;
+        }
+    }
+    if (unix_bound_) {
+        ::unlink(options_.unix_path.c_str());
+        unix_bound_ = false;
     }
 }
 
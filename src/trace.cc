@@ -0,0 +1,144 @@
+
+#include "diarkis/trace.h"
+#include "bvar/bvar.h"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <random>
+
+namespace diarkis::trace {
+
+namespace {
+    thread_local Trace* t_current = nullptr;
+
+    // Slow traces, newest last, readable at /vars/diarkis_slow_traces
+    class SlowTraceRing {
+    public:
+        void configure(const Options& opts) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            options_ = opts;
+            while (traces_.size() > options_.ring_size) {
+                traces_.pop_front();
+            }
+            if (!exposed_) {
+                exposed_ = std::make_unique<bvar::PassiveStatus<std::string>>(
+                    "diarkis_slow_traces", &SlowTraceRing::describe, this);
+            }
+        }
+
+        void push(std::unique_ptr<Trace> trace) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (options_.ring_size == 0) {
+                return;
+            }
+            if (traces_.size() >= options_.ring_size) {
+                traces_.pop_front();
+            }
+            traces_.push_back(std::move(trace));
+        }
+
+    private:
+        static void describe(std::ostream& os, void* arg) {
+            auto* ring = static_cast<SlowTraceRing*>(arg);
+            std::lock_guard<std::mutex> lock(ring->mutex_);
+            for (auto it = ring->traces_.rbegin(); it != ring->traces_.rend(); ++it) {
+                const Trace& t = **it;
+                os << "trace=" << std::hex << t.id() << std::dec
+                   << " wall_us=" << t.wall_start_us()
+                   << " cmd=" << commands::type_name(t.type())
+                   << " path=" << t.path()
+                   << " total_us=" << t.total_us();
+                for (const auto& span : t.spans()) {
+                    os << ' ' << span.name << '@' << span.offset_us << '+' << span.duration_us;
+                }
+                os << '\n';
+            }
+        }
+
+        std::mutex mutex_;
+        Options options_;
+        std::deque<std::unique_ptr<Trace>> traces_;
+        std::unique_ptr<bvar::PassiveStatus<std::string>> exposed_;
+    };
+
+    SlowTraceRing& ring() {
+        static SlowTraceRing instance;
+        return instance;
+    }
+
+    std::atomic<uint32_t> g_sample_threshold{0};    // sample_rate scaled to 2^32
+    std::atomic<int64_t> g_slow_threshold_us{100000};
+
+    uint64_t next_random() {
+        thread_local std::mt19937_64 rng(std::random_device{}());
+        return rng();
+    }
+}
+
+Trace::Trace(uint64_t id, commands::Type type, std::string path, Clock::time_point start)
+    : id_(id), type_(type), path_(std::move(path)), start_(start) {
+    auto wall_now = std::chrono::system_clock::now();
+    wall_start_us_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        wall_now.time_since_epoch()).count() - offset_us(Clock::now());
+    spans_.reserve(8);
+}
+
+int64_t Trace::offset_us(Clock::time_point t) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(t - start_).count();
+}
+
+void Trace::add_span(const char* name, Clock::time_point start, Clock::time_point end) {
+    spans_.push_back({name, offset_us(start),
+                      std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()});
+}
+
+void Trace::finish() {
+    total_us_ = offset_us(Clock::now());
+}
+
+void configure(const Options& opts) {
+    double rate = opts.sample_rate < 0.0 ? 0.0 : (opts.sample_rate > 1.0 ? 1.0 : opts.sample_rate);
+    g_sample_threshold.store(static_cast<uint32_t>(rate * 4294967295.0), std::memory_order_relaxed);
+    g_slow_threshold_us.store(opts.slow_threshold_us, std::memory_order_relaxed);
+    ring().configure(opts);
+}
+
+uint64_t sample(uint64_t requested_id) {
+    if (requested_id != 0) {
+        return requested_id;
+    }
+    uint32_t threshold = g_sample_threshold.load(std::memory_order_relaxed);
+    if (threshold == 0) {
+        return 0;
+    }
+    if (static_cast<uint32_t>(next_random()) > threshold) {
+        return 0;
+    }
+    uint64_t id = next_random();
+    return id != 0 ? id : 1;
+}
+
+void submit(std::unique_ptr<Trace> trace) {
+    if (!trace) {
+        return;
+    }
+    trace->finish();
+    if (trace->total_us() >= g_slow_threshold_us.load(std::memory_order_relaxed)) {
+        ring().push(std::move(trace));
+    }
+}
+
+Trace* current() {
+    return t_current;
+}
+
+ScopedTrace::ScopedTrace(Trace* trace) : previous_(t_current) {
+    t_current = trace;
+}
+
+ScopedTrace::~ScopedTrace() {
+    t_current = previous_;
+}
+
+}
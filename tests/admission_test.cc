@@ -0,0 +1,235 @@
+#include "diarkis/admission.h"
+#include "check.h"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+    using namespace std::chrono_literals;
+    
+    using diarkis::Lane;
+    
+    using diarkis::test::check;
+    
+    void test_budget_capacity() {
+        diarkis::MemoryBudget budget(100);
+        check(budget.try_acquire(60, 0ms), "acquire within capacity");
+        check(!budget.try_acquire(50, 0ms), "acquire beyond capacity");
+        check(budget.try_acquire(40, 0ms), "acquire the rest");
+        check(budget.in_use() == 100, "budget full");
+        budget.release(60);
+        budget.release(40);
+        check(budget.in_use() == 0, "budget released");
+        
+        // Could never fit, so it fails without waiting
+        auto start = std::chrono::steady_clock::now();
+        check(!budget.try_acquire(101, 1000ms), "larger than the capacity");
+        check(std::chrono::steady_clock::now() - start < 500ms, "oversized request does not wait");
+    }
+    
+    void test_budget_waits_for_release() {
+        diarkis::MemoryBudget budget(100);
+        check(budget.try_acquire(100, 0ms), "fill budget");
+        std::thread releaser([&] {
+            std::this_thread::sleep_for(20ms);
+            budget.release(100);
+        });
+        check(budget.try_acquire(50, 5000ms), "acquire after release");
+        releaser.join();
+        check(budget.in_use() == 50, "waiter holds its bytes");
+        
+        auto start = std::chrono::steady_clock::now();
+        check(!budget.try_acquire(60, 20ms), "times out while full");
+        check(std::chrono::steady_clock::now() - start >= 20ms, "waited the timeout");
+    }
+    
+    void test_lease() {
+        diarkis::MemoryBudget budget(100);
+        {
+            diarkis::BudgetLease lease(budget, 70, 0ms);
+            check(static_cast<bool>(lease), "lease granted");
+            diarkis::BudgetLease refused(budget, 40, 0ms);
+            check(!refused, "lease refused");
+            check(budget.in_use() == 70, "refused lease holds nothing");
+            
+            diarkis::BudgetLease moved(std::move(lease));
+            check(!lease && moved, "lease moved");
+            check(budget.in_use() == 70, "move keeps one charge");
+            
+            diarkis::BudgetLease assigned;
+            assigned = std::move(moved);
+            check(assigned && budget.in_use() == 70, "lease move assigned");
+        }
+        check(budget.in_use() == 0, "lease released on destruction");
+        
+        diarkis::BudgetLease lease(budget, 30, 0ms);
+        lease = diarkis::BudgetLease(budget, 20, 0ms);
+        check(budget.in_use() == 20, "assignment releases the old lease");
+        lease.release();
+        lease.release();
+        check(budget.in_use() == 0, "release is idempotent");
+    }
+    
+    // Waits until the scheduler has count requests queued in the lane
+    void wait_queued(diarkis::LaneScheduler& scheduler, Lane lane, size_t count) {
+        while (scheduler.queued(lane) < count) {
+            std::this_thread::sleep_for(1ms);
+        }
+    }
+    
+    // Queues one request per label while a single slot is held, then frees
+    // the slot; each request records its label when granted and releases
+    std::string grant_order(diarkis::LaneScheduler& scheduler,
+                            const std::vector<std::pair<Lane, uint64_t>>& requests,
+                            const std::vector<size_t>& sizes, const std::string& labels) {
+        check(scheduler.try_acquire(Lane::INTERACTIVE, 0, 0, 0ms), "hold the only slot");
+        
+        std::mutex mutex;
+        std::string order;
+        std::vector<std::thread> threads;
+        size_t queued[diarkis::LANE_COUNT] = {};
+        for (size_t i = 0; i < requests.size(); ++i) {
+            Lane lane = requests[i].first;
+            threads.emplace_back([&, i, lane] {
+                if (scheduler.try_acquire(lane, requests[i].second, sizes[i], 5000ms)) {
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        order += labels[i];
+                    }
+                    scheduler.release(lane);
+                }
+            });
+            // Queued one at a time so arrival order is fixed
+            wait_queued(scheduler, lane, ++queued[static_cast<size_t>(lane)]);
+        }
+        
+        scheduler.release(Lane::INTERACTIVE);
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        return order;
+    }
+    
+    void test_lane_limits() {
+        diarkis::LaneScheduler::Options options;
+        options.max_active = 3;
+        options.bulk_max_active = 1;
+        diarkis::LaneScheduler scheduler(options);
+        
+        check(scheduler.try_acquire(Lane::BULK, 1, 0, 0ms), "first bulk slot");
+        check(!scheduler.try_acquire(Lane::BULK, 1, 0, 0ms), "bulk capped on its own");
+        check(scheduler.try_acquire(Lane::INTERACTIVE, 1, 0, 0ms), "interactive beside bulk");
+        check(scheduler.try_acquire(Lane::INTERACTIVE, 1, 0, 0ms), "last slot");
+        check(!scheduler.try_acquire(Lane::INTERACTIVE, 1, 0, 0ms), "all slots taken");
+        check(scheduler.active(Lane::INTERACTIVE) == 2 && scheduler.active(Lane::BULK) == 1, "active counts");
+        check(scheduler.queued(Lane::INTERACTIVE) == 0, "timed out waiter removed");
+        
+        scheduler.release(Lane::BULK);
+        check(scheduler.try_acquire(Lane::BULK, 1, 0, 0ms), "bulk slot freed");
+        scheduler.release(Lane::BULK);
+        scheduler.release(Lane::INTERACTIVE);
+        scheduler.release(Lane::INTERACTIVE);
+    }
+    
+    // With both lanes queued, bulk gets one slot per interactive_weight
+    // interactive grants
+    void test_lane_weights() {
+        diarkis::LaneScheduler::Options options;
+        options.max_active = 1;
+        options.interactive_weight = 2;
+        diarkis::LaneScheduler scheduler(options);
+        
+        std::string order = grant_order(scheduler,
+            {{Lane::BULK, 1}, {Lane::INTERACTIVE, 1}, {Lane::INTERACTIVE, 1}, {Lane::INTERACTIVE, 1}},
+            {0, 0, 0, 0}, "BIII");
+        check(order == "IIBI", "interactive lane weighted over bulk");
+    }
+    
+    // A client with a backlog of large requests cannot hold back another
+    // client's small one in the same lane
+    void test_fair_queuing() {
+        diarkis::LaneScheduler::Options options;
+        options.max_active = 1;
+        diarkis::LaneScheduler scheduler(options);
+        
+        size_t large = 1024 * 1024;
+        std::string order = grant_order(scheduler,
+            {{Lane::INTERACTIVE, 1}, {Lane::INTERACTIVE, 1}, {Lane::INTERACTIVE, 1}, {Lane::INTERACTIVE, 2}},
+            {large, large, large, 0}, "AAAB");
+        check(order == "BAAA", "small client served ahead of a large backlog");
+    }
+    
+    diarkis::RateLimiter::Options rate_options(double ops_per_sec, double bytes_per_sec) {
+        diarkis::RateLimiter::Options options;
+        options.ops_per_sec = ops_per_sec;
+        options.bytes_per_sec = bytes_per_sec;
+        return options;
+    }
+    
+    void test_rate_limit_ops() {
+        check(!diarkis::RateLimiter(rate_options(0, 0)).enabled(), "no rates disables the limiter");
+        
+        diarkis::RateLimiter limiter(rate_options(10, 0));
+        std::chrono::microseconds delay{0};
+        bool burst = true;
+        for (int i = 0; i < 10; ++i) {
+            burst = limiter.acquire("a", 1, 0ms, delay) && delay.count() == 0 && burst;
+        }
+        check(burst, "burst passes without delay");
+        
+        check(!limiter.acquire("a", 1, 0ms, delay), "over the rate");
+        check(delay >= 90ms && delay <= 100ms, "delay is the time to the next token");
+        check(!limiter.acquire("a", 1, 0ms, delay) && delay >= 90ms,
+              "a refused request reserves nothing");
+        check(limiter.acquire("a", 1, 1000ms, delay) && delay >= 90ms, "delayed within max_wait");
+        
+        check(limiter.acquire("b", 1, 0ms, delay) && delay.count() == 0, "clients have their own buckets");
+        check(limiter.clients() == 2, "one bucket per client");
+    }
+    
+    void test_rate_limit_bytes() {
+        diarkis::RateLimiter limiter(rate_options(0, 1000));
+        std::chrono::microseconds delay{0};
+        
+        // Larger than the burst: passes, and the debt delays what follows
+        check(limiter.acquire("a", 5000, 0ms, delay) && delay.count() == 0, "payload above the burst");
+        check(!limiter.acquire("a", 1, 100ms, delay), "debt repaid before the next request");
+        check(delay >= 3900ms, "delay covers the debt");
+        
+        check(limiter.acquire("b", 500, 0ms, delay) && delay.count() == 0, "within the burst");
+        limiter.charge("b", 1000);
+        check(!limiter.acquire("b", 1, 0ms, delay) && delay >= 400ms, "charged response bytes");
+    }
+    
+    void test_rate_limit_eviction() {
+        auto options = rate_options(1000, 0);
+        options.burst_sec = 0.01;
+        options.max_clients = 2;
+        diarkis::RateLimiter limiter(options);
+        std::chrono::microseconds delay{0};
+        
+        check(limiter.acquire("a", 1, 0ms, delay), "client a");
+        check(limiter.acquire("b", 1, 0ms, delay), "client b");
+        std::this_thread::sleep_for(30ms);
+        check(limiter.acquire("c", 1, 0ms, delay), "client c");
+        check(limiter.clients() == 1, "refilled buckets dropped at the limit");
+    }
+}
+
+int main() {
+    test_budget_capacity();
+    test_budget_waits_for_release();
+    test_lease();
+    test_lane_limits();
+    test_lane_weights();
+    test_fair_queuing();
+    test_rate_limit_ops();
+    test_rate_limit_bytes();
+    test_rate_limit_eviction();
+    
+    return diarkis::test::finish("admission");
+}
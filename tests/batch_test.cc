@@ -0,0 +1,112 @@
+#include "diarkis/codec.h"
+#include "check.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+    namespace commands = diarkis::commands;
+    namespace codec = diarkis::commands::codec;
+    
+    using diarkis::test::check;
+    using commands::BatchRun;
+    using commands::Type;
+    
+    msgpack::sbuffer pack(const std::vector<commands::Command>& batch) {
+        msgpack::sbuffer buffer;
+        msgpack::pack(buffer, batch);
+        return buffer;
+    }
+    
+    bool decode(codec::Decoder& decoder, const msgpack::sbuffer& buffer, std::vector<commands::CommandView>& views) {
+        return decoder.decode_batch(reinterpret_cast<const uint8_t*>(buffer.data()), buffer.size(), views);
+    }
+    
+    std::vector<commands::CommandView> views_of(const std::vector<Type>& types) {
+        std::vector<commands::CommandView> views(types.size());
+        for (size_t i = 0; i < types.size(); ++i) {
+            views[i].type = types[i];
+        }
+        return views;
+    }
+    
+    bool same(const std::vector<BatchRun>& runs, const std::vector<BatchRun>& expected) {
+        if (runs.size() != expected.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < runs.size(); ++i) {
+            if (runs[i].kind != expected[i].kind || runs[i].begin != expected[i].begin ||
+                runs[i].end != expected[i].end) {
+                return false;
+            }
+        }
+        return true;
+    }
+    
+    void test_decode_batch() {
+        std::vector<commands::Command> batch = {
+            commands::Command(Type::WRITE_FILE, "a", std::vector<uint8_t>{1, 2, 3}),
+            commands::Command(Type::RENAME, "a", std::string("b")),
+            commands::Command(Type::READ_FILE, "b"),
+        };
+        batch[2].trace_id = 7;
+        
+        codec::Decoder decoder;
+        std::vector<commands::CommandView> views;
+        auto buffer = pack(batch);
+        bool decoded = decode(decoder, buffer, views) && views.size() == batch.size();
+        for (size_t i = 0; decoded && i < batch.size(); ++i) {
+            auto cmd = views[i].to_command();
+            decoded = cmd.type == batch[i].type && cmd.path == batch[i].path &&
+                      cmd.new_path == batch[i].new_path && cmd.contents == batch[i].contents &&
+                      cmd.trace_id == batch[i].trace_id;
+        }
+        check(decoded, "batch decoded in order");
+        
+        check(decode(decoder, pack({}), views) && views.empty(), "empty batch");
+        
+        msgpack::sbuffer not_array;
+        msgpack::pack(not_array, std::string("batch"));
+        check(!decode(decoder, not_array, views), "batch that is not an array");
+    }
+    
+    // Writes and reads alternate in runs, in the order they were sent
+    void test_runs_in_order() {
+        auto views = views_of({Type::WRITE_FILE, Type::CREATE_DIR, Type::READ_FILE, Type::LIST_DIR,
+                               Type::READ_FILE, Type::DELETE_FILE, Type::READ_FILE});
+        std::vector<BatchRun> runs;
+        check(commands::plan_batch(views, views.size(), runs), "batch within the limit");
+        check(same(runs, {{BatchRun::WRITE, 0, 2}, {BatchRun::READ, 2, 5}, {BatchRun::WRITE, 5, 6},
+                          {BatchRun::READ, 6, 7}}), "runs of writes and reads");
+        
+        check(commands::plan_batch({}, 0, runs) && runs.empty(), "empty batch has no runs");
+    }
+    
+    // Commands that are neither reads nor writes are runs of their own, and
+    // split the runs around them
+    void test_other_commands() {
+        auto views = views_of({Type::WRITE_FILE, Type::HELLO, Type::BATCH, Type::APPEND_FILE,
+                               Type::ATTACH_SHM, Type::READ_FILE});
+        std::vector<BatchRun> runs;
+        check(commands::plan_batch(views, views.size(), runs), "batch with other commands");
+        check(same(runs, {{BatchRun::WRITE, 0, 1}, {BatchRun::OTHER, 1, 2}, {BatchRun::OTHER, 2, 3},
+                          {BatchRun::WRITE, 3, 4}, {BatchRun::OTHER, 4, 5}, {BatchRun::READ, 5, 6}}),
+              "other commands run alone");
+    }
+    
+    void test_max_commands() {
+        auto views = views_of({Type::WRITE_FILE, Type::READ_FILE, Type::WRITE_FILE});
+        std::vector<BatchRun> runs;
+        check(commands::plan_batch(views, 3, runs) && runs.size() == 3, "batch at the limit");
+        check(!commands::plan_batch(views, 2, runs) && runs.empty(), "batch over the limit");
+    }
+}
+
+int main() {
+    test_decode_batch();
+    test_runs_in_order();
+    test_other_commands();
+    test_max_commands();
+    
+    return diarkis::test::finish("batch");
+}
@@ -0,0 +1,36 @@
+#ifndef DIARKIS_TESTS_CHECK_H
+#define DIARKIS_TESTS_CHECK_H
+
+#include <cstdio>
+#include <string>
+
+// The checks shared by the test binaries: check() counts failures instead of
+// aborting, so one run reports all of them, and finish() turns the count into
+// the exit status
+namespace diarkis {
+
+namespace test {
+
+inline int g_failures = 0;
+
+inline void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::fprintf(stderr, "FAILED: %s\n", what.c_str());
+        ++g_failures;
+    }
+}
+
+inline int finish(const char* suite) {
+    if (g_failures > 0) {
+        std::fprintf(stderr, "%d check(s) failed\n", g_failures);
+        return 1;
+    }
+    std::printf("All %s tests passed\n", suite);
+    return 0;
+}
+
+}
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#include "diarkis/codec.h"
+#include "check.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+    namespace commands = diarkis::commands;
+    namespace codec = diarkis::commands::codec;
+    
+    using diarkis::test::check;
+    
+    commands::Command sample() {
+        commands::Command cmd(commands::Type::WRITE_FILE, "dir/file", std::vector<uint8_t>{1, 2, 3, 4, 5});
+        cmd.new_path = "other";
+        cmd.trace_id = 0x0123456789ABCDEF;
+        return cmd;
+    }
+    
+    std::vector<uint8_t> encoded(const commands::Command& cmd) {
+        std::vector<uint8_t> out;
+        codec::encode(commands::CommandView(cmd), out);
+        return out;
+    }
+    
+    bool same(const commands::CommandView& view, const commands::Command& cmd) {
+        return view.type == cmd.type && view.path == cmd.path && view.new_path == cmd.new_path &&
+               view.trace_id == cmd.trace_id &&
+               std::vector<uint8_t>(view.contents, view.contents + view.contents_size) == cmd.contents;
+    }
+    
+    void set_u32(std::vector<uint8_t>& data, size_t offset, uint32_t v) {
+        for (int i = 0; i < 4; ++i) {
+            data[offset + i] = static_cast<uint8_t>(v >> (8 * i));
+        }
+    }
+    
+    void test_round_trip() {
+        auto cmd = sample();
+        auto data = encoded(cmd);
+        check(codec::is_compact(data.data(), data.size()), "compact magic");
+        check(data.size() == codec::encoded_size(commands::CommandView(cmd)), "encoded size");
+        
+        commands::CommandView view;
+        check(codec::decode(data.data(), data.size(), view) && same(view, cmd), "round trip");
+        check(view.compression == commands::compression::Algorithm::NONE, "uncompressed");
+        check(codec::inflated_size(data.data(), data.size()) == 0, "no inflated size when uncompressed");
+        
+        commands::Command empty(commands::Type::LIST_DIR, "");
+        auto empty_data = encoded(empty);
+        check(codec::decode(empty_data.data(), empty_data.size(), view) && same(view, empty), "empty fields");
+    }
+    
+    // Every strict prefix and any trailing byte is rejected
+    void test_truncated_and_trailing() {
+        auto data = encoded(sample());
+        commands::CommandView view;
+        bool rejected = true;
+        for (size_t size = 0; size < data.size(); ++size) {
+            rejected = !codec::decode(data.data(), size, view) && codec::frame_size(data.data(), size) == 0 &&
+                       rejected;
+        }
+        check(rejected, "truncated input");
+        
+        data.push_back(0);
+        check(!codec::decode(data.data(), data.size(), view), "trailing byte");
+    }
+    
+    void test_bad_header() {
+        commands::CommandView view;
+        
+        auto version = encoded(sample());
+        version[1] = codec::VERSION + 1;
+        check(!codec::decode(version.data(), version.size(), view), "unknown version");
+        
+        auto flags = encoded(sample());
+        flags[3] = 0x04;
+        check(!codec::decode(flags.data(), flags.size(), view), "unknown flags");
+        
+        // Lengths summing past 32 bits must not wrap into the real size
+        auto lengths = encoded(sample());
+        set_u32(lengths, 4, 0xFFFFFFFF);
+        set_u32(lengths, 8, 0xFFFFFFFF);
+        check(!codec::decode(lengths.data(), lengths.size(), view), "huge lengths");
+        check(codec::frame_size(lengths.data(), lengths.size()) == 0, "huge lengths frame size");
+        check(codec::inflated_size(lengths.data(), lengths.size()) == 0, "huge lengths inflated size");
+    }
+    
+    // Concatenated commands, as in the compact Raft log, are walked by frame_size
+    void test_frame_size() {
+        auto first = sample();
+        commands::Command second(commands::Type::DELETE_FILE, "gone");
+        std::vector<uint8_t> data;
+        codec::encode(commands::CommandView(first), data);
+        size_t first_size = data.size();
+        codec::encode(commands::CommandView(second), data);
+        
+        check(codec::frame_size(data.data(), data.size()) == first_size, "first frame");
+        size_t rest = data.size() - first_size;
+        check(codec::frame_size(data.data() + first_size, rest) == rest, "second frame");
+        
+        commands::CommandView view;
+        check(codec::decode(data.data() + first_size, rest, view) && same(view, second), "second command");
+    }
+    
+    // Compressed contents declare their inflated size in a prefix
+    void test_compressed_contents() {
+        std::vector<uint8_t> payload = {0x00, 0x00, 0x10, 0x00, 0xAA, 0xBB};  // declares 1 MB
+        commands::Command cmd(commands::Type::WRITE_FILE, "f", payload);
+        commands::CommandView view(cmd);
+        view.compression = commands::compression::Algorithm::ZSTD;
+        std::vector<uint8_t> data;
+        codec::encode(view, data);
+        check(codec::inflated_size(data.data(), data.size()) == 1024 * 1024, "declared inflated size");
+        
+        // Garbage contents never decode, and the declared size is capped
+        commands::codec::Decoder decoder;
+        decoder.set_max_inflated(1024);
+        commands::CommandView out;
+        check(!decoder.decode(data.data(), data.size(), out), "inflated size above the limit");
+    }
+    
+    void test_decoder_msgpack() {
+        auto cmd = sample();
+        msgpack::sbuffer buffer;
+        msgpack::pack(buffer, cmd);
+        
+        commands::codec::Decoder decoder;
+        commands::CommandView view;
+        const auto* data = reinterpret_cast<const uint8_t*>(buffer.data());
+        check(decoder.decode(data, buffer.size(), view) && same(view, cmd), "msgpack command");
+        
+        auto compact = encoded(cmd);
+        check(decoder.decode(compact.data(), compact.size(), view) && same(view, cmd), "compact command");
+        
+        std::vector<commands::Command> batch = {cmd, commands::Command(commands::Type::READ_FILE, "r")};
+        msgpack::sbuffer batch_buffer;
+        msgpack::pack(batch_buffer, batch);
+        std::vector<commands::CommandView> views;
+        check(decoder.decode_batch(reinterpret_cast<const uint8_t*>(batch_buffer.data()), batch_buffer.size(), views) &&
+              views.size() == 2 && same(views[0], batch[0]) && same(views[1], batch[1]), "msgpack batch");
+        
+        msgpack::sbuffer not_array;
+        msgpack::pack(not_array, 42);
+        check(!decoder.decode_batch(reinterpret_cast<const uint8_t*>(not_array.data()), not_array.size(), views),
+              "batch that is not an array");
+    }
+}
+
+int main() {
+    test_round_trip();
+    test_truncated_and_trailing();
+    test_bad_header();
+    test_frame_size();
+    test_compressed_contents();
+    test_decoder_msgpack();
+    
+    return diarkis::test::finish("codec");
+}
@@ -0,0 +1,145 @@
+#include "diarkis/compression.h"
+#include "check.h"
+#include <cstdio>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+    namespace compression = diarkis::commands::compression;
+    using compression::Algorithm;
+    
+    using diarkis::test::check;
+    
+    std::vector<uint8_t> compressible(size_t size) {
+        std::vector<uint8_t> data(size);
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = static_cast<uint8_t>("diarkis "[i % 8]);
+        }
+        return data;
+    }
+    
+    std::vector<uint8_t> random_bytes(size_t size) {
+        std::mt19937 rng(42);
+        std::vector<uint8_t> data(size);
+        for (auto& byte : data) {
+            byte = static_cast<uint8_t>(rng());
+        }
+        return data;
+    }
+    
+    void set_raw_size(std::vector<uint8_t>& payload, uint32_t raw) {
+        for (int i = 0; i < 4; ++i) {
+            payload[i] = static_cast<uint8_t>(raw >> (8 * i));
+        }
+    }
+    
+    bool inflate(Algorithm algorithm, const std::vector<uint8_t>& payload, size_t max_raw = compression::MAX_RAW_SIZE) {
+        std::vector<uint8_t> out;
+        return compression::decompress(algorithm, payload.data(), payload.size(), out, max_raw);
+    }
+    
+    // The size prefix is read from untrusted input before anything is allocated
+    void test_size_prefix() {
+        const uint8_t prefix[] = {0x10, 0x32, 0x54, 0x76, 0xFF};
+        check(compression::raw_size(prefix, 3) == 0, "short prefix");
+        check(compression::raw_size(prefix, 4) == 0x76543210, "little endian prefix");
+        
+        std::vector<uint8_t> out;
+        for (Algorithm algorithm : {Algorithm::NONE, Algorithm::LZ4, Algorithm::ZSTD}) {
+            std::string name = compression::name(algorithm);
+            check(!compression::decompress(algorithm, prefix, 3, out), name + ": truncated prefix");
+            
+            std::vector<uint8_t> zero(16, 0);
+            check(!inflate(algorithm, zero), name + ": zero raw size");
+            
+            std::vector<uint8_t> huge(16, 0);
+            set_raw_size(huge, 0xFFFFFFFF);
+            check(!inflate(algorithm, huge), name + ": raw size above the limit");
+        }
+    }
+    
+    void test_unavailable() {
+        auto data = compressible(4096);
+        std::vector<uint8_t> out;
+        check(!compression::compress(Algorithm::NONE, data.data(), data.size(), out), "NONE never compresses");
+        check(!compression::compress(static_cast<Algorithm>(3), data.data(), data.size(), out),
+              "unknown algorithm");
+        for (Algorithm algorithm : {Algorithm::LZ4, Algorithm::ZSTD}) {
+            if (!compression::available(algorithm)) {
+                check(!compression::compress(algorithm, data.data(), data.size(), out),
+                      std::string(compression::name(algorithm)) + ": unavailable algorithm");
+            }
+        }
+    }
+    
+    void test_round_trip(Algorithm algorithm) {
+        std::string name = compression::name(algorithm);
+        for (size_t size : {size_t(64), size_t(4096), size_t(1024 * 1024)}) {
+            auto data = compressible(size);
+            std::vector<uint8_t> payload;
+            check(compression::compress(algorithm, data.data(), data.size(), payload), name + ": compress");
+            std::vector<uint8_t> out;
+            check(compression::decompress(algorithm, payload.data(), payload.size(), out) && out == data,
+                  name + ": round trip");
+        }
+        
+        std::vector<uint8_t> payload;
+        auto noise = random_bytes(256 * 1024);
+        check(!compression::compress(algorithm, noise.data(), noise.size(), payload),
+              name + ": incompressible data left as is");
+        std::vector<uint8_t> empty;
+        check(!compression::compress(algorithm, empty.data(), 0, payload), name + ": empty input");
+    }
+    
+    // Declared sizes that disagree with the frame are corrupt, whichever way
+    void test_corrupt(Algorithm algorithm) {
+        std::string name = compression::name(algorithm);
+        auto data = compressible(256 * 1024);
+        std::vector<uint8_t> payload;
+        if (!compression::compress(algorithm, data.data(), data.size(), payload)) {
+            check(false, name + ": compress");
+            return;
+        }
+        
+        auto larger = payload;
+        set_raw_size(larger, static_cast<uint32_t>(data.size() + 1));
+        check(!inflate(algorithm, larger), name + ": declared size too large");
+        
+        auto smaller = payload;
+        set_raw_size(smaller, static_cast<uint32_t>(data.size() - 1));
+        check(!inflate(algorithm, smaller), name + ": declared size too small");
+        
+        auto truncated = payload;
+        truncated.resize(payload.size() / 2);
+        check(!inflate(algorithm, truncated), name + ": truncated frame");
+        
+        check(!inflate(algorithm, payload, data.size() - 1), name + ": above the caller's limit");
+        check(inflate(algorithm, payload, data.size()), name + ": at the caller's limit");
+        
+        auto garbage = random_bytes(payload.size());
+        set_raw_size(garbage, static_cast<uint32_t>(data.size()));
+        check(!inflate(algorithm, garbage), name + ": garbage frame");
+    }
+}
+
+int main() {
+    test_size_prefix();
+    test_unavailable();
+    for (Algorithm algorithm : {Algorithm::LZ4, Algorithm::ZSTD}) {
+        if (compression::available(algorithm)) {
+            test_round_trip(algorithm);
+            test_corrupt(algorithm);
+        }
+    }
+    
+    // An LZ4 block cannot claim more than LZ4_MAX_RATIO times its size
+    if (compression::available(Algorithm::LZ4)) {
+        std::vector<uint8_t> tiny(4 + 16, 0);
+        set_raw_size(tiny, static_cast<uint32_t>(16 * compression::LZ4_MAX_RATIO + 1));
+        check(!inflate(Algorithm::LZ4, tiny), "lz4: declared size beyond the block ratio");
+    }
+    
+    return diarkis::test::finish("compression");
+}
@@ -0,0 +1,92 @@
+#include "diarkis/http.h"
+#include "check.h"
+#include <cstdint>
+#include <string>
+
+namespace {
+    namespace http = diarkis::http;
+    
+    using diarkis::test::check;
+    using http::Range;
+    
+    // True if header parses to the expected result, and for a satisfiable
+    // range to offset and length
+    bool range_is(const char* header, uint64_t size, Range expected, uint64_t offset = 0, uint64_t length = 0) {
+        uint64_t parsed_offset = 0;
+        uint64_t parsed_length = 0;
+        Range range = http::parse_range(header, size, parsed_offset, parsed_length);
+        if (range != expected) {
+            return false;
+        }
+        return range != Range::SATISFIABLE || (parsed_offset == offset && parsed_length == length);
+    }
+    
+    void test_ranges() {
+        check(range_is("bytes=0-99", 1000, Range::SATISFIABLE, 0, 100), "first and last");
+        check(range_is("bytes=0-4999", 1000, Range::SATISFIABLE, 0, 1000), "last past the end");
+        check(range_is("bytes=999-999", 1000, Range::SATISFIABLE, 999, 1), "last byte");
+        check(range_is(" bytes= 10-19 ", 1000, Range::SATISFIABLE, 10, 10), "surrounding spaces");
+        check(range_is("bytes=1000-1999", 1000, Range::UNSATISFIABLE), "first past the end");
+    }
+    
+    void test_open_ranges() {
+        check(range_is("bytes=500-", 1000, Range::SATISFIABLE, 500, 500), "first with no end");
+        check(range_is("bytes=999-", 1000, Range::SATISFIABLE, 999, 1), "last byte with no end");
+        check(range_is("bytes=1000-", 1000, Range::UNSATISFIABLE), "no end past the end");
+    }
+    
+    void test_suffix_ranges() {
+        check(range_is("bytes=-100", 1000, Range::SATISFIABLE, 900, 100), "suffix");
+        check(range_is("bytes=-5000", 1000, Range::SATISFIABLE, 0, 1000), "suffix longer than the file");
+        check(range_is("bytes=-0", 1000, Range::UNSATISFIABLE), "empty suffix");
+        check(range_is("bytes=-", 1000, Range::NONE), "suffix without length");
+    }
+    
+    // Served as the whole file rather than refused
+    void test_ignored_ranges() {
+        check(range_is("bytes=10-5", 1000, Range::NONE), "last before first");
+        check(range_is("bytes=0-1,5-6", 1000, Range::NONE), "multiple ranges");
+        check(range_is("bytes=0-1, -10", 1000, Range::NONE), "multiple ranges with a suffix");
+        check(range_is("items=0-1", 1000, Range::NONE), "other unit");
+        check(range_is("bytes=5", 1000, Range::NONE), "no dash");
+        check(range_is("bytes=a-b", 1000, Range::NONE), "not numbers");
+        check(range_is("bytes=+1-2", 1000, Range::NONE), "signed first");
+        check(range_is("bytes=99999999999999999999-", 1000, Range::NONE), "first overflows");
+        check(range_is("", 1000, Range::NONE), "empty header");
+    }
+    
+    // No byte of an empty file can be addressed
+    void test_empty_file() {
+        check(range_is("bytes=0-", 0, Range::UNSATISFIABLE), "no end in an empty file");
+        check(range_is("bytes=0-0", 0, Range::UNSATISFIABLE), "first byte of an empty file");
+        check(range_is("bytes=-10", 0, Range::UNSATISFIABLE), "suffix of an empty file");
+        check(range_is("bytes=5-1", 0, Range::NONE), "last before first in an empty file");
+    }
+    
+    void test_etag_matches() {
+        const std::string etag = "\"64-17d2\"";
+        check(http::etag_matches("\"64-17d2\"", etag), "same tag");
+        check(http::etag_matches("W/\"64-17d2\"", etag), "weak tag");
+        check(http::etag_matches("\"1-1\", \"64-17d2\"", etag), "tag in a list");
+        check(http::etag_matches("\"1-1\",W/\"64-17d2\" ", etag), "weak tag in a list");
+        check(http::etag_matches("*", etag), "any tag");
+        check(http::etag_matches("\"1-1\", *", etag), "any tag in a list");
+        check(!http::etag_matches("\"1-1\"", etag), "other tag");
+        check(!http::etag_matches("64-17d2", etag), "unquoted tag");
+        check(!http::etag_matches("\"64-17d2", etag), "truncated tag");
+        check(!http::etag_matches("w/\"64-17d2\"", etag), "lower case weak prefix");
+        check(!http::etag_matches("", etag), "empty header");
+        check(!http::etag_matches(" , ,", etag), "empty list elements");
+    }
+}
+
+int main() {
+    test_ranges();
+    test_open_ranges();
+    test_suffix_ranges();
+    test_ignored_ranges();
+    test_empty_file();
+    test_etag_matches();
+    
+    return diarkis::test::finish("http");
+}
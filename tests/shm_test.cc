@@ -0,0 +1,227 @@
+#include "diarkis/shm.h"
+#include "check.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+    namespace shm = diarkis::commands::shm;
+    
+    using diarkis::test::check;
+    
+    constexpr size_t CAPACITY = shm::MIN_RING_BYTES;
+    constexpr size_t GUARD = 64;
+    constexpr uint8_t GUARD_BYTE = 0xA5;
+    
+    // A ring over heap memory with guard bytes on both sides of the data
+    struct TestRing {
+        shm::RingControl control{};
+        std::vector<uint8_t> memory = std::vector<uint8_t>(GUARD + CAPACITY + GUARD, GUARD_BYTE);
+        shm::Ring producer{&control, memory.data() + GUARD, CAPACITY};
+        shm::Ring consumer{&control, memory.data() + GUARD, CAPACITY};
+        
+        bool guards_intact() const {
+            for (size_t i = 0; i < GUARD; ++i) {
+                if (memory[i] != GUARD_BYTE || memory[GUARD + CAPACITY + i] != GUARD_BYTE) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+    
+    bool send(shm::Ring& ring, const std::string& text, uint32_t request_id) {
+        uint8_t* out = ring.reserve(text.size());
+        if (!out) {
+            return false;
+        }
+        std::memcpy(out, text.data(), text.size());
+        ring.commit(text.size(), request_id);
+        return true;
+    }
+    
+    bool receive(shm::Ring& ring, std::string& text, uint32_t& request_id) {
+        const uint8_t* payload = nullptr;
+        size_t size = 0;
+        if (ring.peek(payload, size, request_id) != shm::Ring::Peek::FRAME) {
+            return false;
+        }
+        text.assign(reinterpret_cast<const char*>(payload), size);
+        ring.consume();
+        return true;
+    }
+    
+    void test_round_trip_with_wrap() {
+        TestRing ring;
+        std::string payload(CAPACITY / 3, 'x');
+        std::string text;
+        uint32_t id = 0;
+        
+        // Three frames of a third each force the third one to wrap
+        for (uint32_t i = 1; i <= 3; ++i) {
+            check(send(ring.producer, payload, i), "send before wrap");
+            check(receive(ring.consumer, text, id) && text == payload && id == i, "receive before wrap");
+        }
+        check(ring.control.tail.load() == ring.control.head.load(), "ring drained");
+        check(ring.guards_intact(), "guards after wrap");
+    }
+    
+    void test_oversized_frame_rejected() {
+        TestRing ring;
+        check(ring.producer.reserve(ring.producer.max_payload() + 1) == nullptr, "oversized reserve");
+    }
+    
+    // A peer moving the producer's tail between reserve() and commit() must
+    // not redirect the frame write outside the ring
+    void test_tail_corrupted_between_reserve_and_commit() {
+        TestRing ring;
+        std::string payload = "hello";
+        uint8_t* out = ring.producer.reserve(payload.size());
+        check(out != nullptr, "reserve");
+        std::memcpy(out, payload.data(), payload.size());
+        
+        ring.control.tail.store(CAPACITY - 4);
+        ring.producer.commit(payload.size(), 7);
+        check(ring.guards_intact(), "guards after corrupted tail");
+        check(ring.control.tail.load() == shm::align8(shm::FRAME_HEADER + payload.size()),
+              "commit publishes the producer's own tail");
+        
+        std::string text;
+        uint32_t id = 0;
+        check(receive(ring.consumer, text, id) && text == payload && id == 7, "frame survives corrupted tail");
+    }
+    
+    // A peer moving the consumer's head between peek() and consume() must
+    // not change what the consumer releases
+    void test_head_corrupted_between_peek_and_consume() {
+        TestRing ring;
+        check(send(ring.producer, "first", 1), "send first");
+        check(send(ring.producer, "second", 2), "send second");
+        
+        const uint8_t* payload = nullptr;
+        size_t size = 0;
+        uint32_t id = 0;
+        check(ring.consumer.peek(payload, size, id) == shm::Ring::Peek::FRAME && id == 1, "peek first");
+        ring.control.head.store(CAPACITY - 3);
+        ring.consumer.consume();
+        check(ring.control.head.load() == shm::align8(shm::FRAME_HEADER + 5),
+              "consume publishes the consumer's own head");
+        
+        std::string text;
+        check(receive(ring.consumer, text, id) && text == "second" && id == 2, "second frame intact");
+        check(ring.guards_intact(), "guards after corrupted head");
+    }
+    
+    // Peer-owned indexes that are out of range are refused, not followed
+    void test_peer_indexes_validated() {
+        TestRing ring;
+        ring.control.head.store(CAPACITY * 4);
+        check(ring.producer.reserve(16) == nullptr, "head ahead of tail");
+        ring.control.head.store(3);
+        check(ring.producer.reserve(16) == nullptr, "unaligned head");
+        
+        TestRing other;
+        const uint8_t* payload = nullptr;
+        size_t size = 0;
+        uint32_t id = 0;
+        other.control.tail.store(CAPACITY + 8);
+        check(other.consumer.peek(payload, size, id) == shm::Ring::Peek::CORRUPT, "tail beyond capacity");
+        other.control.tail.store(12);
+        check(other.consumer.peek(payload, size, id) == shm::Ring::Peek::CORRUPT, "unaligned tail");
+        
+        TestRing lying;
+        uint32_t huge = 1024 * 1024;
+        std::memcpy(lying.memory.data() + GUARD, &huge, sizeof(huge));
+        lying.control.tail.store(16);
+        check(lying.consumer.peek(payload, size, id) == shm::Ring::Peek::CORRUPT, "length beyond tail");
+        
+        TestRing wrapping;
+        std::memcpy(wrapping.memory.data() + GUARD, &shm::WRAP_MARKER, sizeof(shm::WRAP_MARKER));
+        wrapping.control.tail.store(16);
+        check(wrapping.consumer.peek(payload, size, id) == shm::Ring::Peek::CORRUPT, "wrap beyond tail");
+        check(wrapping.control.head.load() == 0, "corrupt wrap leaves head alone");
+    }
+    
+    // The server side maps what the client created and both directions work
+    void test_channel_attach() {
+        std::string error;
+        auto client = shm::Channel::create(CAPACITY, error);
+        check(client != nullptr, "create channel");
+        if (!client) {
+            return;
+        }
+        auto server = shm::Channel::attach(::dup(client->memfd()), ::dup(client->client_event()),
+                                           ::dup(client->server_event()), error);
+        check(server != nullptr, "attach channel");
+        if (!server) {
+            return;
+        }
+        
+        const std::string request = "request";
+        check(client->send(reinterpret_cast<const uint8_t*>(request.data()), request.size(), 9, 1000),
+              "client send");
+        std::vector<uint8_t> received;
+        uint32_t id = 0;
+        check(server->receive(received, id, 1000), "server receive");
+        check(std::string(received.begin(), received.end()) == request && id == 9, "request contents");
+        
+        const std::string response = "response";
+        check(server->send(reinterpret_cast<const uint8_t*>(response.data()), response.size(), 9, 1000),
+              "server send");
+        check(client->receive(received, id, 1000), "client receive");
+        check(std::string(received.begin(), received.end()) == response && id == 9, "response contents");
+        
+        check(!server->receive(received, id, 0), "empty ring times out");
+    }
+    
+    void test_attach_rejects_unsealed() {
+        int memfd = ::memfd_create("diarkis-shm-test", MFD_CLOEXEC);
+        check(memfd >= 0 && ::ftruncate(memfd, static_cast<off_t>(shm::mapping_size(CAPACITY))) == 0,
+              "allocate unsealed memory");
+        std::string error;
+        auto server = shm::Channel::attach(memfd, ::eventfd(0, EFD_CLOEXEC), ::eventfd(0, EFD_CLOEXEC), error);
+        check(server == nullptr, "unsealed memory rejected");
+    }
+    
+    // Event descriptors come from the client: anything but an eventfd is
+    // refused, and blocking eventfds are made non-blocking
+    void test_attach_checks_events() {
+        std::string error;
+        auto client = shm::Channel::create(CAPACITY, error);
+        check(client != nullptr, "create channel");
+        if (!client) {
+            return;
+        }
+        
+        int pipe_fds[2];
+        check(::pipe(pipe_fds) == 0, "pipe");
+        auto server = shm::Channel::attach(::dup(client->memfd()), pipe_fds[0], ::dup(client->server_event()), error);
+        check(server == nullptr, "pipe as event rejected");
+        ::close(pipe_fds[1]);
+        
+        int blocking = ::eventfd(0, EFD_CLOEXEC);
+        server = shm::Channel::attach(::dup(client->memfd()), ::dup(client->client_event()), blocking, error);
+        check(server != nullptr, "blocking eventfd accepted");
+        check((::fcntl(blocking, F_GETFL) & O_NONBLOCK) != 0, "eventfd made non-blocking");
+        
+        // A timed out wait returns without blocking on the eventfd
+        std::vector<uint8_t> received;
+        uint32_t id = 0;
+        check(server && !server->receive(received, id, 10), "receive times out");
+    }
+}
+
+int main() {
+    test_round_trip_with_wrap();
+    test_oversized_frame_rejected();
+    test_tail_corrupted_between_reserve_and_commit();
+    test_head_corrupted_between_peek_and_consume();
+    test_peer_indexes_validated();
+    test_channel_attach();
+    test_attach_rejects_unsealed();
+    test_attach_checks_events();
+    
+    return diarkis::test::finish("shm");
+}
@@ -0,0 +1,152 @@
+
+#include "diarkis/storage.h"
+#include "check.h"
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace {
+    using diarkis::test::check;
+    
+    // Makes fallocate fail like a filesystem without hole punching
+    bool g_fallocate_unsupported = false;
+    
+    // Spans more than one of the zero fill's 64 KB writes
+    constexpr size_t IO_SPAN = 200 * 1024;
+    
+    std::vector<uint8_t> bytes(const std::string& text) {
+        return std::vector<uint8_t>(text.begin(), text.end());
+    }
+    
+    std::vector<uint8_t> read_or_empty(diarkis::Storage& storage, const std::string& path) {
+        auto result = storage.read_file(path);
+        return result.ok() ? result.value() : std::vector<uint8_t>();
+    }
+    
+    // Copying a file onto itself under another spelling must fail and leave
+    // the source intact
+    void test_copy_onto_alias(diarkis::Storage& storage) {
+        auto contents = bytes("source contents");
+        check(storage.create_directory("dir").ok(), "create dir");
+        check(storage.write_file("dir/a", contents.data(), contents.size()).ok(), "write dir/a");
+        
+        for (const char* alias : {"dir/a", "./dir/a", "dir//a", "dir/./a", "dir/a/"}) {
+            check(!storage.copy_file("dir/a", alias).ok(), alias);
+            check(read_or_empty(storage, "dir/a") == contents, alias);
+        }
+        
+        std::string full = storage.base_path() + "/dir/a";
+        std::string link = storage.base_path() + "/dir/link";
+        check(::link(full.c_str(), link.c_str()) == 0, "hard link");
+        check(!storage.copy_file("dir/a", "dir/link").ok(), "copy onto hard link");
+        check(read_or_empty(storage, "dir/a") == contents, "source after hard link copy");
+    }
+    
+    // A copy over a longer file leaves exactly the source's bytes
+    void test_copy_replaces_destination(diarkis::Storage& storage) {
+        auto small = bytes("small");
+        auto large = bytes("a much longer destination file");
+        check(storage.write_file("src", small.data(), small.size()).ok(), "write src");
+        check(storage.write_file("dst", large.data(), large.size()).ok(), "write dst");
+        check(storage.copy_file("src", "dst").ok(), "copy src to dst");
+        check(read_or_empty(storage, "dst") == small, "dst matches src");
+    }
+    
+    // Renaming a file onto another spelling of itself takes its lock once
+    void test_rename_onto_alias(diarkis::Storage& storage) {
+        auto contents = bytes("renamed");
+        check(storage.write_file("alias", contents.data(), contents.size()).ok(), "write alias");
+        check(storage.rename("alias", "./alias").ok(), "rename onto alias");
+        check(read_or_empty(storage, "alias") == contents, "alias after rename");
+    }
+    
+    void test_truncate(diarkis::Storage& storage) {
+        auto contents = bytes("hello world");
+        check(storage.write_file("trunc", contents.data(), contents.size()).ok(), "write trunc");
+        
+        check(storage.truncate_file("trunc", 5).ok(), "truncate shorter");
+        check(read_or_empty(storage, "trunc") == bytes("hello"), "truncated contents");
+        
+        check(storage.truncate_file("trunc", 8).ok(), "truncate longer");
+        check(read_or_empty(storage, "trunc") == bytes(std::string("hello\0\0\0", 8)), "extended with zeros");
+        
+        check(!storage.truncate_file("trunc", diarkis::Storage::MAX_FILE_SIZE + 1).ok(),
+              "truncate beyond the largest file");
+        check(read_or_empty(storage, "trunc").size() == 8, "rejected truncate leaves the file");
+        
+        check(!storage.truncate_file("missing", 0).ok(), "truncate missing file");
+    }
+    
+    void test_punch_hole(diarkis::Storage& storage) {
+        std::string text(16, 'x');
+        auto contents = bytes(text);
+        check(storage.write_file("holes", contents.data(), contents.size()).ok(), "write holes");
+        
+        check(storage.punch_hole("holes", 4, 8).ok(), "punch inside");
+        check(read_or_empty(storage, "holes") == bytes(text.replace(4, 8, 8, '\0')), "hole reads as zeros");
+        
+        // Clamped to the end of the file, which keeps its size
+        check(storage.punch_hole("holes", 14, 100).ok(), "punch past the end");
+        check(read_or_empty(storage, "holes") == bytes(text.replace(14, 2, 2, '\0')), "clamped hole");
+        check(storage.punch_hole("holes", 64, 8).ok(), "punch beyond the end");
+        check(read_or_empty(storage, "holes").size() == 16, "size kept");
+        
+        check(!storage.punch_hole("holes", diarkis::Storage::MAX_FILE_SIZE + 1, 1).ok(),
+              "offset beyond the largest file");
+        check(!storage.punch_hole("holes", 0, diarkis::Storage::MAX_FILE_SIZE + 1).ok(),
+              "length beyond the largest file");
+        check(!storage.punch_hole("missing", 0, 1).ok(), "punch missing file");
+    }
+    
+    // Without hole punching the range is overwritten with zeros instead
+    void test_punch_hole_fallback(diarkis::Storage& storage) {
+        std::string text(IO_SPAN, 'y');
+        auto contents = bytes(text);
+        check(storage.write_file("zeroed", contents.data(), contents.size()).ok(), "write zeroed");
+        
+        g_fallocate_unsupported = true;
+        bool punched = storage.punch_hole("zeroed", 1, IO_SPAN - 2).ok();
+        g_fallocate_unsupported = false;
+        
+        check(punched, "punch without fallocate");
+        text.replace(1, IO_SPAN - 2, IO_SPAN - 2, '\0');
+        check(read_or_empty(storage, "zeroed") == bytes(text), "range zero filled");
+    }
+}
+
+// Overrides libc's fallocate for the whole test binary
+extern "C" int fallocate(int fd, int mode, off_t offset, off_t len) {
+    if (g_fallocate_unsupported) {
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    return static_cast<int>(::syscall(SYS_fallocate, fd, mode, offset, len));
+}
+
+int main() {
+    char dir_template[] = "/tmp/diarkis_storage_test_XXXXXX";
+    char* dir = ::mkdtemp(dir_template);
+    if (!dir) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    
+    diarkis::Storage storage(dir);
+    check(storage.init().ok(), "init");
+    test_copy_onto_alias(storage);
+    test_copy_replaces_destination(storage);
+    test_rename_onto_alias(storage);
+    test_truncate(storage);
+    test_punch_hole(storage);
+    test_punch_hole_fallback(storage);
+    
+    std::string cleanup = std::string("rm -rf ") + dir;
+    std::system(cleanup.c_str());
+    
+    return diarkis::test::finish("storage");
+}
@@ -0,0 +1,94 @@
+#include "diarkis/tcp.h"
+#include "check.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+    using namespace std::chrono_literals;
+    
+    using diarkis::test::check;
+    
+    constexpr int CONNECTIONS = 200;
+    
+    size_t open_fds() {
+        size_t count = 0;
+        DIR* dir = ::opendir("/proc/self/fd");
+        if (!dir) {
+            return 0;
+        }
+        while (::readdir(dir)) {
+            ++count;
+        }
+        ::closedir(dir);
+        return count;
+    }
+    
+    int connect_to(uint16_t port) {
+        int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    
+    bool wait_idle(const diarkis::TcpServer& server) {
+        for (int i = 0; i < 500 && server.active_connections() > 0; ++i) {
+            std::this_thread::sleep_for(10ms);
+        }
+        return server.active_connections() == 0;
+    }
+    
+    // Opens and drops connections against a server running handler, and
+    // checks the server holds no more descriptors afterwards than before
+    void check_no_leak(diarkis::ConnectionHandler handler, const char* what) {
+        diarkis::TcpServer::Options options;
+        options.address = "127.0.0.1";
+        diarkis::TcpServer server(options);
+        server.set_connection_handler(std::move(handler));
+        if (!server.start()) {
+            check(false, "start server");
+            return;
+        }
+        
+        size_t before = open_fds();
+        int connected = 0;
+        for (int i = 0; i < CONNECTIONS; ++i) {
+            int fd = connect_to(server.port());
+            if (fd >= 0) {
+                ++connected;
+                ::close(fd);
+            }
+        }
+        check(connected == CONNECTIONS, "connect");
+        check(wait_idle(server), "handlers finished");
+        check(open_fds() <= before, what);
+        server.stop();
+    }
+}
+
+int main() {
+    // The peer ends the connection while the handler waits for input
+    check_no_leak([](std::shared_ptr<diarkis::TcpConnection> conn) {
+        char byte;
+        while (conn->receive_exact(&byte, 1)) {
+        }
+    }, "descriptors released after the peer disconnects");
+    
+    // The handler gives up on a connection the peer still holds
+    check_no_leak([](std::shared_ptr<diarkis::TcpConnection>) {
+    }, "descriptors released after the handler returns");
+    
+    return diarkis::test::finish("tcp");
+}